@@ -0,0 +1,91 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "libe2c/consensus.h"
+#include "libe2c/crypto.h"
+
+namespace e2c {
+
+/** A replica without network or timers, only running the state machine. */
+class BenchCore: public E2CCore {
+    public:
+    uint64_t ndecided;
+
+    BenchCore(ReplicaID rid, size_t nreplicas):
+            E2CCore(rid, new PrivKeyDummy()), ndecided(0) {
+        for (size_t i = 0; i < nreplicas; i++)
+            add_replica(i, PeerId(uint256_t()), new PubKeyDummy());
+        on_init((nreplicas - 1) / 2);
+    }
+
+    using E2CCore::commit_timer_cb;
+    using E2CCore::update;
+
+    protected:
+    void do_decide(Finality &&) override { ndecided++; }
+    void do_consensus(const block_t &) override {}
+    void do_broadcast_proposal(const Proposal &) override {}
+    /* commit timers are fired by the benchmarks */
+    void do_set_commit_timer(const block_t &, double) override {}
+    void do_broadcast_blame(const Blame &) override {}
+    void do_broadcast_equiv_blame(const EquivBlame &) override {}
+    void do_broadcast_quit_view(const QuitView &) override {}
+    void do_set_view_timer(uint32_t, double) override {}
+    void do_send_status(const Status &) override {}
+
+    public:
+    part_cert_bt create_part_cert(const PrivKey &, const uint256_t &blk_hash) override {
+        return new PartCertDummy(blk_hash);
+    }
+
+    part_cert_bt parse_part_cert(DataStream &s) override {
+        PartCert *pc = new PartCertDummy();
+        s >> *pc;
+        return pc;
+    }
+
+    quorum_cert_bt create_quorum_cert(const uint256_t &blk_hash) override {
+        return new QuorumCertDummy(get_config(), blk_hash);
+    }
+
+    quorum_cert_bt parse_quorum_cert(DataStream &s) override {
+        QuorumCert *qc = new QuorumCertDummy();
+        s >> *qc;
+        return qc;
+    }
+};
+
+inline std::vector<uint256_t> gen_cmds(size_t n, size_t salt = 0) {
+    std::vector<uint256_t> cmds;
+    for (size_t i = 0; i < n; i++)
+        cmds.push_back(salticidae::get_hash(salt * n + i));
+    return cmds;
+}
+
+/** A signed block at height nparents + 1 with nparents distinct parents. */
+inline block_t gen_block(BenchCore &core, size_t blk_size, size_t nparents) {
+    std::vector<block_t> parents;
+    for (size_t i = 0; i < nparents; i++)
+        parents.push_back(new Block(
+            std::vector<block_t>{core.get_genesis()}, gen_cmds(1, i),
+            bytearray_t(), 1, core.get_id()));
+    block_t blk = new Block(parents, gen_cmds(blk_size),
+                            bytearray_t(), nparents + 1, core.get_id());
+    blk->set_signature(new PartCertDummy(blk->get_hash()));
+    return blk;
+}
+
+}
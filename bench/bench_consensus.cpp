@@ -0,0 +1,192 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "libe2c/e2c.h"
+#include "bench_common.h"
+
+using namespace e2c;
+
+/* the inputs prepared at once outside of the timed region, so that pausing
+ * the timer is amortized over as many iterations */
+static const size_t prepared = 1024;
+
+/* Arguments: number of commands, number of parents. */
+static void block_args(benchmark::internal::Benchmark *b) {
+    b->ArgsProduct({{1, 100, 1000}, {1, 16, 128}});
+}
+
+static void BM_BlockSerialize(benchmark::State &state) {
+    BenchCore core(0, 4);
+    block_t blk = gen_block(core, state.range(0), state.range(1));
+    size_t nbytes = 0;
+    for (auto _: state) {
+        DataStream s;
+        s << *blk;
+        nbytes = s.size();
+        benchmark::DoNotOptimize(s.data());
+    }
+    state.SetBytesProcessed(state.iterations() * nbytes);
+}
+BENCHMARK(BM_BlockSerialize)->Apply(block_args);
+
+static void BM_BlockUnserialize(benchmark::State &state) {
+    BenchCore core(0, 4);
+    block_t blk = gen_block(core, state.range(0), state.range(1));
+    DataStream s;
+    s << *blk;
+    bytearray_t raw(std::move(s));
+    std::vector<DataStream> streams;
+    for (auto _: state) {
+        if (streams.empty())
+        {
+            /* copy the bytes outside of the timed region */
+            state.PauseTiming();
+            for (size_t i = 0; i < prepared; i++)
+                streams.emplace_back(bytearray_t(raw));
+            state.ResumeTiming();
+        }
+        Block b;
+        b.unserialize(streams.back(), &core);
+        benchmark::DoNotOptimize(b.get_hash());
+        streams.pop_back();
+    }
+    state.SetBytesProcessed(state.iterations() * raw.size());
+}
+BENCHMARK(BM_BlockUnserialize)->Apply(block_args);
+
+static void BM_BlockHash(benchmark::State &state) {
+    BenchCore core(0, 4);
+    block_t blk = gen_block(core, state.range(0), state.range(1));
+    /* what building a block costs: the command root, then the header */
+    for (auto _: state)
+    {
+        benchmark::DoNotOptimize(MerkleTree::root(blk->get_cmds()));
+        benchmark::DoNotOptimize(blk->header_hash());
+    }
+}
+BENCHMARK(BM_BlockHash)->Apply(block_args);
+
+/* Serialize a proposal on the proposer and parse it on another replica, as
+ * done for every MsgPropose on the wire. */
+static void BM_ProposeRoundTrip(benchmark::State &state) {
+    BenchCore core(0, 4);
+    BenchCore peer(1, 4);
+    block_t blk = gen_block(core, state.range(0), state.range(1));
+    /* the block parsed again is added to the storage of the peer the same
+     * way, only the copy already there is kept */
+    for (auto _: state) {
+        MsgPropose msg(Proposal(blk, &core));
+        MsgPropose msg2(std::move(msg.serialized));
+        msg2.postponed_parse(&peer);
+        benchmark::DoNotOptimize(msg2.proposal.blk);
+    }
+}
+BENCHMARK(BM_ProposeRoundTrip)->Apply(block_args);
+
+/* Build the MsgPropose a replica forwards after receiving a proposal, from
+ * the parsed block (range(2) = 0) or from the received bytes (range(2) = 1). */
+static void BM_ProposeForward(benchmark::State &state) {
+    BenchCore core(0, 4);
+    BenchCore peer(1, 4);
+    block_t blk = gen_block(core, state.range(0), state.range(1));
+    MsgPropose msg(Proposal(blk, &core));
+    MsgPropose recv(std::move(msg.serialized));
+    recv.postponed_parse(&peer);
+    Proposal prop = recv.proposal;
+    if (!state.range(2)) prop.raw = nullptr;
+    for (auto _: state) {
+        MsgPropose fwd(prop);
+        benchmark::DoNotOptimize(fwd.serialized.size());
+    }
+}
+BENCHMARK(BM_ProposeForward)->ArgsProduct({{1, 100, 1000}, {1, 16, 128}, {0, 1}});
+
+/* Encode a proposal in its compact form and rebuild it on another replica
+ * from 4 * blk_size stored batch hashes, with the bytes per command of both
+ * encodings. */
+static void BM_ProposeCompact(benchmark::State &state) {
+    BenchCore core(0, 4);
+    BenchCore peer(1, 4);
+    block_t blk = gen_block(core, state.range(0), 1);
+    auto pool = gen_cmds(3 * state.range(0), 1);
+    for (const auto &cmd: blk->get_cmds())
+        pool.push_back(cmd);
+    size_t nbytes = 0;
+    for (auto _: state) {
+        MsgProposeCompact msg(Proposal(blk, &core));
+        nbytes = msg.serialized.size();
+        MsgProposeCompact recv(std::move(msg.serialized));
+        recv.postponed_parse(&peer);
+        auto key = recv.cp.get_key();
+        std::unordered_map<uint64_t, uint256_t> ids;
+        for (const auto &h: pool)
+            ids.insert(std::make_pair(CompactProposal::short_id(key, h), h));
+        std::vector<uint256_t> cmds;
+        for (auto id: recv.cp.short_ids)
+            cmds.push_back(ids[id]);
+        Block b = recv.cp.to_block(std::move(cmds));
+        if (b.get_hash() != blk->get_hash())
+            state.SkipWithError("rebuilt a different block");
+        benchmark::DoNotOptimize(b.get_hash());
+    }
+    DataStream full;
+    full << Proposal(blk, &core);
+    state.counters["full_bytes_per_cmd"] = (double)full.size() / state.range(0);
+    state.counters["compact_bytes_per_cmd"] = (double)nbytes / state.range(0);
+}
+BENCHMARK(BM_ProposeCompact)->Arg(100)->Arg(1000);
+
+/* update() on the blocks of a chain delivered beforehand, as done for each
+ * new block. The chain is updated again from its start once it is done. */
+static void BM_CoreUpdate(benchmark::State &state) {
+    BenchCore core(0, 4);
+    auto cmds = gen_cmds(state.range(0));
+    std::vector<block_t> chain;
+    block_t tail = core.get_genesis();
+    for (size_t i = 0; i < prepared; i++)
+        chain.push_back(tail = core.on_propose(cmds, {tail}));
+    size_t next = chain.size();
+    for (auto _: state) {
+        if (next == chain.size())
+        {
+            state.PauseTiming();
+            core.ht_blk_map.clear();
+            next = 0;
+            state.ResumeTiming();
+        }
+        core.update(chain[next++]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CoreUpdate)->Arg(1)->Arg(100)->Arg(1000);
+
+/* Commit a chain of `depth` undecided blocks in a single timer callback. */
+static void BM_CommitCascade(benchmark::State &state) {
+    const size_t depth = state.range(0);
+    auto cmds = gen_cmds(state.range(1));
+    for (auto _: state) {
+        state.PauseTiming();
+        BenchCore core(0, 4);
+        block_t tail = core.get_genesis();
+        for (size_t i = 0; i < depth; i++)
+            tail = core.on_propose(cmds, {tail});
+        state.ResumeTiming();
+        core.commit_timer_cb(tail->get_height(), core.get_view());
+        benchmark::DoNotOptimize(core.ndecided);
+    }
+    state.SetItemsProcessed(state.iterations() * depth * cmds.size());
+}
+BENCHMARK(BM_CommitCascade)->ArgsProduct({{1, 16, 128}, {1, 100}});
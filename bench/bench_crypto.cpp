@@ -0,0 +1,216 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <memory>
+
+#include "libe2c/crypto.h"
+#include "libe2c/task.h"
+#include "libe2c/entity.h"
+#include "libe2c/sha256.h"
+
+using namespace e2c;
+
+template<typename PrivKeyType, typename PubKeyType>
+struct Keys {
+    using pubkey_type = PubKeyType;
+    std::vector<PrivKeyType> privs;
+    std::vector<PubKeyType> pubs;
+
+    Keys(size_t n) {
+        privs.resize(n);
+        for (auto &p: privs)
+        {
+            p.from_rand();
+            pubs.push_back(PubKeyType(p));
+        }
+    }
+};
+
+using Secp256k1Keys = Keys<PrivKeySecp256k1, PubKeySecp256k1>;
+using Ed25519Keys = Keys<PrivKeyEd25519, PubKeyEd25519>;
+
+static void BM_Secp256k1Sign(benchmark::State &state) {
+    Secp256k1Keys keys(1);
+    uint256_t msg = salticidae::get_hash(0);
+    for (auto _: state)
+        benchmark::DoNotOptimize(PartCertSecp256k1(keys.privs[0], msg));
+}
+BENCHMARK(BM_Secp256k1Sign);
+
+static void BM_Secp256k1Verify(benchmark::State &state) {
+    Secp256k1Keys keys(1);
+    uint256_t msg = salticidae::get_hash(0);
+    PartCertSecp256k1 pc(keys.privs[0], msg);
+    for (auto _: state)
+        benchmark::DoNotOptimize(pc.verify(keys.pubs[0]));
+}
+BENCHMARK(BM_Secp256k1Verify);
+
+static void BM_Ed25519Sign(benchmark::State &state) {
+    Ed25519Keys keys(1);
+    uint256_t msg = salticidae::get_hash(0);
+    for (auto _: state)
+        benchmark::DoNotOptimize(PartCertEd25519(keys.privs[0], msg));
+}
+BENCHMARK(BM_Ed25519Sign);
+
+static void BM_Ed25519Verify(benchmark::State &state) {
+    Ed25519Keys keys(1);
+    uint256_t msg = salticidae::get_hash(0);
+    PartCertEd25519 pc(keys.privs[0], msg);
+    for (auto _: state)
+        benchmark::DoNotOptimize(pc.verify(keys.pubs[0]));
+}
+BENCHMARK(BM_Ed25519Verify);
+
+/* Verify a batch of signatures through a VeriPool with range(0) workers. */
+static void BM_VeriPool(benchmark::State &state) {
+    const size_t nworker = state.range(0);
+    const size_t batch = state.range(1);
+    Secp256k1Keys keys(1);
+    uint256_t msg = salticidae::get_hash(0);
+    SigSecp256k1 sig(msg, keys.privs[0]);
+    EventContext ec;
+    VeriPool vpool(ec, nworker);
+    for (auto _: state) {
+        std::vector<promise_t> pms;
+        for (size_t i = 0; i < batch; i++)
+            pms.push_back(vpool.verify(
+                new Secp256k1VeriTask(msg, keys.pubs[0], sig)));
+        promise::all(pms).then([ec](const promise::values_t &) mutable {
+            ec.stop();
+        });
+        ec.dispatch();
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+    state.counters["task_bytes"] = sizeof(Secp256k1VeriTask);
+}
+BENCHMARK(BM_VeriPool)->ArgsProduct({{1, 2, 4, 8}, {16, 128}})->UseRealTime();
+
+template<typename KeysType>
+static ReplicaConfig gen_config(const KeysType &keys) {
+    using PubKeyType = typename KeysType::pubkey_type;
+    ReplicaConfig config;
+    for (size_t i = 0; i < keys.pubs.size(); i++)
+        config.add_replica(i, ReplicaInfo(i, salticidae::PeerId(uint256_t()),
+                                          new PubKeyType(keys.pubs[i])));
+    config.nmajority = config.nreplicas - (config.nreplicas - 1) / 2;
+    return config;
+}
+
+/* Same as BM_VeriPool, with the tasks referring to the key by the replica
+ * index in the configuration. */
+static void BM_VeriPoolReplica(benchmark::State &state) {
+    const size_t nworker = state.range(0);
+    const size_t batch = state.range(1);
+    Secp256k1Keys keys(1);
+    ReplicaConfig config = gen_config(keys);
+    uint256_t msg = salticidae::get_hash(0);
+    SigSecp256k1 sig(msg, keys.privs[0]);
+    const bytearray_t raw_msg = msg;
+    EventContext ec;
+    VeriPool vpool(ec, nworker);
+    for (auto _: state) {
+        std::vector<promise_t> pms;
+        for (size_t i = 0; i < batch; i++)
+            pms.push_back(vpool.verify(
+                new Secp256k1ReplicaVeriTask(config, 0, &raw_msg[0], sig)));
+        promise::all(pms).then([ec](const promise::values_t &) mutable {
+            ec.stop();
+        });
+        ec.dispatch();
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+    state.counters["task_bytes"] = sizeof(Secp256k1ReplicaVeriTask);
+}
+BENCHMARK(BM_VeriPoolReplica)->ArgsProduct({{1, 2, 4, 8}, {16, 128}})->UseRealTime();
+
+/* Build and verify a quorum certificate of a majority out of range(0)
+ * replicas. */
+static void BM_QuorumCertVerify(benchmark::State &state) {
+    Secp256k1Keys keys(state.range(0));
+    ReplicaConfig config = gen_config(keys);
+    uint256_t msg = salticidae::get_hash(0);
+    QuorumCertSecp256k1 qc(config, msg);
+    for (size_t i = 0; i < config.nmajority; i++)
+        qc.add_part(i, PartCertSecp256k1(keys.privs[i], msg));
+    qc.compute();
+    DataStream s;
+    s << qc;
+    state.counters["qc_bytes"] = s.size();
+    for (auto _: state)
+        benchmark::DoNotOptimize(qc.verify(config));
+}
+BENCHMARK(BM_QuorumCertVerify)->Arg(4)->Arg(16)->Arg(64);
+
+static void BM_QuorumCertEd25519Verify(benchmark::State &state) {
+    Ed25519Keys keys(state.range(0));
+    ReplicaConfig config = gen_config(keys);
+    uint256_t msg = salticidae::get_hash(0);
+    QuorumCertEd25519 qc(config, msg);
+    for (size_t i = 0; i < config.nmajority; i++)
+        qc.add_part(i, PartCertEd25519(keys.privs[i], msg));
+    qc.compute();
+    DataStream s;
+    s << qc;
+    state.counters["qc_bytes"] = s.size();
+    for (auto _: state)
+        benchmark::DoNotOptimize(qc.verify(config));
+}
+BENCHMARK(BM_QuorumCertEd25519Verify)->Arg(4)->Arg(16)->Arg(64);
+
+/* Hash 1024 messages of range(0) bytes, one salticidae::get_hash each
+ * (range(1) = -1) or in one batch with a kernel (range(1) = Sha256Kernel). */
+static void BM_Sha256Batch(benchmark::State &state) {
+    const size_t n = 1024;
+    const size_t len = state.range(0);
+    std::vector<bytearray_t> msgs(n, bytearray_t(len));
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < len; j++)
+            msgs[i][j] = i + j;
+    std::vector<const uint8_t *> ptrs;
+    std::vector<size_t> lens;
+    for (const auto &m: msgs)
+    {
+        ptrs.push_back(m.data());
+        lens.push_back(m.size());
+    }
+    std::unique_ptr<uint8_t[][32]> digests(new uint8_t[n][32]);
+    if (state.range(1) < 0)
+    {
+        state.SetLabel("get_hash");
+        for (auto _: state)
+            for (const auto &m: msgs)
+                benchmark::DoNotOptimize(salticidae::get_hash(m));
+    }
+    else
+    {
+        auto kernel = (Sha256Kernel)state.range(1);
+        if (!sha256_supported(kernel))
+        {
+            state.SkipWithError("kernel not supported by the CPU");
+            return;
+        }
+        state.SetLabel(sha256_kernel_name(kernel));
+        for (auto _: state)
+        {
+            sha256_batch(kernel, ptrs.data(), lens.data(), n, digests.get());
+            benchmark::DoNotOptimize(digests.get());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    state.SetBytesProcessed(state.iterations() * n * len);
+}
+BENCHMARK(BM_Sha256Batch)->ArgsProduct({{8, 40, 64, 256, 1024, 4096}, {-1, 0, 1, 2}});
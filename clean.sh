@@ -6,7 +6,9 @@ rm -rf CMakeCache.txt CMakeFiles/ CMakeDoxyfile.in CMakeDoxygenDefaults.cmake \
 # Clean Test Directory
 rm -rf test/{Makefile,cmake_install.cmake,test_secp256k1}
 # Clean Programs Directory
-rm -rf programs/{CMakeFiles,Makefile,cmake_install.cmake,e2c-app,e2c-client}
+rm -rf programs/{CMakeFiles,Makefile,cmake_install.cmake,e2c-app,e2c-client,e2c-sim,e2c-logdump}
+# Clean Benchmarks Directory
+rm -rf bench/{CMakeFiles,Makefile,cmake_install.cmake,bench_consensus,bench_crypto}
 # Clean Binaries in the root directory
 rm -rf tls-keygen keygen
 # Clean Logs
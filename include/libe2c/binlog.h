@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+ * NOTE: Asynchronous binary log. A log call copies its format id, timestamp
+ * and raw arguments into a fixed-size record in a ring owned by the calling
+ * thread (single producer, single consumer). A background thread drains all
+ * rings to the file, so the caller never formats nor does I/O. The records
+ * are rendered offline by e2c-logdump using the format strings stored in the
+ * same file. When a ring is full the record is dropped (and counted).
+ *
+ * The commit timers run on short-lived threads, so a ring is released when
+ * its thread exits and, once drained, handed to the next new thread. The
+ * number of rings (and the tids in the records) is thus bounded by the
+ * threads alive at the same time; a tid identifies a ring, not a thread.
+ *
+ * File layout: the magic "E2CBLOG1", then a sequence of entries, each one is
+ * either 'F' <u32 id> <u16 len> <format string>, or 'R' <record>.
+ */
+
+namespace e2c {
+
+struct BinLogRecord {
+    static const size_t size = 128;
+    static const size_t payload_size = size - 16;
+
+    uint64_t ts;     /**< nanoseconds since the epoch */
+    uint32_t fmt_id;
+    uint16_t tid;
+    uint16_t nbytes; /**< used bytes of payload */
+    /* integers and floats take 8 bytes, strings a length byte followed by
+     * the (truncated) characters */
+    uint8_t payload[payload_size];
+
+    size_t room() const { return payload_size - nbytes; }
+
+    void put(const void *data, size_t len) {
+        memmove(payload + nbytes, data, len);
+        nbytes += len;
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value ||
+                            std::is_enum<T>::value>::type
+    put_arg(T v) {
+        if (room() < 8) return;
+        uint64_t x = std::is_signed<T>::value ? (uint64_t)(int64_t)v : (uint64_t)v;
+        put(&x, 8);
+    }
+
+    void put_arg(double v) {
+        if (room() < 8) return;
+        put(&v, 8);
+    }
+
+    void put_arg(const char *s) {
+        if (room() < 1) return;
+        size_t len = std::min(strlen(s), room() - 1);
+        uint8_t l = std::min<size_t>(len, 255);
+        put(&l, 1);
+        put(s, l);
+    }
+
+    void put_arg(const std::string &s) { put_arg(s.c_str()); }
+
+    template<typename T>
+    void put_arg(T *p) { put_arg((uint64_t)(uintptr_t)p); }
+
+    void put_args() {}
+
+    template<typename T, typename... Args>
+    void put_args(const T &v, const Args &...args) {
+        put_arg(v);
+        put_args(args...);
+    }
+
+    /** Render the arguments with their printf-style format. */
+    std::string render(const std::string &fmt) const;
+};
+
+static_assert(sizeof(BinLogRecord) == BinLogRecord::size, "unexpected record padding");
+
+class BinLog {
+    static const size_t ring_capacity = 4096;
+
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        std::atomic<bool> released{false}; /**< its thread has exited */
+        uint16_t tid;
+        BinLogRecord records[ring_capacity];
+    };
+
+    std::atomic<bool> opened;
+    std::atomic<bool> running;
+    FILE *file;
+    std::thread writer;
+    std::mutex lock;
+    /* protected by lock */
+    std::vector<std::shared_ptr<Ring>> rings;
+    /* released and drained, ready for the next new thread */
+    std::vector<std::shared_ptr<Ring>> free_rings;
+    std::vector<std::string> formats;
+    size_t nformats_written;
+    const uint64_t serial; /**< tells the instances apart in get_ring() */
+
+    /** The rings of the calling thread, released when it exits. */
+    struct ThreadRings;
+
+    Ring *get_ring();
+    /** Drain all rings (and new formats) to the file, then recycle the
+     * drained rings of the exited threads.
+     * @return the number of records written */
+    size_t flush();
+    void writer_loop();
+    static uint64_t next_serial();
+
+    public:
+    std::atomic<uint64_t> ndropped;
+
+    BinLog(): opened(false), running(false), file(nullptr),
+        nformats_written(0), serial(next_serial()), ndropped(0) {}
+    ~BinLog() { close(); }
+
+    /** Start writing to path.
+     * @return false if the file cannot be opened */
+    bool open(const std::string &path);
+    /** Flush the remaining records and stop the writer thread. */
+    void close();
+    bool is_open() const { return opened.load(std::memory_order_relaxed); }
+
+    /** @return the id of a format string (registered on first use) */
+    uint32_t register_format(const char *fmt);
+
+    template<typename... Args>
+    void write(uint32_t fmt_id, const Args &...args) {
+        Ring *r = get_ring();
+        uint64_t h = r->head.load(std::memory_order_relaxed);
+        if (h - r->tail.load(std::memory_order_acquire) == ring_capacity)
+        {
+            ndropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        auto &rec = r->records[h % ring_capacity];
+        rec.ts = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        rec.fmt_id = fmt_id;
+        rec.tid = r->tid;
+        rec.nbytes = 0;
+        rec.put_args(args...);
+        r->head.store(h + 1, std::memory_order_release);
+    }
+};
+
+extern BinLog binlog;
+
+}
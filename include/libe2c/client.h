@@ -15,6 +15,50 @@ struct MsgReqCmd {
     MsgReqCmd(DataStream &&s): serialized(std::move(s)) {}
 };
 
+/** A batch of commands submitted by a client in one message. When `forward`
+ * is set the client only sent the batch to this replica, which should forward
+ * it to the proposer if it is not the proposer itself. When `silent` is set
+ * the client expects the decisions from another replica. */
+struct MsgReqCmdBatch {
+    static const opcode_t opcode = 0x7;
+    DataStream serialized;
+    bool forward;
+    bool silent;
+    MsgReqCmdBatch(const std::vector<command_t> &cmds, bool forward = false,
+                    bool silent = false):
+            forward(forward), silent(silent) {
+        serialized << (uint8_t)(forward | silent << 1);
+        serialized << htole((uint32_t)cmds.size());
+        for (const auto &cmd: cmds)
+            serialized << *cmd;
+    }
+    MsgReqCmdBatch(DataStream &&s): serialized(std::move(s)) {
+        uint8_t flags;
+        serialized >> flags;
+        forward = flags & 1;
+        silent = flags & 2;
+    }
+};
+
+/** Ask a replica to reply the decisions of commands sent to other replicas. */
+struct MsgReqCmdWatch {
+    static const opcode_t opcode = 0x8;
+    DataStream serialized;
+    std::vector<uint256_t> cmd_hashes;
+    MsgReqCmdWatch(const std::vector<uint256_t> &cmd_hashes) {
+        serialized << htole((uint32_t)cmd_hashes.size());
+        for (const auto &h: cmd_hashes)
+            serialized << h;
+    }
+    MsgReqCmdWatch(DataStream &&s) {
+        uint32_t size;
+        s >> size;
+        size = letoh(size);
+        cmd_hashes.resize(size);
+        for (auto &h: cmd_hashes) s >> h;
+    }
+};
+
 struct MsgRespCmd {
     static const opcode_t opcode = 0x5;
     DataStream serialized;
@@ -34,6 +78,94 @@ struct MsgRespCmd {
     }
 };
 
+/** Responses to all commands of one client decided in the same block,
+ * together with the proposer the client should submit to. */
+struct MsgRespCmdBatch {
+    static const opcode_t opcode = 0x6;
+    DataStream serialized;
+#if EEC_CMD_RESPSIZE > 0
+    uint8_t payload[EEC_CMD_RESPSIZE];
+#endif
+    ReplicaID proposer;
+    std::vector<Finality> fins;
+    MsgRespCmdBatch(const std::vector<Finality> &fins, ReplicaID proposer) {
+        serialized << htole(proposer);
+        serialized << htole((uint32_t)fins.size());
+        for (const auto &fin: fins)
+        {
+            serialized << fin;
+#if EEC_CMD_RESPSIZE > 0
+            serialized.put_data(payload, payload + sizeof(payload));
+#endif
+        }
+    }
+    MsgRespCmdBatch(DataStream &&s) {
+        uint32_t size;
+        s >> proposer;
+        proposer = letoh(proposer);
+        s >> size;
+        size = letoh(size);
+        fins.resize(size);
+        for (auto &fin: fins)
+        {
+            s >> fin;
+#if EEC_CMD_RESPSIZE > 0
+            s.get_data_inplace(EEC_CMD_RESPSIZE);
+#endif
+        }
+    }
+};
+
+/** Responses to the commands of one client decided in the same block,
+ * with the proof of the commit: the header of the block and its
+ * CommitCert. Each Finality carries the Merkle path of its command under the
+ * header, so that one such response is enough for the client. */
+struct MsgRespCmdCert {
+    static const opcode_t opcode = 0x9;
+    DataStream serialized;
+#if EEC_CMD_RESPSIZE > 0
+    uint8_t payload[EEC_CMD_RESPSIZE];
+#endif
+    ReplicaID proposer;
+    Block header;
+    CommitCert cert;
+    std::vector<Finality> fins;
+    /** @param proof the header followed by the certificate */
+    MsgRespCmdCert(const bytearray_t &proof, const std::vector<Finality> &fins,
+                    ReplicaID proposer) {
+        serialized << htole(proposer);
+        serialized.put_data(proof.begin(), proof.end());
+        serialized << htole((uint32_t)fins.size());
+        for (const auto &fin: fins)
+        {
+            serialized << fin;
+#if EEC_CMD_RESPSIZE > 0
+            serialized.put_data(payload, payload + sizeof(payload));
+#endif
+        }
+    }
+    MsgRespCmdCert(DataStream &&s): serialized(std::move(s)) {}
+    /** Parse the message, the part certificates with the given crypto. */
+    void postponed_parse(const CryptoSuite &crypto) {
+        auto &s = serialized;
+        uint32_t size;
+        s >> proposer;
+        proposer = letoh(proposer);
+        header.unserialize_header(s);
+        cert.unserialize(s, crypto);
+        s >> size;
+        size = letoh(size);
+        fins.resize(size);
+        for (auto &fin: fins)
+        {
+            s >> fin;
+#if EEC_CMD_RESPSIZE > 0
+            s.get_data_inplace(EEC_CMD_RESPSIZE);
+#endif
+        }
+    }
+};
+
 class CommandDummy: public Command {
     uint32_t cid;
     uint32_t n;
@@ -43,6 +175,13 @@ class CommandDummy: public Command {
 #endif
 
     public:
+    /** the size of the encoding, which is also what the hash is taken on */
+#if EEC_CMD_REQSIZE > 0
+    static const size_t wire_size = 2 * sizeof(uint32_t) + EEC_CMD_REQSIZE;
+#else
+    static const size_t wire_size = 2 * sizeof(uint32_t);
+#endif
+
     CommandDummy() {}
     ~CommandDummy() override {}
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <mutex>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "libe2c/promise.hpp"
 #include "libe2c/type.h"
@@ -12,8 +15,15 @@
 namespace e2c {
 
 struct Proposal;
-// struct Blame ;     // TODO
-// struct QuitView ;  // TODO
+struct CompactProposal;
+struct Blame;
+struct EquivBlame;
+struct QuitView;
+struct Status;
+struct BatchAck;
+struct AvailCert;
+struct CommitVote;
+struct CommitCert;
 // struct ReqVote ;   // TODO
 // struct Vote ;      // TODO
 struct Finality;
@@ -26,26 +36,70 @@ class E2CCore {
     /** block containing the QC for the highest block having one */
     block_t b_mark;                            /**< locked block */
     block_t b_comm;                            /**< last executed block */
-    // On finishing 2\delta, use this to commit this block and all its ancestors
-    inline void commit_timer_cb (uint32_t ht);
     /* === auxilliary variables === */
     privkey_bt priv_key;            /**< private key for signing votes */
     std::set<block_t> tails;   /**< set of tail blocks */
     ReplicaConfig config;                   /**< replica configuration */
+    /* === view change === */
+    /** current view, also read by the commit threads */
+    std::atomic<uint32_t> view;
+    /** the view has been quit and the next one is not entered yet */
+    std::atomic<bool> view_changing;
+    /** blames collected against the leader of the current view */
+    quorum_cert_bt blame_qc;
+    std::unordered_set<ReplicaID> blamers;
+    /** the blame of this replica in the current view, sent again on each
+     * blame timeout until the view is quit */
+    BoxObj<Blame> blamed;
+    /** blames of the next view received before entering it */
+    std::vector<Blame> early_blames;
+    /** proposals of the next leader received before entering its view */
+    std::vector<Proposal> early_proposals;
+    /* === status step: on entering a view, each replica sends its highest
+     * block to the leader, which extends the highest of n - f of them and
+     * proves it in its first block === */
+    /** the statuses collected by the leader of the current view */
+    std::vector<Status> statuses;
+    /** statuses of the next view received before entering it */
+    std::vector<Status> early_statuses;
+    /** the leader has adopted the highest status block (view 0 starts from
+     * the genesis block) */
+    bool synced;
+    /** the serialized StatusCert for the first block of this leader */
+    bytearray_t status_proof;
+    /** the block of the current view whose StatusCert has been checked */
+    uint256_t proven_blk;
+    /** serializes the commits of the commit threads with the main thread
+     * replacing the uncommitted blocks */
+    std::mutex commit_lock;
+    /** when the view of the last check_stalled() was entered, in the time of
+     * its caller */
+    double view_start;
+    uint32_t checked_view;
     /* === async event queues === */
     promise_t propose_waiting;
     promise_t receive_proposal_waiting;
+    promise_t quit_view_waiting;
     /* == feature switches == */
 
     block_t get_delivered_blk(const uint256_t &blk_hash);
     void sanity_check_delivered(const block_t &blk);
-    void update(const block_t &nblk);
     void on_propose_(const Proposal &prop);
     void on_receive_proposal_(const Proposal &prop);
-    // void on_blame_(const Blame &bl );
-    // void on_receive_blame(const Blame &bl);
-    // void on_quit_view_(const QuitView &qv);
-    // void on_receive_quit_view(const QuitView &qv);
+    /** Stop committing in the current view and enter the next one after
+     * 2\delta. */
+    void quit_view();
+    void on_quit_view_();
+    /** @return whether blk and b_comm are on different chains, with
+     * commit_lock held */
+    bool conflicts_committed(const block_t &blk) const;
+    /** Replace the uncommitted blocks of ht_blk_map by the chain of blk, with
+     * commit_lock held. */
+    void adopt_chain(const block_t &blk);
+    /** Check that nblk extends the first block of its leader in the current
+     * view, which carries a valid StatusCert and extends its highest status
+     * block, with commit_lock held. */
+    bool check_status_proof(const block_t &nblk);
     // void on_request_vote_(const ReqVote &rv);
     // void on_receive_request_vote(const ReqVote &rv);
     // void on_vote_(const Vote &vote);
@@ -53,6 +107,13 @@ class E2CCore {
 
     protected:
     ReplicaID id;                  /**< identity of the replica itself */
+    /** Track a delivered block by its height and start its commit timer. */
+    void update(const block_t &nblk);
+    // On finishing 2\delta, use this to commit this block and all its ancestors
+    // (unless the view the timer was started in has been quit since)
+    void commit_timer_cb (uint32_t ht, uint32_t view);
+    /** On finishing 2\delta after quitting `view`, enter the next view. */
+    void view_timer_cb(uint32_t view);
 
     public:
     EventContext ec;
@@ -62,10 +123,12 @@ class E2CCore {
     std::unordered_map<uint32_t, TimerEvent> commit_queue;
     // Map between height and block
     std::unordered_map<uint32_t, block_t> ht_blk_map;
+    /** guards the changes to ht_blk_map, which the commit threads read */
+    std::mutex ht_blk_lock;
     BoxObj<EntityStorage> storage;
 
     E2CCore(ReplicaID id, privkey_bt &&priv_key);
-    virtual ~E2CCore() {}
+    virtual ~E2CCore();
 
     /* Inputs of the state machine triggered by external events, should called
      * by the class user, with proper invariants. */
@@ -96,6 +159,36 @@ class E2CCore {
                     const std::vector<block_t> &parents,
                     bytearray_t &&extra = bytearray_t());
 
+    /** Call when the leader of the current view makes no progress. The
+     * replica blames the leader, and sends its blame again on the next
+     * calls in the same view since the others may have missed it. */
+    void on_blame_timeout();
+
+    /** Call upon the delivery of a blame of the current or the next view.
+     * The partial certificate should be already verified. */
+    void on_receive_blame(const Blame &bl);
+
+    /** Call upon the delivery of an equivocation proof against the leader of
+     * the current view. Both block signatures should be already verified. */
+    void on_receive_equiv_blame(const EquivBlame &eb);
+
+    /** Call upon the delivery of a quit-view certificate. The quorum
+     * certificate should be already verified. */
+    void on_receive_quit_view(const QuitView &qv);
+
+    /** Call every \delta with the current time and the submission time of
+     * the oldest undecided command (now if there is none), in seconds. The
+     * first call in a view takes its time as the view entry.
+     * @return whether the leader should be blamed: the command has waited for
+     * 4\delta (the statuses, the proposal and its commit timer) since its
+     * submission or entering the view, whichever is later */
+    bool check_stalled(double now, double since);
+
+    /** Call upon the delivery of a status of the current or the next view to
+     * its leader. The signature should be already verified and the block
+     * delivered. */
+    void on_receive_status(const Status &st);
+
     /* Functions required to construct concrete instances for abstract classes.
      * */
 
@@ -105,13 +198,43 @@ class E2CCore {
     protected:
     /** Called by E2CCore upon the decision being made for cmd. */
     virtual void do_decide(Finality &&fin) = 0;
+    /** Called by E2CCore once all commands in blk have been decided. */
     virtual void do_consensus(const block_t &blk) = 0;
     /** Called by E2CCore upon broadcasting a new proposal.
      * The user should send the proposal message to all replicas except for
      * itself. */
     virtual void do_broadcast_proposal(const Proposal &prop) = 0;
-    // virtual void do_blame(const Blame &bl) = 0 ;
-    // virtual void do_quit_view(const QuitView &qv) = 0;
+    /** Called by E2CCore to start the commit timer of a newly seen block,
+     * commit_timer_cb should be invoked with its height and the current view
+     * after timeout. The
+     * default implementation runs the timer in a dedicated event loop. */
+    virtual void do_set_commit_timer(const block_t &blk, double timeout);
+    /** Called by E2CCore upon blaming the leader, the user should send the
+     * blame to all replicas except for itself. */
+    virtual void do_broadcast_blame(const Blame &bl) = 0;
+    /** Called by E2CCore upon detecting (or first receiving) an
+     * equivocation, the user should send the proof to all other replicas. */
+    virtual void do_broadcast_equiv_blame(const EquivBlame &eb) = 0;
+    /** Called by E2CCore upon (first) quitting a view with n - f blames, the
+     * user should send the certificate to all other replicas. */
+    virtual void do_broadcast_quit_view(const QuitView &qv) = 0;
+    /** Called by E2CCore after quitting `view`, view_timer_cb should be
+     * invoked with the view after timeout. */
+    virtual void do_set_view_timer(uint32_t view, double timeout) = 0;
+    /** Called by E2CCore upon entering `view`, before the status of this
+     * replica is sent. */
+    virtual void do_enter_view(uint32_t) {}
+    /** Called by E2CCore upon entering a view, the user should send the
+     * status to the leader of the view (or hand it to on_receive_status() if
+     * that is this replica). */
+    virtual void do_send_status(const Status &st) = 0;
+    /** Called by E2CCore once this replica, leading `view`, has adopted the
+     * highest block of n - f statuses and may propose. */
+    virtual void do_view_synced(uint32_t) {}
+    /** Sign obj_hash with the key of this replica. */
+    part_cert_bt sign(const uint256_t &obj_hash) {
+        return create_part_cert(*priv_key, obj_hash);
+    }
     // virtual void do_req_vote(const ReqVote &rv) = 0;
     // virtual void do_vote(const Vote &vote) = 0;
 
@@ -142,14 +265,8 @@ class E2CCore {
     promise_t async_wait_proposal();
     /** Get a promise resolved when a new proposal is received. */
     promise_t async_wait_receive_proposal();
-    /** Get a promise resolved when a new blame is detected. */
-    // promise_t async_wait_blame();
-    /** Get a promise resolved when a new blame is received. */
-    // promise_t async_wait_receive_blame();
-    /** Get a promise resolved when we quit the view */
-    // promise_t async_wait_quit_view();
-    /** Get a promise resolved when we receive a quit view message. */
-    // promise_t async_wait_receive_quit_view();
+    /** Get a promise resolved (with the view number) when we quit a view. */
+    promise_t async_wait_quit_view();
     /** Get a promise resolved when we request a vote */
     // promise_t async_wait_request_vote();
     /** Get a promise resolved when we receive a request for a vote. */
@@ -165,10 +282,35 @@ class E2CCore {
     const block_t &get_genesis() const { return b0; }
     const ReplicaConfig &get_config() const { return config; }
     ReplicaID get_id() const { return id; }
+    uint32_t get_view() const { return view.load(); }
+    bool is_view_changing() const { return view_changing.load(); }
+    /** whether the leader of the current view may propose */
+    bool is_view_synced() const { return synced; }
+    /** the commands of the blocks up to b_mark not committed yet */
+    std::unordered_set<uint256_t> get_uncommitted_cmds();
     const std::set<block_t> get_tails() const { return tails; }
     operator std::string () const;
 };
 
+/** The bytes of a received message, kept intact after it has been parsed.
+ * The range is taken before parsing: moving the stream keeps its buffer. */
+class RawBytes {
+    DataStream s;
+    const uint8_t *base;
+    size_t len;
+
+    public:
+    RawBytes(DataStream &&s, const uint8_t *base, size_t len):
+        s(std::move(s)), base(base), len(len) {}
+    RawBytes(const RawBytes &) = delete;
+
+    const uint8_t *begin() const { return base; }
+    const uint8_t *end() const { return base + len; }
+    size_t size() const { return len; }
+};
+
+using raw_bytes_t = ArcObj<RawBytes>;
+
 /** Abstraction for proposal messages. */
 struct Proposal: public Serializable {
     /** block being proposed */
@@ -176,15 +318,25 @@ struct Proposal: public Serializable {
     /** handle of the core object to allow polymorphism. The user should use
      * a pointer to the object of the class derived from E2CCore */
     E2CCore *hsc;
+    /** the signed encoding this proposal was received as, forwarded as is
+     * (null for a proposal made locally) */
+    raw_bytes_t raw;
+    /** raw is a CompactProposal */
+    bool compact;
 
-    Proposal(): blk(nullptr), hsc(nullptr) {}
+    Proposal(): blk(nullptr), hsc(nullptr), raw(nullptr), compact(false) {}
     Proposal(const block_t &blk,
             E2CCore *hsc):
-        blk(blk), hsc(hsc) {}
+        blk(blk), hsc(hsc), raw(nullptr), compact(false) {}
 
     void serialize(DataStream &s) const override {
-          s << *blk
-            << *(blk->get_signature()) ;
+        if (raw)
+        {
+            s.put_data(raw->begin(), raw->end());
+            return;
+        }
+        s << *blk
+          << *(blk->get_signature()) ;
     }
 
     void unserialize(DataStream &s) override {
@@ -205,85 +357,576 @@ struct Proposal: public Serializable {
     }
 };
 
-// // BLAME type in {Equivocation, Extension, No-PROGRESS}
-// struct EquivBlame: public Serializable {
-//     /** Height at which we have a blame */
-//     block_t blk1, blk2 ;
-//     /** handle of the core object to allow polymorphism. The user should use
-//      * a pointer to the object of the class derived from E2CCore */
-//     E2CCore *hsc;
-
-//     EquivBlame(): blk1(nullptr), blk2(nullptr), hsc(nullptr) {}
-//     EquivBlame(const block_t &blk1,
-//                const block_t &blk2,
-//             E2CCore *hsc):
-//         blk1(blk1), blk2(blk2), hsc(hsc) {}
-
-//     void serialize(DataStream &s) const override {
-//         s << *blk1
-//              << *blk2 ;
-//     }
-
-//     void unserialize(DataStream &s) override {
-//         assert(hsc != nullptr);
-//         s >> proposer;
-//         Block _blk1, _blk2;
-//         _blk1.unserialize(s, hsc);
-//         _blk2.unserialize(s, hsc);
-//         blk1 = hsc->storage->add_blk(std::move(_blk1), hsc->get_config());
-//         blk2 = hsc->storage->add_blk(std::move(_blk2), hsc->get_config());
-//     }
-
-//     operator std::string () const {
-//         DataStream s;
-//         s << "<Equiv Blame "
-//           << "blk1=" << get_hex10(blk->get_hash()) << ">"
-//           << "blk2=" << get_hex10(blk->get_hash()) << ">";
-//         return s;
-//     }
-// };
-
-// struct NoProgress: public Serializable {
-//     /** Blamer */
-//     uint32_t view_num ; // View Number
-//     ReplicaID blamer ;  // The node that is blaming
-//     part_cert_bt cert ; // My vote for this blame
-
-//     /** handle of the core object to allow polymorphism. The user should use
-//      * a pointer to the object of the class derived from E2CCore */
-//     E2CCore *hsc;
-
-//     NoProgress(): view_num(0), blamer(nullptr), hsc(nullptr) , cert(nullptr) {}
-//     NoProgress(uint32_t _vnum ,
-//             ReplicaID bl,
-//             part_cert_bt &&cert,
-//             E2CCore *hsc):
-//         view_num(_vnum),
-//         blamer(bl),
-//         cert(std::move(cert)),
-//         hsc(hsc) {}
-
-//     void serialize(DataStream &s) const override {
-//         s << view_num
-//             << blamer
-//              << *cert ;
-//     }
-
-//     void unserialize(DataStream &s) override {
-//         assert(hsc != nullptr);
-//         s >> view_num >> blamer ;
-//         cert = hsc->parse_part_cert(s) ;
-//     }
-
-//     operator std::string () const {
-//         DataStream s;
-//         s << "<No Progress Blame "
-//           << "View Number" << view_num
-//           << "by" << blamer ;
-//         return s;
-//     }
-// };
+/** The compact encoding of a proposal, for the mempool batches the receivers
+ * already store (in the style of BIP 152): each command is sent as a 6-byte
+ * short id, SipHash of the command hash keyed by the block header and a
+ * salt. The block and its hash are rebuilt from the matching batches. The
+ * proposer and the height are kept at the offsets of a Block. */
+struct CompactProposal: public Serializable {
+    static const size_t short_id_size = 6;
+    ReplicaID proposer;
+    uint32_t height;
+    std::vector<uint256_t> parent_hashes;
+    uint64_t salt;
+    std::vector<uint64_t> short_ids;
+    bytearray_t extra;
+    part_cert_bt cert;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    CompactProposal(): proposer(0), height(0), salt(0), cert(nullptr), hsc(nullptr) {}
+    /** Encode a proposal, salted with its block hash. */
+    CompactProposal(const Proposal &prop);
+
+    CompactProposal(const CompactProposal &other):
+        proposer(other.proposer), height(other.height),
+        parent_hashes(other.parent_hashes), salt(other.salt),
+        short_ids(other.short_ids), extra(other.extra),
+        cert(other.cert ? other.cert->clone() : nullptr),
+        hsc(other.hsc) {}
+
+    CompactProposal(CompactProposal &&other) = default;
+
+    /** the SipHash key of the short ids */
+    std::pair<uint64_t, uint64_t> get_key() const;
+    static uint64_t short_id(const std::pair<uint64_t, uint64_t> &key,
+                            const uint256_t &cmd_hash);
+
+    /** The signed block, with cmds[i] matching short_ids[i]. */
+    Block to_block(std::vector<uint256_t> &&cmds) const;
+
+    void serialize(DataStream &s) const override;
+    void unserialize(DataStream &s) override;
+};
+
+/** Blame of a replica against the leader of a view making no progress. */
+struct Blame: public Serializable {
+    uint32_t view;
+    ReplicaID blamer;
+    /** signature on blame_hash(view) */
+    part_cert_bt cert;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    Blame(): view(0), blamer(0), cert(nullptr), hsc(nullptr) {}
+    Blame(uint32_t view,
+            ReplicaID blamer,
+            part_cert_bt &&cert,
+            E2CCore *hsc):
+        view(view), blamer(blamer),
+        cert(std::move(cert)), hsc(hsc) {}
+
+    Blame(const Blame &other):
+        view(other.view), blamer(other.blamer),
+        cert(other.cert ? other.cert->clone() : nullptr),
+        hsc(other.hsc) {}
+
+    Blame(Blame &&other) = default;
+
+    /** The object signed by all blames of a view, so that they can be
+     * aggregated into one quorum certificate. */
+    static uint256_t blame_hash(uint32_t view) {
+        DataStream s;
+        s << htole((uint32_t)0x424c414d) /* "BLAM" */ << htole(view);
+        return s.get_hash();
+    }
+
+    void serialize(DataStream &s) const override {
+        s << htole(view) << htole((uint32_t)blamer) << *cert;
+    }
+
+    void unserialize(DataStream &s) override {
+        assert(hsc != nullptr);
+        uint32_t n;
+        s >> n;
+        view = letoh(n);
+        s >> n;
+        blamer = letoh(n);
+        cert = hsc->parse_part_cert(s);
+    }
+
+    operator std::string () const {
+        DataStream s;
+        s << "<blame "
+          << "view=" << std::to_string(view) << " "
+          << "blamer=" << std::to_string(blamer) << ">";
+        return s;
+    }
+};
+
+/** Proof of the leader of a view proposing two blocks at the same height. */
+struct EquivBlame: public Serializable {
+    uint32_t view;
+    block_t blk1, blk2;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    EquivBlame(): view(0), blk1(nullptr), blk2(nullptr), hsc(nullptr) {}
+    EquivBlame(uint32_t view,
+            const block_t &blk1,
+            const block_t &blk2,
+            E2CCore *hsc):
+        view(view), blk1(blk1), blk2(blk2), hsc(hsc) {}
+
+    /** Check the proof is well-formed, the signatures are not verified. */
+    bool is_valid() const {
+        for (auto &blk: {blk1, blk2})
+            if (!blk || !blk->get_signature() ||
+                blk->get_signature()->get_obj_hash() != blk->get_hash())
+                return false;
+        return blk1->get_proposer() == blk2->get_proposer() &&
+            blk1->get_height() == blk2->get_height() &&
+            blk1->get_hash() != blk2->get_hash();
+    }
+
+    /** Only the headers are sent, the signatures do not cover the
+     * commands. */
+    void serialize(DataStream &s) const override {
+        s << htole(view);
+        blk1->serialize_header(s);
+        s << *(blk1->get_signature());
+        blk2->serialize_header(s);
+        s << *(blk2->get_signature());
+    }
+
+    void unserialize(DataStream &s) override {
+        assert(hsc != nullptr);
+        uint32_t n;
+        s >> n;
+        view = letoh(n);
+        /* kept out of the storage: the blocks are only evidence */
+        for (auto blk: {&blk1, &blk2})
+        {
+            Block _blk;
+            _blk.unserialize_header(s);
+            _blk.set_signature(hsc->parse_part_cert(s));
+            *blk = block_t(new Block(std::move(_blk)));
+        }
+    }
+
+    operator std::string () const {
+        DataStream s;
+        s << "<equiv_blame "
+          << "view=" << std::to_string(view) << " "
+          << "blk1=" << get_hex10(blk1->get_hash()) << " "
+          << "blk2=" << get_hex10(blk2->get_hash()) << ">";
+        return s;
+    }
+};
+
+/** Certificate for quitting a view: n - f blames aggregated into one quorum
+ * certificate on Blame::blame_hash(view). */
+struct QuitView: public Serializable {
+    uint32_t view;
+    quorum_cert_bt qc;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    QuitView(): view(0), qc(nullptr), hsc(nullptr) {}
+    QuitView(uint32_t view,
+            quorum_cert_bt &&qc,
+            E2CCore *hsc):
+        view(view), qc(std::move(qc)), hsc(hsc) {}
+
+    QuitView(const QuitView &other):
+        view(other.view),
+        qc(other.qc ? other.qc->clone() : nullptr),
+        hsc(other.hsc) {}
+
+    QuitView(QuitView &&other) = default;
+
+    void serialize(DataStream &s) const override {
+        s << htole(view) << *qc;
+    }
+
+    void unserialize(DataStream &s) override {
+        assert(hsc != nullptr);
+        uint32_t n;
+        s >> n;
+        view = letoh(n);
+        qc = hsc->parse_quorum_cert(s);
+    }
+
+    operator std::string () const {
+        DataStream s;
+        s << "<quit_view "
+          << "view=" << std::to_string(view) << ">";
+        return s;
+    }
+};
+
+/** The highest block of a replica on entering a view, sent to the leader of
+ * the view. */
+struct Status: public Serializable {
+    uint32_t view;
+    ReplicaID rid;
+    uint256_t blk_hash;
+    uint32_t height;
+    /** signature on status_hash(view, blk_hash, height) */
+    part_cert_bt cert;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    Status(): view(0), rid(0), height(0), cert(nullptr), hsc(nullptr) {}
+    Status(uint32_t view,
+            ReplicaID rid,
+            const uint256_t &blk_hash,
+            uint32_t height,
+            part_cert_bt &&cert,
+            E2CCore *hsc):
+        view(view), rid(rid), blk_hash(blk_hash), height(height),
+        cert(std::move(cert)), hsc(hsc) {}
+
+    Status(const Status &other):
+        view(other.view), rid(other.rid),
+        blk_hash(other.blk_hash), height(other.height),
+        cert(other.cert ? other.cert->clone() : nullptr),
+        hsc(other.hsc) {}
+
+    Status(Status &&other) = default;
+
+    static uint256_t status_hash(uint32_t view, const uint256_t &blk_hash,
+                                uint32_t height) {
+        DataStream s;
+        s << htole((uint32_t)0x53544154) /* "STAT" */ << htole(view)
+          << blk_hash << htole(height);
+        return s.get_hash();
+    }
+
+    void serialize(DataStream &s) const override {
+        s << htole(view) << htole((uint32_t)rid) << blk_hash
+          << htole(height) << *cert;
+    }
+
+    void unserialize(DataStream &s) override {
+        assert(hsc != nullptr);
+        uint32_t n;
+        s >> n;
+        view = letoh(n);
+        s >> n;
+        rid = letoh(n);
+        s >> blk_hash >> n;
+        height = letoh(n);
+        cert = hsc->parse_part_cert(s);
+    }
+
+    operator std::string () const {
+        DataStream s;
+        s << "<status "
+          << "view=" << std::to_string(view) << " "
+          << "rid=" << std::to_string(rid) << " "
+          << "blk=" << get_hex10(blk_hash) << " "
+          << "height=" << std::to_string(height) << ">";
+        return s;
+    }
+};
+
+/** n - f statuses of a view, carried in the extra field of the first block
+ * of its leader, which extends the highest of them. */
+struct StatusCert: public Serializable {
+    uint32_t view;
+    std::vector<Status> statuses;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    StatusCert(E2CCore *hsc): view(0), hsc(hsc) {}
+    StatusCert(uint32_t view, std::vector<Status> &&statuses, E2CCore *hsc):
+        view(view), statuses(std::move(statuses)), hsc(hsc) {}
+
+    /** the status of the highest block, the first one among equals */
+    const Status &get_highest() const {
+        size_t h = 0;
+        for (size_t i = 1; i < statuses.size(); i++)
+            if (statuses[i].height > statuses[h].height) h = i;
+        return statuses[h];
+    }
+
+    /** Check there are nstatuses distinct statuses of the view, the
+     * signatures are not verified. */
+    bool is_valid(size_t nstatuses, size_t nreplicas) const {
+        if (statuses.size() < nstatuses) return false;
+        std::unordered_set<ReplicaID> rids;
+        for (const auto &st: statuses)
+            if (st.view != view || st.rid >= nreplicas || !st.cert ||
+                st.cert->get_obj_hash() !=
+                    Status::status_hash(view, st.blk_hash, st.height) ||
+                !rids.insert(st.rid).second)
+                return false;
+        return true;
+    }
+
+    void serialize(DataStream &s) const override {
+        s << htole(view) << htole((uint32_t)statuses.size());
+        for (const auto &st: statuses)
+            s << st;
+    }
+
+    void unserialize(DataStream &s) override {
+        assert(hsc != nullptr);
+        uint32_t n;
+        s >> n;
+        view = letoh(n);
+        s >> n;
+        n = letoh(n);
+        statuses.clear();
+        for (uint32_t i = 0; i < n; i++)
+        {
+            Status st;
+            st.hsc = hsc;
+            s >> st;
+            statuses.push_back(std::move(st));
+        }
+    }
+};
+
+/** Acknowledgement of a replica storing a mempool batch. */
+struct BatchAck: public Serializable {
+    ReplicaID rid;
+    uint256_t batch_hash;
+    /** signature on AvailCert::ack_hash(batch_hash) */
+    part_cert_bt cert;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    BatchAck(): rid(0), cert(nullptr), hsc(nullptr) {}
+    BatchAck(ReplicaID rid,
+            const uint256_t &batch_hash,
+            part_cert_bt &&cert,
+            E2CCore *hsc):
+        rid(rid), batch_hash(batch_hash),
+        cert(std::move(cert)), hsc(hsc) {}
+
+    BatchAck(const BatchAck &other):
+        rid(other.rid), batch_hash(other.batch_hash),
+        cert(other.cert ? other.cert->clone() : nullptr),
+        hsc(other.hsc) {}
+
+    BatchAck(BatchAck &&other) = default;
+
+    void serialize(DataStream &s) const override {
+        s << htole((uint32_t)rid) << batch_hash << *cert;
+    }
+
+    void unserialize(DataStream &s) override {
+        assert(hsc != nullptr);
+        uint32_t n;
+        s >> n;
+        rid = letoh(n);
+        s >> batch_hash;
+        cert = hsc->parse_part_cert(s);
+    }
+};
+
+/** Availability certificate of a mempool batch: f + 1 replicas acknowledged
+ * storing it, so at least one correct replica can serve it. */
+struct AvailCert: public Serializable {
+    uint256_t batch_hash;
+    std::vector<std::pair<ReplicaID, part_cert_bt>> acks;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    AvailCert(): hsc(nullptr) {}
+    AvailCert(const uint256_t &batch_hash, E2CCore *hsc):
+        batch_hash(batch_hash), hsc(hsc) {}
+
+    AvailCert(const AvailCert &other):
+            batch_hash(other.batch_hash), hsc(other.hsc) {
+        for (const auto &a: other.acks)
+            acks.push_back(std::make_pair(a.first, part_cert_bt(a.second->clone())));
+    }
+
+    AvailCert(AvailCert &&other) = default;
 
+    /** The object signed by the acknowledgements of a batch, kept apart from
+     * the block hashes so that an ack never doubles as a proposal. */
+    static uint256_t ack_hash(const uint256_t &batch_hash) {
+        DataStream s;
+        s << htole((uint32_t)0x4241434b) /* "BACK" */ << batch_hash;
+        return s.get_hash();
+    }
+
+    bool has_ack(ReplicaID rid) const {
+        for (const auto &a: acks)
+            if (a.first == rid) return true;
+        return false;
+    }
+
+    /** Check there are nacks distinct acknowledgements on this batch, the
+     * signatures are not verified. */
+    bool is_valid(size_t nacks, size_t nreplicas) const {
+        if (acks.size() < nacks) return false;
+        const uint256_t h = ack_hash(batch_hash);
+        std::unordered_set<ReplicaID> rids;
+        for (const auto &a: acks)
+            if (a.first >= nreplicas || !a.second ||
+                a.second->get_obj_hash() != h ||
+                !rids.insert(a.first).second)
+                return false;
+        return true;
+    }
+
+    void serialize(DataStream &s) const override {
+        s << batch_hash << htole((uint32_t)acks.size());
+        for (const auto &a: acks)
+            s << htole((uint32_t)a.first) << *a.second;
+    }
+
+    void unserialize(DataStream &s) override {
+        assert(hsc != nullptr);
+        uint32_t n;
+        s >> batch_hash >> n;
+        n = letoh(n);
+        acks.clear();
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint32_t rid;
+            s >> rid;
+            acks.push_back(std::make_pair((ReplicaID)letoh(rid), hsc->parse_part_cert(s)));
+        }
+    }
+
+    operator std::string () const {
+        DataStream s;
+        s << "<avail_cert "
+          << "batch=" << get_hex10(batch_hash) << " "
+          << "nacks=" << std::to_string(acks.size()) << ">";
+        return s;
+    }
+};
+
+/** A replica's vote that it has committed a block, multicast after the
+ * commit so that each replica gathers a CommitCert. */
+struct CommitVote: public Serializable {
+    ReplicaID rid;
+    uint32_t height;
+    uint256_t blk_hash;
+    /** signature on CommitCert::vote_hash(blk_hash, height) */
+    part_cert_bt cert;
+    /** handle of the core object to allow polymorphism. The user should use
+     * a pointer to the object of the class derived from E2CCore */
+    E2CCore *hsc;
+
+    CommitVote(): rid(0), height(0), cert(nullptr), hsc(nullptr) {}
+    CommitVote(ReplicaID rid,
+            uint32_t height,
+            const uint256_t &blk_hash,
+            part_cert_bt &&cert,
+            E2CCore *hsc):
+        rid(rid), height(height), blk_hash(blk_hash),
+        cert(std::move(cert)), hsc(hsc) {}
+
+    CommitVote(const CommitVote &other):
+        rid(other.rid), height(other.height), blk_hash(other.blk_hash),
+        cert(other.cert ? other.cert->clone() : nullptr),
+        hsc(other.hsc) {}
+
+    CommitVote(CommitVote &&other) = default;
+
+    void serialize(DataStream &s) const override {
+        s << htole((uint32_t)rid) << htole(height) << blk_hash << *cert;
+    }
+
+    void unserialize(DataStream &s) override {
+        assert(hsc != nullptr);
+        uint32_t n;
+        s >> n;
+        rid = letoh(n);
+        s >> n;
+        height = letoh(n);
+        s >> blk_hash;
+        cert = hsc->parse_part_cert(s);
+    }
+};
+
+/** f + 1 commit votes on a block: at least one correct replica has
+ * committed it. With the header of the block and the Merkle path of a
+ * command (see Finality), it proves the command committed to a client on
+ * its own. It is also parsed by the clients, with the part_cert parser of
+ * their CryptoSuite. */
+struct CommitCert {
+    uint256_t blk_hash;
+    uint32_t height;
+    std::vector<std::pair<ReplicaID, part_cert_bt>> votes;
+
+    CommitCert(): height(0) {}
+    CommitCert(const uint256_t &blk_hash, uint32_t height):
+        blk_hash(blk_hash), height(height) {}
+
+    CommitCert(const CommitCert &other):
+            blk_hash(other.blk_hash), height(other.height) {
+        for (const auto &v: other.votes)
+            votes.push_back(std::make_pair(v.first, part_cert_bt(v.second->clone())));
+    }
+
+    CommitCert(CommitCert &&other) = default;
+
+    /** The object signed by the commit votes on a block, kept apart from
+     * the block hash so that a vote never doubles as a proposal. The height
+     * is signed as well, as the votes are kept by height. */
+    static uint256_t vote_hash(const uint256_t &blk_hash, uint32_t height) {
+        DataStream s;
+        s << htole((uint32_t)0x434d4954) /* "CMIT" */ << blk_hash << htole(height);
+        return s.get_hash();
+    }
+
+    bool has_vote(ReplicaID rid) const {
+        for (const auto &v: votes)
+            if (v.first == rid) return true;
+        return false;
+    }
+
+    /** Check there are nvotes distinct votes on this block, the signatures
+     * are not verified. */
+    bool is_valid(size_t nvotes, size_t nreplicas) const {
+        if (votes.size() < nvotes) return false;
+        const uint256_t h = vote_hash(blk_hash, height);
+        std::unordered_set<ReplicaID> rids;
+        for (const auto &v: votes)
+            if (v.first >= nreplicas || !v.second ||
+                v.second->get_obj_hash() != h ||
+                !rids.insert(v.first).second)
+                return false;
+        return true;
+    }
+
+    void serialize(DataStream &s) const {
+        s << blk_hash << htole(height) << htole((uint32_t)votes.size());
+        for (const auto &v: votes)
+            s << htole((uint32_t)v.first) << *v.second;
+    }
+
+    /** @param parser an E2CCore or a CryptoSuite */
+    template<typename PartCertParser>
+    void unserialize(DataStream &s, PartCertParser &parser) {
+        uint32_t n;
+        s >> blk_hash >> height >> n;
+        height = letoh(height);
+        n = letoh(n);
+        votes.clear();
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint32_t rid;
+            s >> rid;
+            votes.push_back(std::make_pair((ReplicaID)letoh(rid), parser.parse_part_cert(s)));
+        }
+    }
+
+    operator std::string () const {
+        DataStream s;
+        s << "<commit_cert "
+          << "blk=" << get_hex10(blk_hash) << " "
+          << "nvotes=" << std::to_string(votes.size()) << ">";
+        return s;
+    }
+};
 
 struct Finality: public Serializable {
     ReplicaID rid;
@@ -292,9 +935,13 @@ struct Finality: public Serializable {
     uint32_t cmd_height;
     uint256_t cmd_hash;
     uint256_t blk_hash;
+    /** the number of commands of the block and the Merkle path of cmd_hash
+     * (empty when the block refers to mempool batches) */
+    uint32_t ncmds;
+    std::vector<uint256_t> cmd_path;
 
     public:
-    Finality() = default;
+    Finality(): ncmds(0) {}
     Finality(ReplicaID rid,
             int8_t decision,
             uint32_t cmd_idx,
@@ -303,20 +950,39 @@ struct Finality: public Serializable {
             uint256_t blk_hash):
         rid(rid), decision(decision),
         cmd_idx(cmd_idx), cmd_height(cmd_height),
-        cmd_hash(cmd_hash), blk_hash(blk_hash) {}
+        cmd_hash(cmd_hash), blk_hash(blk_hash), ncmds(0) {}
+
+    /** Check that the command is the cmd_idx-th one under the Merkle root
+     * of a block header. */
+    bool verify_inclusion(const uint256_t &cmd_root) const {
+        return MerkleTree::verify(cmd_root, cmd_hash, cmd_idx, ncmds, cmd_path);
+    }
 
     void serialize(DataStream &s) const override {
         s << rid << decision
           << cmd_idx << cmd_height
           << cmd_hash;
-        if (decision == 1) s << blk_hash;
+        if (decision == 1)
+        {
+            s << blk_hash << ncmds
+              << (uint8_t)cmd_path.size();
+            for (const auto &h: cmd_path)
+                s << h;
+        }
     }
 
     void unserialize(DataStream &s) override {
         s >> rid >> decision
           >> cmd_idx >> cmd_height
           >> cmd_hash;
-        if (decision == 1) s >> blk_hash;
+        if (decision == 1)
+        {
+            uint8_t n;
+            s >> blk_hash >> ncmds >> n;
+            cmd_path.resize(n);
+            for (auto &h: cmd_path)
+                s >> h;
+        }
     }
 
     operator std::string () const {
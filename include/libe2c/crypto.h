@@ -1,5 +1,6 @@
 #pragma once
 
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 
 #include "secp256k1.h"
@@ -174,7 +175,7 @@ class PubKeySecp256k1: public PubKey {
                                     secp256k1_default_sign_ctx);
 
     void serialize(DataStream &s) const override {
-        static uint8_t output[_olen];
+        uint8_t output[_olen];
         size_t olen = _olen;
         (void)secp256k1_ec_pubkey_serialize(
                 ctx->ctx, (unsigned char *)output,
@@ -196,6 +197,8 @@ class PubKeySecp256k1: public PubKey {
     PubKeySecp256k1 *clone() override {
         return new PubKeySecp256k1(*this);
     }
+
+    const secp256k1_pubkey &get_raw() const { return data; }
 };
 
 class PrivKeySecp256k1: public PrivKey {
@@ -269,7 +272,7 @@ class SigSecp256k1: public Serializable {
     }
 
     void serialize(DataStream &s) const override {
-        static uint8_t output[64];
+        uint8_t output[64];
         (void)secp256k1_ecdsa_signature_serialize_compact(
             ctx->ctx, (unsigned char *)output,
             &data);
@@ -310,22 +313,68 @@ class SigSecp256k1: public Serializable {
     bool verify(const bytearray_t &msg, const PubKeySecp256k1 &pub_key) {
         return verify(msg, pub_key, ctx);
     }
+
+    const secp256k1_ecdsa_signature &get_raw() const { return data; }
+
+    /** Verify a parsed signature on a 32-byte message with the default
+     * verifying context. */
+    static bool verify_raw(const secp256k1_ecdsa_signature &sig,
+                            const uint8_t *msg,
+                            const secp256k1_pubkey &pub_key) {
+        return secp256k1_ecdsa_verify(
+                secp256k1_default_verify_ctx->ctx, &sig,
+                msg, &pub_key) == 1;
+    }
+
+    static bool verify_raw(const secp256k1_ecdsa_signature &sig,
+                            const uint8_t *msg,
+                            const PubKeySecp256k1 &pub_key) {
+        return verify_raw(sig, msg, pub_key.data);
+    }
 };
 
+/** Verify a signature against a key given by the caller, which may not be
+ * one of the replica configuration (see Secp256k1ReplicaVeriTask). The
+ * parsed key and signature are copied by value, without their contexts, so
+ * creating the task touches no reference count. */
 class Secp256k1VeriTask: public VeriTask {
-    uint256_t msg;
-    PubKeySecp256k1 pubkey;
-    SigSecp256k1 sig;
+    uint8_t msg[32];
+    secp256k1_pubkey pubkey;
+    secp256k1_ecdsa_signature sig;
     public:
     Secp256k1VeriTask(const uint256_t &msg,
                         const PubKeySecp256k1 &pubkey,
                         const SigSecp256k1 &sig):
-        msg(msg), pubkey(pubkey), sig(sig) {}
+            pubkey(pubkey.get_raw()), sig(sig.get_raw()) {
+        const bytearray_t raw_msg = msg;
+        memmove(this->msg, &raw_msg[0], sizeof(this->msg));
+    }
     virtual ~Secp256k1VeriTask() = default;
 
     bool verify() override {
-        return sig.verify(msg, pubkey, secp256k1_default_verify_ctx);
+        return SigSecp256k1::verify_raw(sig, msg, pubkey);
+    }
+};
+
+/** Verify the signature of a replica against its key in the replica
+ * configuration. Only the index, the message bytes and the parsed signature
+ * are carried, so creating the task copies no key and touches no reference
+ * count. The configuration must outlive the task. */
+class Secp256k1ReplicaVeriTask: public VeriTask {
+    const ReplicaConfig &config;
+    ReplicaID rid;
+    uint8_t msg[32];
+    secp256k1_ecdsa_signature sig;
+    public:
+    /** @param msg the 32 bytes of the signed hash */
+    Secp256k1ReplicaVeriTask(const ReplicaConfig &config, ReplicaID rid,
+                            const uint8_t *msg, const SigSecp256k1 &sig):
+            config(config), rid(rid), sig(sig.get_raw()) {
+        memmove(this->msg, msg, sizeof(this->msg));
     }
+    virtual ~Secp256k1ReplicaVeriTask() = default;
+
+    bool verify() override;
 };
 
 class PartCertSecp256k1: public SigSecp256k1, public PartCert {
@@ -368,6 +417,7 @@ class PartCertSecp256k1: public SigSecp256k1, public PartCert {
 };
 
 class QuorumCertSecp256k1: public QuorumCert {
+    protected:
     uint256_t obj_hash;
     salticidae::Bits rids;
     std::unordered_map<ReplicaID, SigSecp256k1> sigs;
@@ -408,4 +458,282 @@ class QuorumCertSecp256k1: public QuorumCert {
     }
 };
 
+/** Owning handle of an OpenSSL key, shared by the copies of a key object. */
+class EVPKey {
+    EVP_PKEY *pkey;
+    public:
+    EVPKey(EVP_PKEY *pkey): pkey(pkey) {}
+    EVPKey(const EVPKey &) = delete;
+    ~EVPKey() { EVP_PKEY_free(pkey); }
+    EVP_PKEY *get() const { return pkey; }
+};
+
+using evp_key_t = ArcObj<EVPKey>;
+
+class PrivKeyEd25519;
+
+class PubKeyEd25519: public PubKey {
+    static const auto nbytes = 32;
+    friend class SigEd25519;
+    uint8_t data[nbytes];
+    evp_key_t key;
+
+    void load();
+
+    public:
+    PubKeyEd25519(): PubKey() {}
+
+    PubKeyEd25519(const bytearray_t &raw_bytes): PubKey() {
+        from_bytes(raw_bytes);
+    }
+
+    PubKeyEd25519(const PrivKeyEd25519 &priv_key);
+
+    void serialize(DataStream &s) const override {
+        s.put_data(data, data + nbytes);
+    }
+
+    void unserialize(DataStream &s) override {
+        static const auto _exc = std::invalid_argument("ill-formed public key");
+        try {
+            memmove(data, s.get_data_inplace(nbytes), nbytes);
+        } catch (std::ios_base::failure &) {
+            throw _exc;
+        }
+        load();
+    }
+
+    PubKeyEd25519 *clone() override {
+        return new PubKeyEd25519(*this);
+    }
+};
+
+class PrivKeyEd25519: public PrivKey {
+    static const auto nbytes = 32;
+    friend class PubKeyEd25519;
+    friend class SigEd25519;
+    uint8_t data[nbytes];
+    evp_key_t key;
+
+    void load();
+
+    public:
+    PrivKeyEd25519(): PrivKey() {}
+
+    PrivKeyEd25519(const bytearray_t &raw_bytes): PrivKey() {
+        from_bytes(raw_bytes);
+    }
+
+    void serialize(DataStream &s) const override {
+        s.put_data(data, data + nbytes);
+    }
+
+    void unserialize(DataStream &s) override {
+        static const auto _exc = std::invalid_argument("ill-formed private key");
+        try {
+            memmove(data, s.get_data_inplace(nbytes), nbytes);
+        } catch (std::ios_base::failure &) {
+            throw _exc;
+        }
+        load();
+    }
+
+    void from_rand() override {
+        if (!RAND_bytes(data, nbytes))
+            throw std::runtime_error("cannot get rand bytes from openssl");
+        load();
+    }
+
+    pubkey_bt get_pubkey() const override {
+        return new PubKeyEd25519(*this);
+    }
+};
+
+/** Ed25519 signature (RFC 8032) computed by OpenSSL. */
+class SigEd25519: public Serializable {
+    static const auto nbytes = 64;
+    uint8_t data[nbytes];
+
+    static void check_msg_length(const bytearray_t &msg) {
+        if (msg.size() != 32)
+            throw std::invalid_argument("the message should be 32-bytes");
+    }
+
+    public:
+    SigEd25519(): Serializable() {}
+    SigEd25519(const uint256_t &digest, const PrivKeyEd25519 &priv_key):
+        Serializable() {
+        sign(digest, priv_key);
+    }
+
+    void serialize(DataStream &s) const override {
+        s.put_data(data, data + nbytes);
+    }
+
+    void unserialize(DataStream &s) override {
+        static const auto _exc = std::invalid_argument("ill-formed signature");
+        try {
+            memmove(data, s.get_data_inplace(nbytes), nbytes);
+        } catch (std::ios_base::failure &) {
+            throw _exc;
+        }
+    }
+
+    void sign(const bytearray_t &msg, const PrivKeyEd25519 &priv_key);
+
+    /** Verify with a caller-provided digest context, which is reset before
+     * use, so that the signatures of a certificate can share one. */
+    bool verify(const bytearray_t &msg, const PubKeyEd25519 &pub_key,
+                EVP_MD_CTX *ctx) const;
+
+    bool verify(const bytearray_t &msg, const PubKeyEd25519 &pub_key) const;
+};
+
+class Ed25519VeriTask: public VeriTask {
+    uint256_t msg;
+    PubKeyEd25519 pubkey;
+    SigEd25519 sig;
+    public:
+    Ed25519VeriTask(const uint256_t &msg,
+                    const PubKeyEd25519 &pubkey,
+                    const SigEd25519 &sig):
+        msg(msg), pubkey(pubkey), sig(sig) {}
+    virtual ~Ed25519VeriTask() = default;
+
+    bool verify() override {
+        return sig.verify(msg, pubkey);
+    }
+};
+
+class PartCertEd25519: public SigEd25519, public PartCert {
+    uint256_t obj_hash;
+
+    public:
+    PartCertEd25519() = default;
+    PartCertEd25519(const PrivKeyEd25519 &priv_key, const uint256_t &obj_hash):
+        SigEd25519(obj_hash, priv_key),
+        PartCert(),
+        obj_hash(obj_hash) {}
+
+    bool verify(const PubKey &pub_key) override {
+        return SigEd25519::verify(obj_hash,
+                                static_cast<const PubKeyEd25519 &>(pub_key));
+    }
+
+    promise_t verify(const PubKey &pub_key, VeriPool &vpool) override {
+        return vpool.verify(new Ed25519VeriTask(obj_hash,
+                static_cast<const PubKeyEd25519 &>(pub_key),
+                static_cast<const SigEd25519 &>(*this)));
+    }
+
+    const uint256_t &get_obj_hash() const override { return obj_hash; }
+
+    PartCertEd25519 *clone() override {
+        return new PartCertEd25519(*this);
+    }
+
+    void serialize(DataStream &s) const override {
+        s << obj_hash;
+        this->SigEd25519::serialize(s);
+    }
+
+    void unserialize(DataStream &s) override {
+        s >> obj_hash;
+        this->SigEd25519::unserialize(s);
+    }
+};
+
+/** Quorum certificate of Ed25519 signatures, verified one by one. */
+class QuorumCertEd25519: public QuorumCert {
+    uint256_t obj_hash;
+    salticidae::Bits rids;
+    std::unordered_map<ReplicaID, SigEd25519> sigs;
+
+    public:
+    QuorumCertEd25519() = default;
+    QuorumCertEd25519(const ReplicaConfig &config, const uint256_t &obj_hash);
+
+    void add_part(ReplicaID rid, const PartCert &pc) override {
+        if (pc.get_obj_hash() != obj_hash)
+            throw std::invalid_argument("PartCert does match the block hash");
+        sigs.insert(std::make_pair(
+            rid, static_cast<const PartCertEd25519 &>(pc)));
+        rids.set(rid);
+    }
+
+    void compute() override {}
+
+    bool verify(const ReplicaConfig &config) override;
+    promise_t verify(const ReplicaConfig &config, VeriPool &vpool) override;
+
+    const uint256_t &get_obj_hash() const override { return obj_hash; }
+
+    QuorumCertEd25519 *clone() override {
+        return new QuorumCertEd25519(*this);
+    }
+
+    void serialize(DataStream &s) const override {
+        s << obj_hash << rids;
+        for (size_t i = 0; i < rids.size(); i++)
+            if (rids.get(i)) s << sigs.at(i);
+    }
+
+    void unserialize(DataStream &s) override {
+        s >> obj_hash >> rids;
+        for (size_t i = 0; i < rids.size(); i++)
+            if (rids.get(i)) s >> sigs[i];
+    }
+};
+
+/** The key and certificate types of a signature scheme chosen at runtime. */
+class CryptoSuite {
+    public:
+    virtual ~CryptoSuite() = default;
+    virtual privkey_bt parse_privkey(const bytearray_t &raw_bytes) const = 0;
+    virtual pubkey_bt parse_pubkey(const bytearray_t &raw_bytes) const = 0;
+    virtual part_cert_bt create_part_cert(const PrivKey &priv_key, const uint256_t &obj_hash) const = 0;
+    virtual part_cert_bt parse_part_cert(DataStream &s) const = 0;
+    virtual quorum_cert_bt create_quorum_cert(const ReplicaConfig &config, const uint256_t &obj_hash) const = 0;
+    virtual quorum_cert_bt parse_quorum_cert(DataStream &s) const = 0;
+};
+
+using crypto_suite_bt = BoxObj<CryptoSuite>;
+
+template<typename PrivKeyType, typename PubKeyType,
+        typename PartCertType, typename QuorumCertType>
+class CryptoSuiteImpl: public CryptoSuite {
+    public:
+    privkey_bt parse_privkey(const bytearray_t &raw_bytes) const override {
+        return new PrivKeyType(raw_bytes);
+    }
+
+    pubkey_bt parse_pubkey(const bytearray_t &raw_bytes) const override {
+        return new PubKeyType(raw_bytes);
+    }
+
+    part_cert_bt create_part_cert(const PrivKey &priv_key, const uint256_t &obj_hash) const override {
+        return new PartCertType(static_cast<const PrivKeyType &>(priv_key), obj_hash);
+    }
+
+    part_cert_bt parse_part_cert(DataStream &s) const override {
+        PartCert *pc = new PartCertType();
+        s >> *pc;
+        return pc;
+    }
+
+    quorum_cert_bt create_quorum_cert(const ReplicaConfig &config, const uint256_t &obj_hash) const override {
+        return new QuorumCertType(config, obj_hash);
+    }
+
+    quorum_cert_bt parse_quorum_cert(DataStream &s) const override {
+        QuorumCert *qc = new QuorumCertType();
+        s >> *qc;
+        return qc;
+    }
+};
+
+/** @return the suite of the named scheme (secp256k1, ed25519), or throws
+ * std::invalid_argument */
+crypto_suite_bt create_crypto_suite(const std::string &algo);
+
 }
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
 #include <queue>
 #include <unordered_map>
 #include <unordered_set>
@@ -9,6 +14,8 @@
 #include "salticidae/msg.h"
 #include "libe2c/util.h"
 #include "libe2c/consensus.h"
+#include "libe2c/metrics.h"
+#include "libe2c/trace.h"
 
 namespace e2c {
 
@@ -63,29 +70,27 @@ struct MsgRespBlock {
     void postponed_parse(E2CCore *hsc);
 };
 
-// struct MsgEquivBlame {
-//     static const opcode_t opcode = 0x4;
-//     DataStream serialized;
-//     EquivBlame bl;
-//     MsgEquivBlame(const EquivBlame &);
-//     /** Only move the data to serialized, do not parse immediately. */
-//     MsgEquivBlame(DataStream &&s): serialized(std::move(s)) {}
-//     /** Parse the serialized data to blks now, with `hsc->storage`. */
-//     void postponed_parse(E2CCore *hsc);
-// };
-
-// struct MsgNoProgressBlame {
-//     static const opcode_t opcode = 0x5;
-//     DataStream serialized;
-//     NoProgressBlame bl;
-
+/** Proof of the leader equivocating. */
+struct MsgEquivBlame {
+    static const opcode_t opcode = 0x4;
+    DataStream serialized;
+    EquivBlame bl;
+    MsgEquivBlame(const EquivBlame &);
+    /** Only move the data to serialized, do not parse immediately. */
+    MsgEquivBlame(DataStream &&s): serialized(std::move(s)) {}
+    void postponed_parse(E2CCore *hsc);
+};
 
-//     MsgNoProgressBlame(const NoProgressBlame &);
-//     /** Only move the data to serialized, do not parse immediately. */
-//     MsgNoProgressBlame(DataStream &&s): serialized(std::move(s)) {}
-//     /** Parse the serialized data to blks now, with `hsc->storage`. */
-//     void postponed_parse(E2CCore *hsc);
-// };
+/** Blame against the leader making no progress. */
+struct MsgBlame {
+    static const opcode_t opcode = 0x5;
+    DataStream serialized;
+    Blame bl;
+    MsgBlame(const Blame &);
+    /** Only move the data to serialized, do not parse immediately. */
+    MsgBlame(DataStream &&s): serialized(std::move(s)) {}
+    void postponed_parse(E2CCore *hsc);
+};
 
 // struct MsgExtBlame {
 //     static const opcode_t opcode = 0x6;
@@ -98,16 +103,16 @@ struct MsgRespBlock {
 //     void postponed_parse(E2CCore *hsc);
 // };
 
-// struct MsgQuitView {
-//     static const opcode_t opcode = 0x7;
-//     DataStream serialized;
-//     QuitView qv ;
-//     MsgQuitView(const QuitView &);
-//     /** Only move the data to serialized, do not parse immediately. */
-//     MsgQuitView(DataStream &&s): serialized(std::move(s)) {}
-//     /** Parse the serialized data to blks now, with `hsc->storage`. */
-//     void postponed_parse(E2CCore *hsc);
-// };
+/** n - f blames against the leader, aggregated in a quorum certificate. */
+struct MsgQuitView {
+    static const opcode_t opcode = 0x7;
+    DataStream serialized;
+    QuitView qv;
+    MsgQuitView(const QuitView &);
+    /** Only move the data to serialized, do not parse immediately. */
+    MsgQuitView(DataStream &&s): serialized(std::move(s)) {}
+    void postponed_parse(E2CCore *hsc);
+};
 
 // struct MsgReqVote {
 //     static const opcode_t opcode = 0x8;
@@ -120,8 +125,188 @@ struct MsgRespBlock {
 //     void postponed_parse(E2CCore *hsc);
 // };
 
+/** Client commands forwarded by a replica to the proposer. */
+struct MsgFwdCmd {
+    static const opcode_t opcode = 0x9;
+    DataStream serialized;
+    std::vector<uint256_t> cmd_hashes;
+    MsgFwdCmd(const std::vector<uint256_t> &cmd_hashes);
+    MsgFwdCmd(DataStream &&s);
+};
+
+/** A mempool batch streamed by its origin to the other replicas. */
+struct MsgBatch {
+    static const opcode_t opcode = 0xa;
+    DataStream serialized;
+    CmdBatch batch;
+    MsgBatch(const CmdBatch &);
+    MsgBatch(DataStream &&s);
+};
+
+/** Acknowledgement of a stored batch, sent back to its origin. */
+struct MsgBatchAck {
+    static const opcode_t opcode = 0xb;
+    DataStream serialized;
+    BatchAck ack;
+    MsgBatchAck(const BatchAck &);
+    MsgBatchAck(DataStream &&s): serialized(std::move(s)) {}
+    void postponed_parse(E2CCore *hsc);
+};
+
+/** Availability certificate of a batch, for the leader to propose it. */
+struct MsgAvailCert {
+    static const opcode_t opcode = 0xc;
+    DataStream serialized;
+    AvailCert ac;
+    MsgAvailCert(const AvailCert &);
+    MsgAvailCert(DataStream &&s): serialized(std::move(s)) {}
+    void postponed_parse(E2CCore *hsc);
+};
+
+struct MsgReqBatch {
+    static const opcode_t opcode = 0xd;
+    DataStream serialized;
+    std::vector<uint256_t> batch_hashes;
+    MsgReqBatch(const std::vector<uint256_t> &batch_hashes);
+    MsgReqBatch(DataStream &&s);
+};
+
+struct MsgRespBatch {
+    static const opcode_t opcode = 0xe;
+    DataStream serialized;
+    std::vector<CmdBatch> batches;
+    MsgRespBatch(const std::vector<command_t> &batches);
+    MsgRespBatch(DataStream &&s);
+};
+
+/** A proposal in its compact form (see CompactProposal). */
+struct MsgProposeCompact {
+    static const opcode_t opcode = 0xf;
+    DataStream serialized;
+    CompactProposal cp;
+    MsgProposeCompact(const Proposal &);
+    MsgProposeCompact(DataStream &&s): serialized(std::move(s)) {}
+    void postponed_parse(E2CCore *hsc);
+};
+
+/** The commands of a compact proposal missed by the receiver, by index. */
+struct MsgReqCompactCmds {
+    static const opcode_t opcode = 0x10;
+    DataStream serialized;
+    uint32_t height;
+    /** the digest of the MsgProposeCompact */
+    uint256_t digest;
+    std::vector<uint32_t> idx;
+    MsgReqCompactCmds(uint32_t height, const uint256_t &digest,
+                        const std::vector<uint32_t> &idx);
+    MsgReqCompactCmds(DataStream &&s);
+};
+
+struct MsgRespCompactCmds {
+    static const opcode_t opcode = 0x11;
+    DataStream serialized;
+    uint256_t digest;
+    std::vector<uint256_t> cmds;
+    MsgRespCompactCmds(const uint256_t &digest, const std::vector<uint256_t> &cmds);
+    MsgRespCompactCmds(DataStream &&s);
+};
+
+/** The vote of a replica on a block it has committed. */
+struct MsgCommitVote {
+    static const opcode_t opcode = 0x12;
+    DataStream serialized;
+    CommitVote vote;
+    MsgCommitVote(const CommitVote &);
+    MsgCommitVote(DataStream &&s): serialized(std::move(s)) {}
+    void postponed_parse(E2CCore *hsc);
+};
+
+/** The highest block of a replica, sent to the leader on entering its view. */
+struct MsgStatus {
+    static const opcode_t opcode = 0x13;
+    DataStream serialized;
+    Status st;
+    MsgStatus(const Status &);
+    MsgStatus(DataStream &&s): serialized(std::move(s)) {}
+    void postponed_parse(E2CCore *hsc);
+};
+
+/** Forwarded commands the overloaded proposer has not taken, sent back to
+ * the forwarding replica to answer its clients. */
+struct MsgFwdReject {
+    static const opcode_t opcode = 0x14;
+    DataStream serialized;
+    std::vector<uint256_t> cmd_hashes;
+    MsgFwdReject(const std::vector<uint256_t> &cmd_hashes);
+    MsgFwdReject(DataStream &&s);
+};
+
 using promise::promise_t;
 
+/** Drop the byte-identical copies of a proposal forwarded by every replica,
+ * by the SipHash digest of the message under a random key of this replica.
+ * Shared by the main loop and the vpool workers. */
+class ProposalFilter {
+    std::pair<uint64_t, uint64_t> key;
+    std::mutex lock;
+    /** the digests of the valid proposals */
+    std::unordered_set<uint64_t> seen;
+    /** the digests of seen by block height, to prune them */
+    std::map<uint32_t, std::vector<uint64_t>> seen_heights;
+    /** the digests of the proposals being verified, with the committed
+     * height when they were admitted */
+    std::unordered_map<uint64_t, uint32_t> verifying;
+
+    public:
+    ProposalFilter();
+
+    uint64_t digest(const uint8_t *data, size_t len) const {
+        return siphash24(key.first, key.second, data, len);
+    }
+    /** Start verifying a proposal.
+     * @return false if it is valid or being verified already */
+    bool admit(uint64_t digest, uint32_t commit_height);
+    /** Record the outcome of verifying an admitted proposal, only a valid
+     * one is kept, until its height is pruned. */
+    void checked(uint64_t digest, bool valid, uint32_t height);
+    /** Forget the proposals below a committed height, and the ones admitted
+     * before it and never checked. */
+    void prune(uint32_t height);
+};
+
+/** Parse, hash and verify a received MsgPropose or MsgRespBlock on a VeriPool
+ * worker. The main loop only stores the blocks of a valid result. */
+class IngestTask: public VeriTask {
+    public:
+    struct Result {
+        std::vector<Block> blks;
+        /** the bytes of a proposal, to forward it as is */
+        raw_bytes_t raw;
+        /** the digest of a proposal in the filter */
+        uint64_t digest;
+        /** a copy of a proposal that is valid or being verified */
+        bool dup;
+        Result(): digest(0), dup(false) {}
+    };
+    using result_t = ArcObj<Result>;
+
+    private:
+    E2CCore *hsc;
+    DataStream s;
+    /** null for a block response */
+    ProposalFilter *filter;
+    uint32_t commit_height;
+    result_t res;
+
+    public:
+    IngestTask(E2CCore *hsc, DataStream &&s, ProposalFilter *filter,
+                uint32_t commit_height, const result_t &res):
+        hsc(hsc), s(std::move(s)), filter(filter),
+        commit_height(commit_height), res(res) {}
+
+    bool verify() override;
+};
+
 class E2CBase;
 using pacemaker_bt = BoxObj<class PaceMaker>;
 
@@ -195,26 +380,202 @@ class E2CBase: public E2CCore {
     /* queues for async tasks */
     std::unordered_map<const uint256_t, BlockFetchContext> blk_fetch_waiting;
     std::unordered_map<const uint256_t, BlockDeliveryContext> blk_delivery_waiting;
-    std::unordered_map<const uint256_t, commit_cb_t> decision_waiting;
-    using cmd_queue_t = salticidae::MPSCQueueEventDriven<std::pair<uint256_t, commit_cb_t>>;
+    /** a command whose decision is waited for by a client */
+    struct DecisionWaiting {
+        commit_cb_t callback;
+        std::chrono::steady_clock::time_point since;
+        /** forwarded to the proposer, again to each new one */
+        bool forward;
+    };
+    /** guards decision_waiting and decision_order, which the commit threads
+     * change */
+    mutable std::mutex decision_lock;
+    std::unordered_map<const uint256_t, DecisionWaiting> decision_waiting;
+    /** the commands of decision_waiting in submission order, the decided
+     * ones are dropped from the front lazily */
+    std::deque<std::pair<uint256_t, std::chrono::steady_clock::time_point>> decision_order;
+    struct CmdSubmission {
+        std::vector<uint256_t> cmd_hashes;
+        /** null if nobody waits for the decision on this replica */
+        commit_cb_t callback;
+        /** forward to the proposer if this replica is not the proposer */
+        bool forward;
+    };
+    using cmd_queue_t = salticidae::MPSCQueueEventDriven<CmdSubmission>;
     cmd_queue_t cmd_pending;
     std::queue<uint256_t> cmd_pending_buffer;
+    /** when the oldest command in cmd_pending_buffer was buffered */
+    Tracer::time_point batch_start;
+    /** fires the entering of the next view after quitting one */
+    TimerEvent view_timer;
+    /* admission control (off if cmd_high_watermark is 0): the commands are
+     * turned away once the pending ones reach the high watermark, until they
+     * drain to the low one */
+    size_t cmd_high_watermark;
+    size_t cmd_low_watermark;
+    std::atomic<bool> cmd_overloaded;
+    /* catch-up serving: the block requests are answered one per event loop
+     * turn, after the consensus messages received meanwhile, and within a
+     * budget of catchup_rate bytes per second (0 for no limit) */
+    struct BlockRequest {
+        PeerId replica;
+        std::vector<uint256_t> blk_hashes;
+        std::chrono::steady_clock::time_point arrival;
+    };
+    std::deque<BlockRequest> catchup_queue;
+    /** the requests of each replica in catchup_queue */
+    std::unordered_map<const PeerId, size_t> catchup_pending;
+    TimerEvent catchup_timer;
+    bool catchup_scheduled;
+    double catchup_rate;
+    double catchup_tokens;
+    std::chrono::steady_clock::time_point catchup_refill;
+    /* mempool (off if mempool_batch is 0): the commands are streamed in
+     * batches to all replicas and blocks carry the certified batch hashes */
+    size_t mempool_batch;
+    uint32_t batch_seq;
+    std::vector<uint256_t> mempool_buffer;
+    /** disseminates a partial mempool_buffer after mempool_flush seconds */
+    TimerEvent mempool_timer;
+    double mempool_flush;
+    /** the acks collected on the batches of this replica */
+    std::unordered_map<const uint256_t, AvailCert> batch_acks;
+    /** the certificates of the batches of this replica, sent again to each
+     * new proposer until the batch is committed or expires */
+    std::unordered_map<const uint256_t, AvailCert> batch_certs;
+    /** the commands (or batches) of the uncommitted blocks extended by this
+     * replica as the leader, not to be proposed again */
+    std::unordered_set<uint256_t> adopted_cmds;
+    std::unordered_map<const uint256_t, CmdFetchContext> cmd_fetch_waiting;
+    /** the commands of the stored batches, accessed from the commit threads */
+    std::mutex batch_lock;
+    std::unordered_map<const uint256_t, std::vector<uint256_t>> batch_cmds;
+    /** the stored batches with the commit_height when they were stored, to
+     * expire the ones never committed */
+    std::queue<std::pair<uint256_t, uint32_t>> batch_order;
+    /** the compact proposals sent by this replica, by height, to serve the
+     * commands missed by the receivers */
+    std::map<uint32_t, std::vector<std::pair<uint256_t, block_t>>> compact_sent;
+    /** a compact proposal being rebuilt */
+    struct CompactRebuild {
+        CompactProposal cp;
+        std::vector<uint256_t> cmds;
+        /** the indices of the commands not found locally */
+        std::vector<uint32_t> missing;
+        raw_bytes_t raw;
+        PeerId peer;
+        /** all commands have been requested */
+        bool full;
+        /** the digest of the message in prop_filter */
+        uint64_t seen_digest;
+    };
+    std::unordered_map<const uint256_t, CompactRebuild> compact_waiting;
+    /* commit certificates (off unless enabled): each replica multicasts a
+     * vote on the blocks it commits and hands the ones with f + 1 votes to
+     * state_machine_certify() */
+    bool commit_cert;
+    struct CommitTally {
+        CommitCert cert;
+        /** set once the block is committed by this replica */
+        block_t blk;
+        bool done;
+    };
+    /** by block height, within prop_seen_window of commit_height */
+    std::map<uint32_t, std::unordered_map<const uint256_t, CommitTally>> commit_votes;
+    /** the highest block height committed by this replica, set by the
+     * commit threads. The state kept by the height of unverified messages
+     * is pruned around it, never by the heights received. */
+    std::atomic<uint32_t> commit_height;
+    /** @return whether height is within prop_seen_window of commit_height */
+    bool near_commit_height(uint32_t height) const;
 
     /* statistics */
-    uint64_t fetched;
-    uint64_t delivered;
-    mutable uint64_t nsent;
-    mutable uint64_t nrecv;
-
-    mutable uint32_t part_parent_size;
-    mutable uint32_t part_fetched;
-    mutable uint32_t part_delivered;
-    mutable uint32_t part_decided;
-    mutable uint32_t part_gened;
-    mutable double part_delivery_time;
-    mutable double part_delivery_time_min;
-    mutable double part_delivery_time_max;
-    mutable std::unordered_map<const PeerId, uint32_t> part_fetched_replica;
+    MetricsRegistry metrics;
+    struct Stats {
+        Counter &fetched;
+        Counter &delivered;
+        Counter &decided;
+        Counter &proposed;
+        Counter &parent_size;
+        Counter &nsent;
+        Counter &nrecv;
+        /* in microseconds */
+        Histogram &delivery_time;
+        Histogram &commit_latency;
+        Histogram &verify_time;
+        /* in bytes */
+        Histogram &propose_size;
+        Histogram &resp_blk_size;
+        Counter &blames;
+        Counter &view_changes;
+        Counter &dup_proposals;
+        Counter &mempool_batches;
+        Counter &mempool_certs;
+        Counter &compact_missed;
+        Counter &commit_certs;
+        Counter &cmds_rejected;
+        /* the depths of the command queues */
+        Gauge &cmds_queued;
+        Gauge &cmds_buffered;
+        Gauge &cmds_waiting;
+        Counter &catchup_sent;
+        Counter &catchup_dropped;
+        /** time a block request waits to be served, in microseconds */
+        Histogram &catchup_wait;
+        /** block fetch requests sent to each replica */
+        std::unordered_map<const PeerId, Counter *> fetch_req;
+        Stats(MetricsRegistry &metrics);
+    } stats;
+    /** the snapshot taken by the last print_stat() */
+    mutable MetricsSnapshot last_stat;
+    /** when each uncommitted block was proposed or first seen, accessed from
+     * the commit threads */
+    std::mutex blk_seen_lock;
+    std::unordered_map<const uint256_t, std::chrono::steady_clock::time_point> blk_seen;
+    /** the blocks of blk_seen by height, to forget the ones never committed */
+    std::map<uint32_t, std::vector<uint256_t>> blk_seen_heights;
+    ProposalFilter prop_filter;
+    /** received proposals and block responses being ingested by the vpool
+     * workers, handed to the core in their arrival order */
+    struct Ingest {
+        IngestTask::result_t res;
+        PeerId peer;
+        bool is_proposal;
+        bool done;
+        bool valid;
+    };
+    std::deque<Ingest> ingest_queue;
+    /** the sequence number of the front of ingest_queue */
+    uint64_t ingest_base;
+
+    void ingest(DataStream &&s, const PeerId &peer, bool is_proposal);
+    void on_ingested(Ingest &&in);
+    /** Check the proposer at its fixed offset in the Block.
+     * @return false if the proposal is dropped */
+    bool check_proposer(DataStream &s);
+    /** Record the outcome of verifying a proposal admitted by prop_filter,
+     * only a valid one near commit_height is kept. */
+    void on_proposal_checked(uint64_t digest, bool valid, uint32_t height = 0);
+    /** deliver a proposal whose signature has been checked */
+    void on_proposal_verified(block_t blk, raw_bytes_t &&raw, bool compact,
+                            const PeerId &peer);
+    void on_compact_rebuilt(const uint256_t &digest, CompactRebuild &&rb);
+
+    /** stream the buffered commands as a batch and ack it */
+    void disseminate_batch();
+    void on_store_batch(const command_t &cmd);
+    void on_batch_ack(const BatchAck &ack);
+    void on_avail_cert(const AvailCert &ac);
+
+    /** @return null if the height is too far from commit_height */
+    CommitTally *get_commit_tally(uint32_t height, const uint256_t &blk_hash);
+    /** vote on a block committed by this replica */
+    void on_local_commit(const block_t &blk);
+    void on_commit_vote(const CommitVote &vote);
+
+    void schedule_catchup(double delay);
+    /** answer the oldest block request if the budget allows */
+    void serve_catchup();
 
     void on_fetch_cmd(const command_t &cmd);
     void on_fetch_blk(const block_t &blk);
@@ -227,24 +588,73 @@ class E2CBase: public E2CCore {
 
     /** deliver consensus message: <propose> */
     inline void propose_handler(MsgPropose &&, const Net::conn_t &);
+    /** rebuilds a compact proposal from the stored batches */
+    inline void propose_compact_handler(MsgProposeCompact &&, const Net::conn_t &);
+    /** serves the commands of a compact proposal */
+    inline void req_compact_handler(MsgReqCompactCmds &&, const Net::conn_t &);
+    /** receives the commands missed in a compact proposal */
+    inline void resp_compact_handler(MsgRespCompactCmds &&, const Net::conn_t &);
     /** fetches full block data */
     inline void req_blk_handler(MsgReqBlock &&, const Net::conn_t &);
     /** receives a block */
     inline void resp_blk_handler(MsgRespBlock &&, const Net::conn_t &);
+    /** receives client commands forwarded by another replica */
+    inline void fwd_cmd_handler(MsgFwdCmd &&, const Net::conn_t &);
+    inline void fwd_reject_handler(MsgFwdReject &&, const Net::conn_t &);
+    /** receives a blame against the leader */
+    inline void blame_handler(MsgBlame &&, const Net::conn_t &);
+    /** receives an equivocation proof against the leader */
+    inline void equiv_blame_handler(MsgEquivBlame &&, const Net::conn_t &);
+    /** receives a quit-view certificate */
+    inline void quit_view_handler(MsgQuitView &&, const Net::conn_t &);
+    /** stores a mempool batch and acks it */
+    inline void batch_handler(MsgBatch &&, const Net::conn_t &);
+    /** receives an ack on a batch of this replica */
+    inline void batch_ack_handler(MsgBatchAck &&, const Net::conn_t &);
+    /** receives the availability certificate of a batch (proposer only) */
+    inline void avail_cert_handler(MsgAvailCert &&, const Net::conn_t &);
+    /** fetches mempool batches */
+    inline void req_batch_handler(MsgReqBatch &&, const Net::conn_t &);
+    /** receives mempool batches */
+    inline void resp_batch_handler(MsgRespBatch &&, const Net::conn_t &);
+    /** receives the vote of a replica on a committed block */
+    inline void commit_vote_handler(MsgCommitVote &&, const Net::conn_t &);
+    /** receives the status of a replica (leader only) */
+    inline void status_handler(MsgStatus &&, const Net::conn_t &);
 
     inline bool conn_handler(const salticidae::ConnPool::conn_t &, bool);
 
+    /** propose the first blk_size buffered commands */
+    void propose_pending();
+
     // Sendall <PROPOSE>
     void do_broadcast_proposal(const Proposal &) override;
     // We call the action of committing, DECIDING
     void do_decide(Finality &&) override;
+    void decide_cmd(Finality &&);
+    /** Decide on the commands of a committed batch. */
+    void decide_batch(const Finality &fin, const std::vector<uint256_t> &cmds);
     void do_consensus(const block_t &blk) override;
+    void do_set_commit_timer(const block_t &blk, double timeout) override;
+    void do_broadcast_blame(const Blame &) override;
+    void do_broadcast_equiv_blame(const EquivBlame &) override;
+    void do_broadcast_quit_view(const QuitView &) override;
+    void do_set_view_timer(uint32_t view, double timeout) override;
+    void do_enter_view(uint32_t view) override;
+    void do_send_status(const Status &) override;
+    void do_view_synced(uint32_t view) override;
 
     protected:
 
     /** Called to replicate the execution of a command, the application should
      * implement this to make transition for the application state. */
     virtual void state_machine_execute(const Finality &) = 0;
+    /** Called after all commands in a committed block have been executed,
+     * the application can use this to flush per-block work (e.g. replies). */
+    virtual void state_machine_commit(const block_t &) {}
+    /** Called (with commit certificates enabled) once a block committed by
+     * this replica has f + 1 commit votes. */
+    virtual void state_machine_certify(const block_t &, const CommitCert &) {}
 
     public:
     E2CBase(uint32_t blk_size,
@@ -262,14 +672,57 @@ class E2CBase: public E2CCore {
 
     /* Submit the command to be decided. */
     void exec_command(uint256_t cmd_hash, commit_cb_t callback);
+    /* Submit a batch of commands to be decided, each decision invokes the
+     * callback. The batch is handed to the proposer loop as a whole. If
+     * forward is set and this replica is not the proposer, the batch is
+     * forwarded to the proposer. */
+    void exec_command(std::vector<uint256_t> &&cmd_hashes, commit_cb_t callback,
+                        bool forward = false);
     void start(std::vector<std::tuple<NetAddr, pubkey_bt, uint256_t>> &&replicas,
                 bool ec_loop = false);
+    /** Disseminate the commands through the mempool in batches of
+     * batch_size, the blocks then carry the certified batches instead of the
+     * commands and are proposed in their compact form. A partial batch is
+     * disseminated after flush_delay seconds. Must be called
+     * before start() and set alike on all replicas. */
+    void enable_mempool(size_t batch_size, double flush_delay) {
+        mempool_batch = batch_size;
+        mempool_flush = flush_delay;
+    }
+    /** Gather a CommitCert on each committed block (see
+     * state_machine_certify()). Must be called before start() and set alike
+     * on all replicas. The Merkle paths of the commands are only there
+     * without the mempool. */
+    void enable_commit_cert() { commit_cert = true; }
+    bool is_commit_cert() const { return commit_cert; }
+    /** Turn away the commands submitted once high pending ones (queued,
+     * buffered for a proposal or waiting for their decision) are reached,
+     * until they drain to low. Must be called before start(). */
+    void set_cmd_watermarks(size_t high, size_t low) {
+        cmd_high_watermark = high;
+        cmd_low_watermark = low;
+    }
+    /** Limit the bytes per second of the blocks served to the replicas
+     * catching up (0 for no limit). Must be called before start(). */
+    void set_catchup_rate(double rate);
+    /** the commands in the queues above, counted once per queue */
+    size_t get_cmd_pending() const;
+    /** Called (from any thread) before submitting n commands.
+     * @return false if the replica is overloaded and the commands should be
+     * rejected */
+    bool admit_cmds(size_t n);
 
     size_t size() const { return peers.size(); }
-    const auto &get_decision_waiting() const { return decision_waiting; }
+    /** @return the seconds the oldest undecided command of the clients has
+     * been waiting for, 0 if there is none */
+    double get_decision_wait();
+    /** Impeach the leader if it leaves the commands undecided (see
+     * E2CCore::check_stalled()), to be called every \delta. */
+    void check_progress();
     ThreadCall &get_tcall() { return tcall; }
     PaceMaker *get_pace_maker() { return pmaker.get(); }
     void print_stat() const;
+    MetricsRegistry &get_metrics() { return metrics; }
     virtual void do_elected() {}
 
     /* Helper functions */
@@ -343,9 +796,65 @@ class E2C: public E2CBase {
     }
 };
 
+/** E2C protocol with the signature scheme chosen at runtime. */
+class E2CDyn: public E2CBase {
+    crypto_suite_bt suite;
+
+    protected:
+    part_cert_bt create_part_cert(const PrivKey &priv_key, const uint256_t &blk_hash) override {
+        return suite->create_part_cert(priv_key, blk_hash);
+    }
+
+    part_cert_bt parse_part_cert(DataStream &s) override {
+        return suite->parse_part_cert(s);
+    }
+
+    quorum_cert_bt create_quorum_cert(const uint256_t &blk_hash) override {
+        return suite->create_quorum_cert(get_config(), blk_hash);
+    }
+
+    quorum_cert_bt parse_quorum_cert(DataStream &s) override {
+        return suite->parse_quorum_cert(s);
+    }
+
+    public:
+    E2CDyn(crypto_suite_bt &&_suite,
+            uint32_t blk_size,
+            ReplicaID rid,
+            const bytearray_t &raw_privkey,
+            NetAddr listen_addr,
+            pacemaker_bt pmaker,
+            EventContext ec = EventContext(),
+            size_t nworker = 4,
+            const Net::Config &netconfig = Net::Config()):
+        E2CBase(blk_size,
+                    rid,
+                    _suite->parse_privkey(raw_privkey),
+                    listen_addr,
+                    std::move(pmaker),
+                    ec,
+                    nworker,
+                    netconfig),
+        suite(std::move(_suite)) {}
+
+    void start(const std::vector<std::tuple<NetAddr, bytearray_t, bytearray_t>> &replicas, bool ec_loop = false) {
+        std::vector<std::tuple<NetAddr, pubkey_bt, uint256_t>> reps;
+        for (auto &r: replicas)
+            reps.push_back(
+                std::make_tuple(
+                    std::get<0>(r),
+                    suite->parse_pubkey(std::get<1>(r)),
+                    uint256_t(std::get<2>(r))
+                ));
+        E2CBase::start(std::move(reps), ec_loop);
+    }
+};
+
 using E2CNoSig = E2C<>;
 using E2CSecp256k1 = E2C<PrivKeySecp256k1, PubKeySecp256k1,
                                     PartCertSecp256k1, QuorumCertSecp256k1>;
+using E2CEd25519 = E2C<PrivKeyEd25519, PubKeyEd25519,
+                                    PartCertEd25519, QuorumCertEd25519>;
 
 template<EntityType ent_type>
 FetchContext<ent_type>::FetchContext(FetchContext && other):
@@ -360,6 +869,11 @@ FetchContext<ent_type>::FetchContext(FetchContext && other):
     reset_timeout();
 }
 
+template<>
+inline void FetchContext<ENT_TYPE_CMD>::send(const PeerId &replica) {
+    hs->pn.send_msg(MsgReqBatch(std::vector<uint256_t>{ent_hash}), replica);
+}
+
 template<>
 inline void FetchContext<ENT_TYPE_CMD>::timeout_cb(TimerEvent &) {
     for (const auto &replica: replicas)
@@ -388,7 +902,8 @@ FetchContext<ent_type>::FetchContext(
 
 template<EntityType ent_type>
 void FetchContext<ent_type>::send(const PeerId &replica) {
-    hs->part_fetched_replica[replica]++;
+    auto it = hs->stats.fetch_req.find(replica);
+    if (it != hs->stats.fetch_req.end()) it->second->add();
     hs->pn.send_msg(fetch_msg, replica);
 }
 
@@ -12,6 +12,7 @@
 #include "libe2c/type.h"
 #include "libe2c/util.h"
 #include "libe2c/crypto.h"
+#include "libe2c/merkle.h"
 
 /*
  * NOTE: Defines all the entities/messages used in the protocol
@@ -45,6 +46,15 @@ struct ReplicaInfo {
 
 class ReplicaConfig {
     std::unordered_map<ReplicaID, ReplicaInfo> replica_map;
+    /** the public keys of replica_map indexed by ReplicaID, so that the
+     * verifiers look them up without hashing nor copying */
+    std::vector<const PubKey *> pubkeys;
+
+    void index_pubkey(ReplicaID rid, const ReplicaInfo &info) {
+        if (rid >= pubkeys.size())
+            pubkeys.resize(rid + 1, nullptr);
+        pubkeys[rid] = info.pubkey.get();
+    }
 
     public:
     size_t nreplicas;
@@ -52,8 +62,22 @@ class ReplicaConfig {
 
     ReplicaConfig(): nreplicas(0), nmajority(0) {}
 
+    ReplicaConfig(const ReplicaConfig &other):
+            replica_map(other.replica_map),
+            nreplicas(other.nreplicas),
+            nmajority(other.nmajority) {
+        /* the copied ReplicaInfo own clones of the keys */
+        for (const auto &p: replica_map)
+            index_pubkey(p.first, p.second);
+    }
+
+    ReplicaConfig(ReplicaConfig &&) = default;
+    ReplicaConfig &operator=(const ReplicaConfig &) = delete;
+    ReplicaConfig &operator=(ReplicaConfig &&) = default;
+
     void add_replica(ReplicaID rid, const ReplicaInfo &info) {
-        replica_map.insert(std::make_pair(rid, info));
+        auto it = replica_map.insert(std::make_pair(rid, info)).first;
+        index_pubkey(rid, it->second);
         nreplicas++;
     }
 
@@ -66,7 +90,15 @@ class ReplicaConfig {
     }
 
     const PubKey &get_pubkey(ReplicaID rid) const {
-        return *(get_info(rid).pubkey);
+        if (rid < pubkeys.size() && pubkeys[rid])
+            return *pubkeys[rid];
+        throw E2CError("rid %s not found", get_hex(rid).c_str());
+    }
+
+    /** @return null if the replica is unknown, never throws (for the
+     * VeriPool workers) */
+    const PubKey *find_pubkey(ReplicaID rid) const {
+        return rid < pubkeys.size() ? pubkeys[rid] : nullptr;
     }
 
     const salticidae::PeerId &get_peer_id(ReplicaID rid) const {
@@ -94,6 +126,49 @@ class Command: public Serializable {
 
 using command_t = ArcObj<Command>;
 
+/** A batch of command hashes disseminated by the mempool of a replica. The
+ * blocks refer to the batches once they are available (see AvailCert). */
+class CmdBatch: public Command {
+    ReplicaID origin;
+    uint32_t seq;
+    std::vector<uint256_t> cmds;
+    uint256_t hash;
+
+    public:
+    CmdBatch(): origin(0), seq(0) {}
+    CmdBatch(ReplicaID origin, uint32_t seq, std::vector<uint256_t> &&cmds):
+        origin(origin), seq(seq), cmds(std::move(cmds)) {
+        hash = salticidae::get_hash(*this);
+    }
+
+    void serialize(DataStream &s) const override {
+        s << htole((uint32_t)origin) << htole(seq)
+          << htole((uint32_t)cmds.size());
+        for (const auto &cmd: cmds)
+            s << cmd;
+    }
+
+    void unserialize(DataStream &s) override {
+        uint32_t n;
+        s >> n;
+        origin = letoh(n);
+        s >> n;
+        seq = letoh(n);
+        s >> n;
+        n = letoh(n);
+        cmds.resize(n);
+        for (auto &cmd: cmds)
+            s >> cmd;
+        hash = salticidae::get_hash(*this);
+    }
+
+    const uint256_t &get_hash() const override { return hash; }
+    bool verify() const override { return true; }
+
+    ReplicaID get_origin() const { return origin; }
+    const std::vector<uint256_t> &get_cmds() const { return cmds; }
+};
+
 template<typename Hashable>
 inline static std::vector<uint256_t>
 get_hashes(const std::vector<Hashable> &plist) {
@@ -110,27 +185,39 @@ class Block {
     bytearray_t extra;
     ReplicaID proposer ;
     uint32_t height;
+    /** the number of commands and their Merkle root, which the header
+     * carries in place of cmds */
+    uint32_t ncmds;
+    uint256_t cmd_root;
     part_cert_bt signature ;
     // The signature is filled in MsgPropose
 
     /* the following fields can be derived from above */
     std::vector<block_t> parents;
+    /** the hash of the header */
     uint256_t hash;
     bool delivered;
+    /** the signature was checked when the block was ingested */
+    bool verified;
     int8_t decision;
     EventContext commit_ec;
     TimerEvent commit_timer;
     std::thread commit_thread;
 
+    /** parse the header fields, the hash is left to the caller */
+    void parse_header(DataStream &s);
+    /** parse the commands and check them against cmd_root */
+    void parse_body(DataStream &s);
+
     public:
     Block():
-        height(0),
-        delivered(false), decision(0) {}
+        height(0), ncmds(0),
+        delivered(false), verified(false), decision(0) {}
 
     Block(bool delivered, int8_t decision):
-        height(0),
-        hash(salticidae::get_hash(*this)),
-        delivered(delivered), decision(decision) {}
+        height(0), ncmds(0),
+        hash(header_hash()),
+        delivered(delivered), verified(false), decision(decision) {}
 
     Block(const std::vector<block_t> &parents,
         const std::vector<uint256_t> &cmds,
@@ -143,9 +230,29 @@ class Block {
             extra(std::move(extra)),
             proposer(proposer),
             height(height),
+            ncmds(this->cmds.size()),
+            cmd_root(MerkleTree::root(this->cmds)),
             parents(parents),
             delivered(0),
-            decision(decision) { hash = salticidae::get_hash(*this); }
+            verified(false),
+            decision(decision) { hash = header_hash(); }
+
+    /** Rebuild a received block whose parents are not resolved yet. */
+    Block(std::vector<uint256_t> &&parent_hashes,
+        std::vector<uint256_t> &&cmds,
+        bytearray_t &&extra,
+        uint32_t height,
+        ReplicaID proposer):
+            parent_hashes(std::move(parent_hashes)),
+            cmds(std::move(cmds)),
+            extra(std::move(extra)),
+            proposer(proposer),
+            height(height),
+            ncmds(this->cmds.size()),
+            cmd_root(MerkleTree::root(this->cmds)),
+            delivered(0),
+            verified(false),
+            decision(0) { hash = header_hash(); }
 
     void set_signature (part_cert_bt cert) { signature = std::move(cert); }
     part_cert_bt& get_signature () {return signature; }
@@ -153,10 +260,31 @@ class Block {
     /* Fetch the block's proposer */
     ReplicaID get_proposer() { return proposer; }
 
+    /** The header is followed by the commands. */
     void serialize(DataStream &s) const;
 
+    /** @throw E2CError if the commands do not match cmd_root */
     void unserialize(DataStream &s, E2CCore *hsc);
 
+    /** Parse blks.size() consecutive blocks, hashing them in one batch. */
+    static void unserialize_batch(DataStream &s, std::vector<Block> &blks);
+
+    /** The fields covered by the hash (and the signature): all but the
+     * commands themselves. */
+    void serialize_header(DataStream &s) const;
+
+    /** Parse a header alone, the block is left without its commands. */
+    void unserialize_header(DataStream &s);
+
+    uint256_t header_hash() const;
+
+    /** whether the commands are there, not only the header */
+    bool has_body() const { return cmds.size() == ncmds; }
+
+    uint32_t get_ncmds() const { return ncmds; }
+
+    const uint256_t &get_cmd_root() const { return cmd_root; }
+
     const std::vector<uint256_t> &get_cmds() const {
         return cmds;
     }
@@ -179,6 +307,10 @@ class Block {
 
     bool is_delivered() const { return delivered; }
 
+    void set_verified() { verified = true; }
+
+    bool is_verified() const { return verified; }
+
     uint32_t get_height() const { return height; }
 
     const bytearray_t &get_extra() const { return extra; }
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace e2c {
+
+/** HDR-style histogram of non-negative integer samples (e.g. latencies in
+ * microseconds). Samples are grouped by their power of two and every power of
+ * two is split into 2^sub_bits linear sub-buckets, so any reported value is
+ * within 2^-sub_bits of the recorded one while the memory stays constant. */
+class LatencyHistogram {
+    static const unsigned sub_bits = 7;
+    static const uint64_t nsub = 1ull << sub_bits;
+    static const size_t nbuckets = (64 - sub_bits + 1) * nsub;
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t min_v;
+    uint64_t max_v;
+    double sum;
+
+    static size_t index_of(uint64_t v) {
+        if (v < nsub) return v;
+        unsigned shift = 63 - __builtin_clzll(v) - sub_bits;
+        return ((size_t)(shift + 1) << sub_bits) + ((v >> shift) - nsub);
+    }
+
+    /** the largest value falling into the bucket */
+    static uint64_t value_of(size_t idx) {
+        if (idx < nsub) return idx;
+        unsigned shift = (idx >> sub_bits) - 1;
+        uint64_t sub = idx & (nsub - 1);
+        return ((nsub + sub + 1) << shift) - 1;
+    }
+
+    public:
+    LatencyHistogram(): counts(nbuckets, 0) { reset(); }
+
+    void record(uint64_t v) {
+        counts[index_of(v)]++;
+        total++;
+        sum += v;
+        min_v = std::min(min_v, v);
+        max_v = std::max(max_v, v);
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (size_t i = 0; i < nbuckets; i++)
+            counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        min_v = std::min(min_v, other.min_v);
+        max_v = std::max(max_v, other.max_v);
+    }
+
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        sum = 0;
+        min_v = UINT64_MAX;
+        max_v = 0;
+    }
+
+    /** @return the value below which q percent of the samples fall */
+    uint64_t percentile(double q) const {
+        if (!total) return 0;
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(q / 100 * total));
+        uint64_t acc = 0;
+        for (size_t i = 0; i < nbuckets; i++)
+            if ((acc += counts[i]) >= rank)
+                return std::min(value_of(i), max_v);
+        return max_v;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? min_v : 0; }
+    uint64_t max() const { return max_v; }
+    double mean() const { return total ? sum / total : 0; }
+};
+
+}
@@ -39,38 +39,42 @@ class PaceMaker {
 using pacemaker_bt = BoxObj<PaceMaker>;
 
     /*
-     * PaceMaker Implementation for E2C. We require the implementation that does the following:
-     * 1. If p blocks are not proposed in (2p+1)\Delta then change to the next leader
+     * PaceMaker Implementation for E2C. The leader rotates with the view:
+     * when the current leader makes no progress, impeach() blames it, and
+     * once n - f replicas have blamed it (or it has been caught equivocating)
+     * E2CCore moves every replica to the next view together.
      * */
 
 class E2CSyncPaceMaker : public virtual PaceMaker {
-    ReplicaID proposer ; // The current proposer for the current view
-    EventContext ec ;
+    ReplicaID start ; // The proposer of view 0
     /* Constructor that takes the starting proposer for the pacemaker */
     public:
     E2CSyncPaceMaker(ReplicaID start):
-        proposer(start) {}
+        start(start) {}
 
+    /* While the view is being quit, the proposer is the one of the next view,
+     * whose early proposals are held by E2CCore. */
     ReplicaID get_proposer() override {
-        return proposer ;
+        uint32_t view = hsc->get_view() + hsc->is_view_changing() ;
+        return (start + view) % hsc->get_config().nreplicas ;
     }
 
-//     // void reg_blame() {
-//     //     hsc->async_wait_blame().then([this](const Blame &bl) {
-//     //         // TODO what to do after receiving a BLAME
-//     //         // TODO implement Blame class
-//     //         // TODO implement async_wait_blame in E2CCore
-//     //         reg_blame() ;
-//     //     });
-//     // }
+    void reg_quit_view() {
+        hsc->async_wait_quit_view().then([this](uint32_t view) {
+            E2C_LOG_INFO("Impeached the proposer %u of view %u",
+                        (start + view) % hsc->get_config().nreplicas, view);
+            reg_quit_view() ;
+        });
+    }
 
     void init ( E2CCore *_hsc) override {
         hsc = _hsc ;
+        reg_quit_view() ;
     }
 
     // Send correct BLAMEs
     void impeach() override {
-        proposer = (proposer + 1) % hsc->get_config().nreplicas;
+        hsc->on_blame_timeout() ;
     }
 
     promise_t beat() override {
@@ -82,12 +86,10 @@ class E2CSyncPaceMaker : public virtual PaceMaker {
     }
 
     void on_consensus ( const block_t& blk) override {
-        logger.info("Achieved consensus for block: %s" , std::string(*blk).c_str());
+        E2C_LOG_PROTO("Achieved consensus for block %016lx at height %u",
+                    trace_id(blk->get_hash()), blk->get_height());
         return ;
     }
-
-//     // Need to implement beat, get_parents, beat_resp, impeach, on_consensus,
-//     // get_pending_size
 };
 
 } // end of namespace e2c
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "libe2c/type.h"
+
+/*
+ * NOTE: Binary Merkle tree over the command hashes of a block. A node is the
+ * SHA-256 of its two children concatenated, the last node of a level with an
+ * odd width moves up unchanged. The shape only depends on the number of
+ * leaves, which is part of the block header, so a path is checked against the
+ * root together with the index of the leaf and the number of leaves.
+ */
+
+namespace e2c {
+
+class MerkleTree {
+    /** levels[0] are the leaves, the last level holds the root */
+    std::vector<std::vector<uint256_t>> levels;
+
+    public:
+    MerkleTree(const std::vector<uint256_t> &leaves);
+
+    /** the root, a zero hash for no leaves */
+    const uint256_t &get_root() const { return levels.back()[0]; }
+
+    /** The siblings on the way from leaves[idx] up to the root. */
+    std::vector<uint256_t> get_path(size_t idx) const;
+
+    /** The root without keeping the inner levels. */
+    static uint256_t root(const std::vector<uint256_t> &leaves);
+
+    /** Check that leaf is the leaf idx of the n leaves under root. */
+    static bool verify(const uint256_t &root, const uint256_t &leaf,
+                        size_t idx, size_t n,
+                        const std::vector<uint256_t> &path);
+};
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "salticidae/ref.h"
+
+/*
+ * NOTE: Metrics updated on the hot paths. Every counter and histogram is
+ * sharded into cache-line sized slots, a thread only touches its own slot
+ * with relaxed atomics, and readers add up the slots when taking a snapshot.
+ * Registration takes a lock and should be done once, at startup.
+ */
+
+namespace e2c {
+
+using salticidae::BoxObj;
+
+/** number of slots per metric, threads beyond this share slots */
+static const size_t metrics_nshards = 16;
+static const size_t cache_line_size = 64;
+
+/** @return the slot of the calling thread */
+size_t metrics_shard();
+
+class Counter {
+    struct alignas(cache_line_size) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+    Shard shards[metrics_nshards];
+
+    public:
+    void add(uint64_t n = 1) {
+        shards[metrics_shard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        uint64_t sum = 0;
+        for (const auto &s: shards)
+            sum += s.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+};
+
+/** A value that goes up and down (e.g. a queue depth). */
+class Gauge {
+    alignas(cache_line_size) std::atomic<int64_t> value{0};
+
+    public:
+    void set(int64_t v) { value.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+    int64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+/** Histogram with fixed bucket upper bounds (inclusive), plus an implicit
+ * overflow bucket. */
+class Histogram {
+    struct alignas(cache_line_size) Shard {
+        std::unique_ptr<std::atomic<uint64_t>[]> counts;
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> count{0};
+    };
+    std::vector<uint64_t> bounds;
+    Shard shards[metrics_nshards];
+
+    public:
+    Histogram(std::vector<uint64_t> &&bounds);
+
+    void observe(uint64_t v) {
+        size_t i = 0;
+        /* bounds are few, a linear scan beats a branchy binary search */
+        while (i < bounds.size() && v > bounds[i]) i++;
+        auto &s = shards[metrics_shard()];
+        s.counts[i].fetch_add(1, std::memory_order_relaxed);
+        s.sum.fetch_add(v, std::memory_order_relaxed);
+        s.count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const std::vector<uint64_t> &get_bounds() const { return bounds; }
+    /** @return the per-bucket (non-cumulative) counts, the last one being the
+     * overflow bucket */
+    std::vector<uint64_t> get_counts() const;
+    uint64_t get_sum() const;
+    uint64_t get_count() const;
+};
+
+/** @return count bounds start, start * factor, start * factor^2, ... */
+std::vector<uint64_t> exponential_buckets(uint64_t start, double factor, size_t count);
+
+enum MetricType {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+};
+
+struct MetricSample {
+    std::string name;
+    /** Prometheus labels without braces, e.g. `peer="1a2b"` */
+    std::string labels;
+    std::string help;
+    MetricType type;
+    /** value of a counter or a gauge */
+    double value;
+    /* histogram only */
+    std::vector<uint64_t> bounds;
+    std::vector<uint64_t> counts;
+    uint64_t sum;
+    uint64_t count;
+
+    /** @return the upper bound of the bucket holding the q-th percentile */
+    uint64_t percentile(double q) const;
+    double mean() const { return count ? sum / double(count) : 0; }
+};
+
+struct MetricsSnapshot {
+    std::vector<MetricSample> samples;
+
+    const MetricSample *find(const std::string &name,
+                            const std::string &labels = "") const;
+    /** The sample value of name, or 0 if it is not registered. */
+    double get(const std::string &name, const std::string &labels = "") const;
+    /** @return the increase since prev for counters and histograms, gauges
+     * are kept as is */
+    MetricsSnapshot delta(const MetricsSnapshot &prev) const;
+    /** Render in the Prometheus text exposition format. */
+    std::string to_prometheus() const;
+};
+
+class MetricsRegistry {
+    struct Entry {
+        std::string name;
+        std::string labels;
+        std::string help;
+        MetricType type;
+        BoxObj<Counter> counter;
+        BoxObj<Gauge> gauge;
+        BoxObj<Histogram> histogram;
+    };
+    mutable std::mutex lock;
+    /* keyed by name and labels, so that a family is listed contiguously */
+    std::map<std::pair<std::string, std::string>, Entry> entries;
+
+    Entry &get_entry(const std::string &name, const std::string &labels,
+                    const std::string &help, MetricType type);
+
+    public:
+    /* Look up or register a metric, the returned reference stays valid for
+     * the lifetime of the registry. */
+    Counter &counter(const std::string &name, const std::string &help,
+                    const std::string &labels = "");
+    Gauge &gauge(const std::string &name, const std::string &help,
+                const std::string &labels = "");
+    Histogram &histogram(const std::string &name, const std::string &help,
+                        std::vector<uint64_t> &&bounds,
+                        const std::string &labels = "");
+
+    MetricsSnapshot snapshot() const;
+    /** Write the Prometheus text dump to path (atomically replacing the
+     * file, so it can be picked up by a textfile collector).
+     * @return false on I/O error */
+    bool dump_prometheus(const std::string &path) const;
+};
+
+}
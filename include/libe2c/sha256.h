@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "libe2c/type.h"
+
+/*
+ * NOTE: Batched SHA-256 for the many small messages of the hot paths
+ * (commands of a client batch, blocks of a response). The kernel is picked
+ * once at run time: SHA-NI hashes the messages one after another, AVX2
+ * hashes 8 of them at once in the lanes of the vector registers, the scalar
+ * code is the fallback. The digests are the ones of salticidae::get_hash.
+ */
+
+namespace e2c {
+
+enum class Sha256Kernel {
+    scalar,
+    shani,
+    avx2,
+};
+
+/** whether the CPU runs the kernel */
+bool sha256_supported(Sha256Kernel kernel);
+/** the kernel used by sha256_batch() */
+Sha256Kernel sha256_kernel();
+const char *sha256_kernel_name(Sha256Kernel kernel);
+
+/** Hash n messages: digests[i] is the SHA-256 of msgs[i][0 .. lens[i]). */
+void sha256_batch(const uint8_t *const *msgs, const size_t *lens, size_t n,
+                    uint8_t (*digests)[32]);
+/** Same with the given (supported) kernel. */
+void sha256_batch(Sha256Kernel kernel,
+                    const uint8_t *const *msgs, const size_t *lens, size_t n,
+                    uint8_t (*digests)[32]);
+
+/** The hash of a single message, as salticidae::get_hash would give. */
+uint256_t sha256(const uint8_t *data, size_t len);
+
+/** Messages collected to be hashed together. The data must stay valid
+ * until digest() returns. */
+class Sha256Batch {
+    std::vector<const uint8_t *> msgs;
+    std::vector<size_t> lens;
+
+    public:
+    void reserve(size_t n) {
+        msgs.reserve(n);
+        lens.reserve(n);
+    }
+
+    void add(const uint8_t *data, size_t len) {
+        msgs.push_back(data);
+        lens.push_back(len);
+    }
+
+    size_t size() const { return msgs.size(); }
+
+    /** @return the hashes in the order the messages were added */
+    std::vector<uint256_t> digest() const;
+};
+
+}
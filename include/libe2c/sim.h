@@ -0,0 +1,273 @@
+#pragma once
+
+#include <deque>
+#include <queue>
+#include <random>
+#include <functional>
+#include <unordered_map>
+
+#include "libe2c/consensus.h"
+#include "libe2c/e2c.h"
+#include "libe2c/histogram.h"
+
+/*
+ * NOTE: An in-process simulation of E2C: replicas are plain E2CCore
+ * instances talking through a simulated network, and every timer (including
+ * the 2\Delta commit timers) runs in virtual time. A run is fully determined
+ * by its configuration and seed.
+ */
+
+namespace e2c {
+
+/** Discrete-event scheduler keeping the virtual time. */
+class SimClock {
+    struct Event {
+        double time;
+        uint64_t seq;
+        std::function<void()> callback;
+        bool operator>(const Event &other) const {
+            return time > other.time || (time == other.time && seq > other.seq);
+        }
+    };
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    double now;
+    uint64_t nseq;
+
+    public:
+    SimClock(): now(0), nseq(0) {}
+
+    double get_time() const { return now; }
+    size_t get_nevents() const { return nseq; }
+
+    /** Run callback after delay (in virtual seconds). */
+    void schedule(double delay, std::function<void()> callback) {
+        events.push(Event{now + delay, nseq++, std::move(callback)});
+    }
+
+    /** Process the earliest event.
+     * @return false if no event is left */
+    bool step() {
+        if (events.empty()) return false;
+        /* the callback may schedule more events */
+        auto cb = std::move(const_cast<Event &>(events.top()).callback);
+        now = events.top().time;
+        events.pop();
+        cb();
+        return true;
+    }
+
+    /** Process the events scheduled no later than deadline. */
+    void run_until(double deadline) {
+        while (!events.empty() && events.top().time <= deadline)
+            step();
+    }
+};
+
+struct SimNetConfig {
+    /** one-way delay of a message (in seconds) */
+    double delay;
+    /** extra delay drawn uniformly from [0, jitter) */
+    double jitter;
+    /** probability of a proposal message being dropped */
+    double loss;
+    uint64_t seed;
+
+    SimNetConfig(): delay(0.01), jitter(0), loss(0), seed(0) {}
+};
+
+class SimReplicaBase;
+class Simulation;
+
+/** Point-to-point links between the simulated replicas. */
+class SimNetwork {
+    SimClock &clock;
+    SimNetConfig config;
+    std::mt19937_64 rng;
+    std::vector<SimReplicaBase *> replicas;
+
+    public:
+    /* statistics */
+    uint64_t nmsgs;
+    uint64_t nbytes;
+    uint64_t ndropped;
+
+    SimNetwork(SimClock &clock, const SimNetConfig &config):
+        clock(clock), config(config), rng(config.seed),
+        nmsgs(0), nbytes(0), ndropped(0) {}
+
+    void add_replica(SimReplicaBase *replica) { replicas.push_back(replica); }
+    SimReplicaBase *get_replica(ReplicaID rid) { return replicas[rid]; }
+    size_t size() const { return replicas.size(); }
+    SimClock &get_clock() { return clock; }
+
+    /** the one-way delay of the next message */
+    double gen_delay();
+    /** Deliver a message to all live replicas except the sender, by invoking
+     * handler on each of them. Only the lossy messages may be dropped. */
+    void multicast(ReplicaID from, const bytearray_t &msg,
+                    void (SimReplicaBase::*handler)(ReplicaID, bytearray_t &&),
+                    bool lossy = false);
+    /** Deliver a message to replica `to`, if both ends are live. */
+    void send(ReplicaID from, ReplicaID to, const bytearray_t &msg,
+                void (SimReplicaBase::*handler)(ReplicaID, bytearray_t &&));
+    /** Deliver a proposal to all replicas except the sender. */
+    void multicast_proposal(ReplicaID from, const bytearray_t &msg);
+};
+
+/** E2C protocol on top of the simulated network (without the cryptographic
+ * implementation). */
+class SimReplicaBase: public E2CCore {
+    Simulation &sim;
+    std::unordered_map<const uint256_t, promise_t> blk_fetch_waiting;
+    std::unordered_map<const uint256_t, promise_t> blk_delivery_waiting;
+
+    /** the commands submitted to this replica and not decided yet, by the
+     * virtual time of their submission */
+    std::unordered_map<const uint256_t, double> cmd_waiting;
+    /** the commands of cmd_waiting in submission order, the decided ones are
+     * dropped from the front lazily */
+    std::deque<std::pair<uint256_t, double>> cmd_order;
+    /** the commands to propose as the leader */
+    std::deque<uint256_t> cmd_buffer;
+
+    promise_t async_fetch_blk(const uint256_t &blk_hash, ReplicaID replica);
+    promise_t async_deliver_blk(const uint256_t &blk_hash, ReplicaID replica);
+    /** Propose the buffered commands in blocks of blk_size, the last partial
+     * one once all commands are submitted. */
+    void propose_pending();
+    /** Blame the leader as a replica does (see E2CCore::check_stalled()),
+     * every \delta while commands are left undecided. */
+    void check_progress();
+
+    protected:
+    void do_broadcast_proposal(const Proposal &prop) override;
+    void do_decide(Finality &&fin) override;
+    void do_consensus(const block_t &blk) override;
+    void do_set_commit_timer(const block_t &blk, double timeout) override;
+    void do_broadcast_blame(const Blame &bl) override;
+    void do_broadcast_equiv_blame(const EquivBlame &eb) override;
+    void do_broadcast_quit_view(const QuitView &qv) override;
+    void do_set_view_timer(uint32_t view, double timeout) override;
+    void do_enter_view(uint32_t view) override;
+    void do_send_status(const Status &st) override;
+    void do_view_synced(uint32_t view) override;
+
+    public:
+    /* statistics */
+    uint64_t ndecided;
+    uint64_t ncommitted;
+    /** time between a block being proposed and committed (in microseconds) */
+    LatencyHistogram commit_latency;
+    /** a crashed replica neither sends nor handles any message */
+    bool crashed;
+
+    SimReplicaBase(Simulation &sim, ReplicaID rid, privkey_bt &&priv_key):
+        E2CCore(rid, std::move(priv_key)), sim(sim),
+        ndecided(0), ncommitted(0), crashed(false) {}
+
+    /** Start monitoring the progress of the leaders. */
+    void start();
+
+    /** Submit commands to be decided, as a client sending them to every
+     * replica. The leader buffers them for its proposals. */
+    void submit(const std::vector<uint256_t> &cmds);
+
+    /** Handle a proposal message sent by replica `from`. */
+    void on_recv_proposal(ReplicaID from, bytearray_t &&msg);
+    /** Handle a blame message sent by replica `from`. */
+    void on_recv_blame(ReplicaID from, bytearray_t &&msg);
+    /** Handle an equivocation proof sent by replica `from`. */
+    void on_recv_equiv_blame(ReplicaID from, bytearray_t &&msg);
+    /** Handle a quit-view certificate sent by replica `from`. */
+    void on_recv_quit_view(ReplicaID from, bytearray_t &&msg);
+    /** Handle a status sent by replica `from` to the leader. */
+    void on_recv_status(ReplicaID from, bytearray_t &&msg);
+};
+
+/** Simulated E2C replica (templated by cryptographic implementation). */
+template<typename PrivKeyType = PrivKeyDummy,
+        typename PubKeyType = PubKeyDummy,
+        typename PartCertType = PartCertDummy,
+        typename QuorumCertType = QuorumCertDummy>
+class SimReplica: public SimReplicaBase {
+    using SimReplicaBase::SimReplicaBase;
+    protected:
+
+    part_cert_bt create_part_cert(const PrivKey &priv_key, const uint256_t &blk_hash) override {
+        return new PartCertType(
+                    static_cast<const PrivKeyType &>(priv_key),
+                    blk_hash);
+    }
+
+    part_cert_bt parse_part_cert(DataStream &s) override {
+        PartCert *pc = new PartCertType();
+        s >> *pc;
+        return pc;
+    }
+
+    quorum_cert_bt create_quorum_cert(const uint256_t &blk_hash) override {
+        return new QuorumCertType(get_config(), blk_hash);
+    }
+
+    quorum_cert_bt parse_quorum_cert(DataStream &s) override {
+        QuorumCert *qc = new QuorumCertType();
+        s >> *qc;
+        return qc;
+    }
+};
+
+struct SimConfig {
+    size_t nreplicas;
+    /** number of blocks worth of commands submitted */
+    size_t nblocks;
+    size_t blk_size;
+    double delta;
+    /** time between two submissions of a block worth of commands */
+    double interval;
+    /** the leader of the first view */
+    ReplicaID proposer;
+    /** when the first leader crashes (never if negative) */
+    double crash_at;
+    SimNetConfig netconfig;
+
+    SimConfig(): nreplicas(4), nblocks(100), blk_size(100),
+        delta(0.05), interval(0.01), proposer(1),
+        crash_at(-1) {}
+};
+
+/** A set of replicas deciding dummy commands on a simulated network. */
+class Simulation {
+    SimConfig config;
+    SimClock clock;
+    SimNetwork net;
+    std::vector<BoxObj<SimReplicaBase>> replicas;
+    size_t nsubmitted;
+
+    void submit();
+    void crash();
+
+    public:
+    /** virtual time when each block is proposed */
+    std::unordered_map<const uint256_t, double> proposed_at;
+    /** virtual time between the leader crashing and the first commit of a
+     * block proposed by another leader (negative if it never happened) */
+    double failover;
+
+    /** Create the replicas (without signatures) and connect them. */
+    Simulation(const SimConfig &config);
+
+    /** Run until all submitted commands are decided by all live replicas.
+     * @return the virtual time when the run finished */
+    double run();
+
+    const SimConfig &get_config() const { return config; }
+    ReplicaID get_leader(uint32_t view) const {
+        return (config.proposer + view) % config.nreplicas;
+    }
+    bool all_submitted() const { return nsubmitted >= config.nblocks; }
+    SimClock &get_clock() { return clock; }
+    SimNetwork &get_net() { return net; }
+    SimReplicaBase &get_replica(ReplicaID rid) { return *replicas[rid]; }
+};
+
+}
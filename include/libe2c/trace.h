@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "libe2c/type.h"
+
+/*
+ * NOTE: Per-block trace spans. Events are appended to a fixed-size ring
+ * buffer without locks (the oldest ones are overwritten) and can be dumped
+ * in the Chrome trace-event format (chrome://tracing, Perfetto). Tracing is
+ * off by default and then costs a single relaxed load per event.
+ */
+
+namespace e2c {
+
+class Tracer {
+    struct Slot {
+        /* 2 * idx + 1 while being written, 2 * idx + 2 once done */
+        std::atomic<uint64_t> seq{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<char> phase{0};
+        std::atomic<uint32_t> tid{0};
+        std::atomic<uint64_t> ts{0};
+        std::atomic<uint64_t> dur{0};
+        std::atomic<uint64_t> id{0};
+        std::atomic<uint64_t> arg{0};
+    };
+
+    std::atomic<bool> enabled;
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    std::atomic<uint64_t> head;
+    uint32_t pid;
+    std::chrono::steady_clock::time_point start;
+
+    void record(char phase, const char *name, uint64_t id,
+                uint64_t ts, uint64_t dur, uint64_t arg);
+
+    public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    Tracer(): enabled(false), mask(0), head(0), pid(0),
+        start(std::chrono::steady_clock::now()) {}
+
+    /** Start recording into a ring of (at least) capacity events. Should be
+     * called before any thread starts tracing. */
+    void enable(size_t capacity, uint32_t pid);
+    bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    static time_point now() { return std::chrono::steady_clock::now(); }
+
+    /** A span of the calling thread, from since to now. */
+    void span(const char *name, uint64_t id, const time_point &since, uint64_t arg = 0) {
+        if (!is_enabled()) return;
+        using std::chrono::nanoseconds;
+        using std::chrono::duration_cast;
+        record('X', name, id,
+                duration_cast<nanoseconds>(since - start).count(),
+                duration_cast<nanoseconds>(now() - since).count(), arg);
+    }
+
+    /* Spans of a block crossing threads, matched by name and id. */
+    void begin(const char *name, uint64_t id, uint64_t arg = 0) {
+        if (is_enabled()) record('b', name, id, elapsed_ns(), 0, arg);
+    }
+
+    void end(const char *name, uint64_t id, uint64_t arg = 0) {
+        if (is_enabled()) record('e', name, id, elapsed_ns(), 0, arg);
+    }
+
+    void instant(const char *name, uint64_t id, uint64_t arg = 0) {
+        if (is_enabled()) record('i', name, id, elapsed_ns(), 0, arg);
+    }
+
+    uint64_t elapsed_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            now() - start).count();
+    }
+
+    /** Write the buffered events as Chrome trace-event JSON.
+     * @return false on I/O error */
+    bool dump_chrome(const std::string &path) const;
+};
+
+/** trace id of a block or a command */
+inline uint64_t trace_id(const uint256_t &hash) {
+    return std::hash<uint256_t>()(hash);
+}
+
+extern Tracer tracer;
+
+}
@@ -2,6 +2,7 @@
 
 #include "salticidae/util.h"
 #include "libe2c/config.h"
+#include "libe2c/binlog.h"
 
 namespace e2c {
 
@@ -22,10 +23,48 @@ class Logger: public salticidae::Logger {
 // A global Logger Class
 extern Logger logger ;
 
+/** SipHash-2-4 of data with the 128-bit key (k0, k1). */
+uint64_t siphash24(uint64_t k0, uint64_t k1, const uint8_t *data, size_t len);
+
+/** Write a protocol log to the binary log if it is open, otherwise to logger.
+ * The format id is cached in fmt_id, one per call site. */
+template<typename... Args>
+void binlog_proto(std::atomic<uint32_t> &fmt_id, const char *fmt, const Args &...args) {
+    if (!binlog.is_open())
+    {
+        logger.prot_log(fmt, args...);
+        return;
+    }
+    uint32_t id = fmt_id.load(std::memory_order_relaxed);
+    if (id == UINT32_MAX)
+        fmt_id.store(id = binlog.register_format(fmt), std::memory_order_relaxed);
+    binlog.write(id, args...);
+}
+
+}
+
 /*
- * Logging can be enabled in source code, by defining the compiler flags:
- * E2C_{TRACE, DEBUG, INFO, WARN, ERROR}
+ * Logging macros, the arguments of a disabled level are not evaluated.
+ * E2C_LOG_DEBUG is enabled by E2C_DEBUG and E2C_LOG_PROTO (per-block
+ * protocol events on the hot paths) by E2C_ENABLE_PROT_LOG, see config.h.
+ * Protocol logs go to the asynchronous binary log once it is opened.
  */
 
+#ifdef E2C_DEBUG
+#define E2C_LOG_DEBUG(...) e2c::logger.debug(__VA_ARGS__)
+#else
+#define E2C_LOG_DEBUG(...) ((void)0)
+#endif
 
-}
+#ifdef E2C_ENABLE_PROT_LOG
+#define E2C_LOG_PROTO(...) do { \
+        static std::atomic<uint32_t> _e2c_fmt_id{UINT32_MAX}; \
+        e2c::binlog_proto(_e2c_fmt_id, __VA_ARGS__); \
+    } while (0)
+#else
+#define E2C_LOG_PROTO(...) ((void)0)
+#endif
+
+#define E2C_LOG_INFO(...) e2c::logger.info(__VA_ARGS__)
+#define E2C_LOG_WARN(...) e2c::logger.warning(__VA_ARGS__)
+#define E2C_LOG_ERROR(...) e2c::logger.error(__VA_ARGS__)
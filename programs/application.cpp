@@ -17,6 +17,7 @@
 #include <cassert>
 #include <algorithm>
 #include <random>
+#include <mutex>
 #include <unistd.h>
 #include <signal.h>
 
@@ -32,6 +33,7 @@
 #include "libe2c/client.h"
 #include "libe2c/e2c.h"
 #include "libe2c/liveness.h"
+#include "libe2c/sha256.h"
 
 using salticidae::MsgNetwork;
 using salticidae::ClientNetwork;
@@ -56,14 +58,20 @@ using e2c::bytearray_t;
 using e2c::DataStream;
 using e2c::ReplicaID;
 using e2c::MsgReqCmd;
+using e2c::MsgReqCmdBatch;
+using e2c::MsgReqCmdWatch;
 using e2c::MsgRespCmd;
+using e2c::MsgRespCmdBatch;
+using e2c::MsgRespCmdCert;
 using e2c::get_hash;
 using e2c::promise_t;
 
-using E2C = e2c::E2CSecp256k1;
+using E2C = e2c::E2CDyn;
 
 class E2CApp: public E2C {
     double stat_period;
+    /** where the Prometheus text dump is written every stat period */
+    std::string metrics_file;
     double start_time ;
     EventContext req_ec;
     EventContext resp_ec;
@@ -79,7 +87,16 @@ class E2CApp: public E2C {
     std::unordered_map<const uint256_t, promise_t> unconfirmed;
 
     using conn_t = ClientNetwork<opcode_t>::conn_t;
-    using resp_queue_t = salticidae::MPSCQueueEventDriven<std::pair<Finality, NetAddr>>;
+    /** a batch of replies to one client */
+    struct ClientResp {
+        std::vector<Finality> fins;
+        ReplicaID proposer;
+        NetAddr addr;
+        /** the header and commit certificate of the block, if any */
+        bytearray_t proof;
+    };
+    using resp_queue_t = salticidae::MPSCQueueEventDriven<ClientResp>;
+    using resp_batch_t = std::unordered_map<NetAddr, std::vector<Finality>>;
 
     /* for the dedicated thread sending responses to the clients */
     std::thread req_thread;
@@ -87,8 +104,20 @@ class E2CApp: public E2C {
     resp_queue_t resp_queue;
     salticidae::BoxObj<salticidae::ThreadCall> resp_tcall;
     salticidae::BoxObj<salticidae::ThreadCall> req_tcall;
+    /** decided commands waiting for their block to finish committing, grouped
+     * by the client connection they are replied to */
+    std::mutex resp_pending_lock;
+    std::unordered_map<const uint256_t, resp_batch_t> resp_pending;
 
     void client_request_cmd_handler(MsgReqCmd &&, const conn_t &);
+    void client_request_cmd_batch_handler(MsgReqCmdBatch &&, const conn_t &);
+    void client_request_cmd_watch_handler(MsgReqCmdWatch &&, const conn_t &);
+    /** the callback replying the decision to the client at addr */
+    commit_cb_t client_resp_cb(const NetAddr &addr);
+    /** Turn the commands away if the replica is overloaded.
+     * @return false if they were rejected */
+    bool admit_client_cmds(const std::vector<uint256_t> &cmd_hashes,
+                            const NetAddr &addr, bool silent);
 
     static command_t parse_cmd(DataStream &s) {
         auto cmd = new CommandDummy();
@@ -96,21 +125,45 @@ class E2CApp: public E2C {
         return cmd;
     }
 
-    void reset_imp_timer() {
-        impeach_timer.del();
-        impeach_timer.add(2*get_delta());
+    void state_machine_execute(const Finality &) override {}
+
+
+    /** reply the decisions in blk to the clients */
+    void respond(const e2c::block_t &blk, const bytearray_t &proof) {
+        resp_batch_t resps;
+        {
+            std::lock_guard<std::mutex> _(resp_pending_lock);
+            auto it = resp_pending.find(blk->get_hash());
+            if (it == resp_pending.end()) return;
+            resps = std::move(it->second);
+            resp_pending.erase(it);
+        }
+        e2c::tracer.instant("respond", e2c::trace_id(blk->get_hash()), resps.size());
+        for (auto &p: resps)
+            resp_queue.enqueue(ClientResp{std::move(p.second), blk->get_proposer(), p.first, proof});
     }
 
-    void state_machine_execute(const Finality &fin) override {
-        reset_imp_timer();
+    void state_machine_commit(const e2c::block_t &blk) override {
+        /* with commit certificates, wait for one to reply */
+        if (!is_commit_cert())
+            respond(blk, bytearray_t());
+    }
+
+    void state_machine_certify(const e2c::block_t &blk, const e2c::CommitCert &cert) override {
+        DataStream s;
+        blk->serialize_header(s);
+        cert.serialize(s);
+        respond(blk, bytearray_t(std::move(s)));
     }
 
     std::unordered_set<conn_t> client_conns;
     void print_stat() const;
 
     public:
-    E2CApp(uint32_t blk_size,
+    E2CApp(const std::string &algo,
+                uint32_t blk_size,
                 double stat_period,
+                const std::string &metrics_file,
                 ReplicaID idx,
                 const bytearray_t &raw_privkey,
                 NetAddr plisten_addr,
@@ -142,11 +195,22 @@ int main(int argc, char **argv) {
 
     auto opt_blk_size = Config::OptValInt::create(1);
     auto opt_parent_limit = Config::OptValInt::create(-1);
+    auto opt_mempool_batch = Config::OptValInt::create(0);
+    auto opt_mempool_flush = Config::OptValDouble::create(0.01);
+    auto opt_commit_cert = Config::OptValFlag::create(false);
+    auto opt_cmd_high_watermark = Config::OptValInt::create(0);
+    auto opt_cmd_low_watermark = Config::OptValInt::create(-1);
+    auto opt_catchup_rate = Config::OptValDouble::create(0);
     auto opt_stat_period = Config::OptValDouble::create(200);
+    auto opt_metrics_file = Config::OptValStr::create();
+    auto opt_trace_file = Config::OptValStr::create();
+    auto opt_binlog = Config::OptValStr::create();
+    auto opt_trace_size = Config::OptValInt::create(1 << 20);
     auto opt_replicas = Config::OptValStrVec::create();
     auto opt_idx = Config::OptValInt::create(0);
     auto opt_client_port = Config::OptValInt::create(-1);
     auto opt_privkey = Config::OptValStr::create();
+    auto opt_algo = Config::OptValStr::create("secp256k1");
     auto opt_tls_privkey = Config::OptValStr::create();
     auto opt_tls_cert = Config::OptValStr::create();
     auto opt_help = Config::OptValFlag::create(false);
@@ -166,11 +230,22 @@ int main(int argc, char **argv) {
 
     config.add_opt("block-size", opt_blk_size, Config::SET_VAL);
     config.add_opt("parent-limit", opt_parent_limit, Config::SET_VAL);
+    config.add_opt("mempool-batch", opt_mempool_batch, Config::SET_VAL, 'k', "stream the commands to all replicas in batches of this size and propose their availability certificates (0 to disable)");
+    config.add_opt("mempool-flush", opt_mempool_flush, Config::SET_VAL, 'F', "the seconds a partial mempool batch waits for more commands before it is streamed");
+    config.add_opt("commit-cert", opt_commit_cert, Config::SWITCH_ON, 'C', "reply the clients with a commit certificate of f + 1 replicas, so that one reply is enough");
+    config.add_opt("cmd-high-watermark", opt_cmd_high_watermark, Config::SET_VAL, 'W', "reject the client commands once this many are pending (0 to accept all)");
+    config.add_opt("cmd-low-watermark", opt_cmd_low_watermark, Config::SET_VAL, 'w', "accept the client commands again once the pending ones drop to this (half of the high watermark by default)");
+    config.add_opt("catchup-rate", opt_catchup_rate, Config::SET_VAL, 'R', "the bytes per second of blocks served to the replicas catching up (0 for no limit)");
     config.add_opt("stat-period", opt_stat_period, Config::SET_VAL);
+    config.add_opt("binlog", opt_binlog, Config::SET_VAL, 'g', "write protocol logs to this binary log (see e2c-logdump)");
+    config.add_opt("trace-file", opt_trace_file, Config::SET_VAL, 'T', "record per-block trace spans and write them as Chrome trace JSON on exit");
+    config.add_opt("trace-size", opt_trace_size, Config::SET_VAL, 'z', "the number of trace events kept");
+    config.add_opt("metrics-file", opt_metrics_file, Config::SET_VAL, 'P', "write the metrics in Prometheus text format to this file every stat period");
     config.add_opt("replica", opt_replicas, Config::APPEND, 'a', "add an replica to the list");
     config.add_opt("idx", opt_idx, Config::SET_VAL, 'i', "specify the index in the replica list");
     config.add_opt("cport", opt_client_port, Config::SET_VAL, 'c', "specify the port listening for clients");
     config.add_opt("privkey", opt_privkey, Config::SET_VAL);
+    config.add_opt("algo", opt_algo, Config::SET_VAL, 'A', "the signature scheme of the keys (secp256k1, ed25519)");
     config.add_opt("tls-privkey", opt_tls_privkey, Config::SET_VAL);
     config.add_opt("tls-cert", opt_tls_cert, Config::SET_VAL);
     config.add_opt("pace-maker", opt_pace_maker, Config::SET_VAL, 'p', "specify pace maker (dummy, rr)");
@@ -249,8 +324,10 @@ int main(int argc, char **argv) {
     clinet_config
         .burst_size(opt_cliburst->get())
         .nworker(opt_clinworker->get());
-    papp = new E2CApp(opt_blk_size->get(),
+    papp = new E2CApp(opt_algo->get(),
+                        opt_blk_size->get(),
                         opt_stat_period->get(),
+                        opt_metrics_file->get(),
                         idx,
                         e2c::from_hex(opt_privkey->get()),
                         plisten_addr,
@@ -276,13 +353,48 @@ int main(int argc, char **argv) {
     ev_sigterm.add(SIGTERM);
 
     papp->set_delta(opt_imp_timeout->get()) ; // 2 minutes
+    if (opt_mempool_batch->get() > 0)
+    {
+        if (opt_mempool_flush->get() <= 0)
+            throw E2CError("--mempool-flush must be positive");
+        papp->enable_mempool(opt_mempool_batch->get(), opt_mempool_flush->get());
+    }
+    if (opt_commit_cert->get())
+    {
+        /* the blocks of the mempool commit to batches, not to commands */
+        if (opt_mempool_batch->get() > 0)
+            throw E2CError("--commit-cert does not work with --mempool-batch");
+        papp->enable_commit_cert();
+    }
+    if (opt_cmd_high_watermark->get() > 0)
+    {
+        size_t high = opt_cmd_high_watermark->get();
+        size_t low = opt_cmd_low_watermark->get() < 0 ? high / 2 :
+                        std::min<size_t>(opt_cmd_low_watermark->get(), high);
+        papp->set_cmd_watermarks(high, low);
+    }
+    if (opt_catchup_rate->get() < 0)
+        throw std::invalid_argument("catchup rate must be >=0");
+    papp->set_catchup_rate(opt_catchup_rate->get());
+    if (!opt_binlog->get().empty() && !e2c::binlog.open(opt_binlog->get()))
+        throw std::runtime_error("cannot open the binary log " + opt_binlog->get());
+    if (!opt_trace_file->get().empty())
+        e2c::tracer.enable(opt_trace_size->get(), idx);
     papp->start(reps);
+    if (!opt_trace_file->get().empty() &&
+        !e2c::tracer.dump_chrome(opt_trace_file->get()))
+        E2C_LOG_WARN("unable to write the trace to %s", opt_trace_file->get().c_str());
+    e2c::binlog.close();
+    if (e2c::binlog.ndropped)
+        E2C_LOG_WARN("%lu binary log records dropped", e2c::binlog.ndropped.load());
     elapsed.stop(true);
     return 0;
 }
 
-E2CApp::E2CApp(uint32_t blk_size,
+E2CApp::E2CApp(const std::string &algo,
+                        uint32_t blk_size,
                         double stat_period,
+                        const std::string &metrics_file,
                         ReplicaID idx,
                         const bytearray_t &raw_privkey,
                         NetAddr plisten_addr,
@@ -292,22 +404,26 @@ E2CApp::E2CApp(uint32_t blk_size,
                         size_t nworker,
                         const Net::Config &repnet_config,
                         const ClientNetwork<opcode_t>::Config &clinet_config):
-    E2C(blk_size, idx, raw_privkey,
+    E2C(e2c::create_crypto_suite(algo), blk_size, idx, raw_privkey,
             plisten_addr, std::move(pmaker), ec, nworker, repnet_config),
     stat_period(stat_period),
+    metrics_file(metrics_file),
     cn(req_ec, clinet_config),
     clisten_addr(clisten_addr) {
     /* prepare the thread used for sending back confirmations */
     resp_tcall = new salticidae::ThreadCall(resp_ec);
     req_tcall = new salticidae::ThreadCall(req_ec);
     resp_queue.reg_handler(resp_ec, [this](resp_queue_t &q) {
-        std::pair<Finality, NetAddr> p;
-        while (q.try_dequeue(p))
+        ClientResp r;
+        while (q.try_dequeue(r))
         {
             try {
-                cn.send_msg(MsgRespCmd(std::move(p.first)), p.second);
+                if (r.proof.empty())
+                    cn.send_msg(MsgRespCmdBatch(r.fins, r.proposer), r.addr);
+                else
+                    cn.send_msg(MsgRespCmdCert(r.proof, r.fins, r.proposer), r.addr);
             } catch (std::exception &err) {
-                e2c::logger.warning("unable to send to the client: %s", err.what());
+                E2C_LOG_WARN("unable to send to the client: %s", err.what());
             }
         }
         return false;
@@ -315,6 +431,8 @@ E2CApp::E2CApp(uint32_t blk_size,
 
     /* register the handlers for msg from clients */
     cn.reg_handler(salticidae::generic_bind(&E2CApp::client_request_cmd_handler, this, _1, _2));
+    cn.reg_handler(salticidae::generic_bind(&E2CApp::client_request_cmd_batch_handler, this, _1, _2));
+    cn.reg_handler(salticidae::generic_bind(&E2CApp::client_request_cmd_watch_handler, this, _1, _2));
     cn.start();
     cn.listen(clisten_addr);
 }
@@ -323,28 +441,83 @@ void E2CApp::client_request_cmd_handler(MsgReqCmd &&msg, const conn_t &conn) {
     const NetAddr addr = conn->get_addr();
     auto cmd = parse_cmd(msg.serialized);
     const auto &cmd_hash = cmd->get_hash();
-    e2c::logger.info ("processing %s", std::string(*cmd).c_str());
-    exec_command(cmd_hash, [this, addr](Finality fin) {
-        resp_queue.enqueue(std::make_pair(fin, addr));
-    });
+    E2C_LOG_DEBUG("processing %s", std::string(*cmd).c_str());
+    if (!admit_client_cmds({cmd_hash}, addr, false)) return;
+    exec_command(cmd_hash, client_resp_cb(addr));
+}
+
+void E2CApp::client_request_cmd_batch_handler(MsgReqCmdBatch &&msg, const conn_t &conn) {
+    const NetAddr addr = conn->get_addr();
+    auto &s = msg.serialized;
+    uint32_t size;
+    s >> size;
+    size = e2c::letoh(size);
+    /* the commands are laid out back to back with a fixed size, hash them
+     * in place and in one batch */
+    const size_t cmd_size = CommandDummy::wire_size;
+    const uint8_t *base = s.get_data_inplace(size * cmd_size);
+    e2c::Sha256Batch batch;
+    batch.reserve(size);
+    for (uint32_t i = 0; i < size; i++)
+        batch.add(base + i * cmd_size, cmd_size);
+    std::vector<uint256_t> cmd_hashes = batch.digest();
+    E2C_LOG_DEBUG("processing a batch of %u commands", size);
+    if (!admit_client_cmds(cmd_hashes, addr, msg.silent)) return;
+    exec_command(std::move(cmd_hashes),
+                msg.silent ? nullptr : client_resp_cb(addr), msg.forward);
+}
+
+void E2CApp::client_request_cmd_watch_handler(MsgReqCmdWatch &&msg, const conn_t &conn) {
+    const NetAddr addr = conn->get_addr();
+    if (!admit_client_cmds(msg.cmd_hashes, addr, false)) return;
+    exec_command(std::move(msg.cmd_hashes), client_resp_cb(addr));
+}
+
+bool E2CApp::admit_client_cmds(const std::vector<uint256_t> &cmd_hashes,
+                                const NetAddr &addr, bool silent) {
+    if (admit_cmds(cmd_hashes.size())) return true;
+    if (silent) return false;
+    /* tell the client to back off rather than let the queues grow */
+    std::vector<Finality> fins;
+    fins.reserve(cmd_hashes.size());
+    for (const auto &cmd_hash: cmd_hashes)
+        fins.push_back(Finality(get_id(), -1, 0, 0, cmd_hash, uint256_t()));
+    resp_queue.enqueue(ClientResp{std::move(fins), get_pace_maker()->get_proposer(), addr, bytearray_t()});
+    return false;
+}
+
+E2CApp::commit_cb_t E2CApp::client_resp_cb(const NetAddr &addr) {
+    return [this, addr](const Finality &fin) {
+        if (fin.decision != 1)
+        {
+            /* not part of a committed block, reply right away */
+            resp_queue.enqueue(ClientResp{{fin}, get_pace_maker()->get_proposer(), addr, bytearray_t()});
+            return;
+        }
+        std::lock_guard<std::mutex> _(resp_pending_lock);
+        resp_pending[fin.blk_hash][addr].push_back(fin);
+    };
 }
 
 void E2CApp::start(const std::vector<std::tuple<NetAddr, bytearray_t, bytearray_t>> &reps) {
     ev_stat_timer = TimerEvent(ec, [this](TimerEvent &) {
         E2CApp::print_stat();
+        if (!metrics_file.empty() && !get_metrics().dump_prometheus(metrics_file))
+            E2C_LOG_WARN("unable to write metrics to %s", metrics_file.c_str());
         //HotStuffCore::prune(100);
         ev_stat_timer.add(stat_period);
     });
     ev_stat_timer.add(stat_period);
     impeach_timer = TimerEvent(ec, [this](TimerEvent &) {
-        // If 2\delta has passed and no progress has been made, then impeach the leader
-        get_pace_maker()->impeach();
-        reset_imp_timer();
+        // If a pending command is left undecided by the leader, impeach it
+        check_progress();
+        impeach_timer.add(get_delta());
     });
-    e2c::logger.info("** starting the system with parameters **");
-    e2c::logger.info("blk_size = %lu", blk_size);
-    e2c::logger.info("conns = %lu", E2C::size());
-    e2c::logger.info("** starting the event loop...");
+    impeach_timer.add(get_delta());
+    E2C_LOG_INFO("** starting the system with parameters **");
+    E2C_LOG_INFO("blk_size = %lu", blk_size);
+    E2C_LOG_INFO("conns = %lu", E2C::size());
+    E2C_LOG_INFO("** starting the event loop...");
     E2C::start(reps);
     cn.reg_conn_handler([this](const salticidae::ConnPool::conn_t &_conn, bool connected) {
         auto conn = salticidae::static_pointer_cast<conn_t::type>(_conn);
@@ -376,7 +549,7 @@ void E2CApp::stop() {
 }
 
 void E2CApp::print_stat() const {
-    e2c::logger.info("--- client msg. (10s) ---");
+    E2C_LOG_INFO("--- client msg. (10s) ---");
     size_t _nsent = 0;
     size_t _nrecv = 0;
     for (const auto &conn: client_conns)
@@ -387,10 +560,10 @@ void E2CApp::print_stat() const {
         size_t nsb = conn->get_nsentb();
         size_t nrb = conn->get_nrecvb();
         conn->clear_msgstat();
-        e2c::logger.info("%s: %u(%u), %u(%u)",
+        E2C_LOG_INFO("%s: %u(%u), %u(%u)",
             std::string(conn->get_addr()).c_str(), ns, nsb, nr, nrb);
         _nsent += ns;
         _nrecv += nr;
     }
-    e2c::logger.info("--- end client msg. ---");
+    E2C_LOG_INFO("--- end client msg. ---");
 }
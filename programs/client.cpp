@@ -12,8 +12,11 @@
  * limitations under the License.
  */
 
+
 #include <cassert>
 #include <random>
+#include <chrono>
+#include <thread>
 #include <signal.h>
 #include <sys/time.h>
 
@@ -25,79 +28,386 @@
 #include "libe2c/util.h"
 #include "libe2c/type.h"
 #include "libe2c/client.h"
+#include "libe2c/histogram.h"
 
 using salticidae::Config;
+using salticidae::ThreadCall;
+using salticidae::BoxObj;
+using salticidae::_1;
+using salticidae::_2;
 
 using e2c::ReplicaID;
 using e2c::NetAddr;
 using e2c::EventContext;
+using e2c::TimerEvent;
 using e2c::MsgReqCmd;
+using e2c::MsgReqCmdBatch;
+using e2c::MsgReqCmdWatch;
 using e2c::MsgRespCmd;
+using e2c::MsgRespCmdBatch;
+using e2c::MsgRespCmdCert;
+using e2c::Finality;
 using e2c::CommandDummy;
 using e2c::E2CError;
 using e2c::uint256_t;
 using e2c::opcode_t;
 using e2c::command_t;
 
-EventContext ec;
-ReplicaID proposer;
+using Net = salticidae::MsgNetwork<opcode_t>;
+
+/* shared by all workers, only set before they start */
+std::vector<NetAddr> replicas;
 size_t max_async_num;
-int max_iter_num;
-uint32_t cid;
-uint32_t cnt = 0;
+size_t batch_size;
+/* only submit to the proposer, learnt from the responses */
+bool leader_only;
 uint32_t nfaulty;
+/* commands per second issued by one worker, closed-loop if zero */
+double worker_rate;
+/* accept a single reply carrying a commit certificate, checked with the
+ * public keys of the replicas */
+bool commit_cert;
+e2c::crypto_suite_bt crypto;
+std::vector<e2c::pubkey_bt> pubkeys;
+/* seconds to wait for the replica replying with the certificate before
+ * resending the commands to the next one */
+double resp_timeout;
 
 struct Request {
     command_t cmd;
     size_t confirmed;
-    salticidae::ElapsedTime et;
-    Request(const command_t &cmd): cmd(cmd), confirmed(0) { et.start(); }
+    /** replicas that turned the command away */
+    size_t rejected;
+    /** when the command was last sent */
+    double sent_at;
+    /** when the command was due, the latency is measured from there so that
+     * a late send in open loop is not left out */
+    double issued_at;
+    Request(const command_t &cmd, double sent_at, double issued_at):
+            cmd(cmd), confirmed(0), rejected(0),
+            sent_at(sent_at), issued_at(issued_at) {}
 };
 
-using Net = salticidae::MsgNetwork<opcode_t>;
+/* the worker index takes the low bits of the command ids, the client id the
+ * high ones */
+static const unsigned worker_bits = 16;
 
-std::unordered_map<ReplicaID, Net::conn_t> conns;
-std::unordered_map<const uint256_t, Request> waiting;
-std::vector<NetAddr> replicas;
-std::vector<std::pair<struct timeval, double>> elapsed;
-Net mn(ec, Net::Config());
+/* the pause after a rejection, doubled on each one and halved on each
+ * acknowledgement */
+static const double min_backoff = 1e-3;
+static const double max_backoff = 0.2;
+
+static double get_time() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
 
-void connect_all() {
+/** A client connected to all replicas through its own connections, running
+ * its own event loop in a dedicated thread. */
+class ClientWorker {
+    uint32_t cid;
+    uint32_t cnt;
+    int max_iter_num;
+    ReplicaID proposer;
+    /** the replica replying with the commit certificate */
+    ReplicaID responder;
+    EventContext ec;
+    Net mn;
+    BoxObj<ThreadCall> tcall;
+    std::thread handle;
+    /** fires when the next (Poisson) arrival is due in open-loop mode */
+    TimerEvent ev_arrival;
+    double next_arrival;
+    std::mt19937_64 rng;
+    std::exponential_distribution<double> arrival;
+    /** no command is sent until resume_at after a rejection */
+    TimerEvent ev_resume;
+    double backoff;
+    double resume_at;
+    /** checks the commands waiting for a certificate (or for the proposer
+     * with --leader-only) for too long */
+    TimerEvent ev_timeout;
+
+    std::unordered_map<ReplicaID, Net::conn_t> conns;
+    std::unordered_map<const uint256_t, Request> waiting;
+
+    /** @param scheduled the arrival time of the commands in open loop, now
+     * if zero */
+    bool try_send(bool check = true, double scheduled = 0);
+    /** Send the commands to the proposer (and the watches without a
+     * certificate) with --leader-only. */
+    void send_leader_only(const std::vector<command_t> &cmds);
+    /** @param certified the commit of fin has been proven */
+    void on_fin(const Finality &fin, bool certified = false);
+    /** Check the certificate of the block and the Merkle paths of the
+     * commands under its header. */
+    bool verify_cert(const MsgRespCmdCert &msg) const;
+    void on_arrival(TimerEvent &);
+    /** the replicas are overloaded, slow down */
+    void on_reject();
+    void on_timeout(TimerEvent &);
+    void client_resp_cmd_handler(MsgRespCmd &&, const Net::conn_t &);
+    void client_resp_cmd_batch_handler(MsgRespCmdBatch &&, const Net::conn_t &);
+    void client_resp_cmd_cert_handler(MsgRespCmdCert &&, const Net::conn_t &);
+
+    public:
+    uint64_t nsent;
+    uint64_t nacked;
+    /** commands given up after a rejection */
+    uint64_t nrejected;
+    /** open-loop commands not issued while backing off */
+    uint64_t nthrottled;
+    /** latencies of acknowledged commands in microseconds */
+    e2c::LatencyHistogram latency;
+    std::vector<std::pair<struct timeval, double>> elapsed;
+
+    ClientWorker(uint32_t cid, int max_iter_num, ReplicaID proposer);
+    void start();
+    void stop();
+};
+
+ClientWorker::ClientWorker(uint32_t cid, int max_iter_num, ReplicaID proposer):
+        cid(cid), cnt(0), max_iter_num(max_iter_num), proposer(proposer),
+        responder(cid % replicas.size()),
+        mn(ec, Net::Config()),
+        rng(std::random_device()()),
+        arrival(worker_rate > 0 ? worker_rate / batch_size : 1),
+        backoff(0), resume_at(0),
+        nsent(0), nacked(0), nrejected(0), nthrottled(0) {
+    mn.reg_handler(salticidae::generic_bind(&ClientWorker::client_resp_cmd_handler, this, _1, _2));
+    mn.reg_handler(salticidae::generic_bind(&ClientWorker::client_resp_cmd_batch_handler, this, _1, _2));
+    mn.reg_handler(salticidae::generic_bind(&ClientWorker::client_resp_cmd_cert_handler, this, _1, _2));
+    mn.start();
     for (size_t i = 0; i < replicas.size(); i++)
         conns.insert(std::make_pair(i, mn.connect_sync(replicas[i])));
 }
 
-bool try_send(bool check = true) {
+bool ClientWorker::try_send(bool check, double scheduled) {
+    if (backoff > 0 && get_time() < resume_at) return false;
     if ((!check || waiting.size() < max_async_num) && max_iter_num)
     {
-        auto cmd = new CommandDummy(cid, cnt++);
-        MsgReqCmd msg(*cmd);
-        for (auto &p: conns) mn.send_msg(msg, p.second);
-        e2c::logger.info("send new cmd %.10s",
-                            get_hex(cmd->get_hash()).c_str());
-        waiting.insert(std::make_pair(
-            cmd->get_hash(), Request(cmd)));
-        if (max_iter_num > 0)
-            max_iter_num--;
+        std::vector<command_t> cmds;
+        double now = get_time();
+        if (scheduled == 0) scheduled = now;
+        do {
+            command_t cmd = new CommandDummy(cid, cnt++);
+            E2C_LOG_DEBUG("send new cmd %.10s",
+                                get_hex(cmd->get_hash()).c_str());
+            waiting.insert(std::make_pair(
+                cmd->get_hash(), Request(cmd, now, scheduled)));
+            cmds.push_back(cmd);
+            if (max_iter_num > 0)
+                max_iter_num--;
+        } while (cmds.size() < batch_size && max_iter_num &&
+                (!check || waiting.size() < max_async_num));
+        nsent += cmds.size();
+        if (leader_only)
+            send_leader_only(cmds);
+        else if (commit_cert)
+        {
+            /* one replica replies with the proof, picked by the client id
+             * (see on_timeout) */
+            MsgReqCmdBatch msg(cmds, false, true);
+            for (auto &p: conns)
+                if (p.first != responder) mn.send_msg(msg, p.second);
+            mn.send_msg(MsgReqCmdBatch(cmds), conns[responder]);
+        }
+        else if (cmds.size() == 1)
+        {
+            MsgReqCmd msg(*cmds[0]);
+            for (auto &p: conns) mn.send_msg(msg, p.second);
+        }
+        else
+        {
+            MsgReqCmdBatch msg(cmds);
+            for (auto &p: conns) mn.send_msg(msg, p.second);
+        }
         return true;
     }
     return false;
 }
 
-void client_resp_cmd_handler(MsgRespCmd &&msg, const Net::conn_t &) {
-    auto &fin = msg.fin;
-    e2c::logger.info("got %s", std::string(msg.fin).c_str());
+void ClientWorker::send_leader_only(const std::vector<command_t> &cmds) {
+    /* the proposer (or whoever we think it is) gets the commands and replies
+     * with the proof, or the next f replicas only watch the decisions to
+     * make up f + 1 replies */
+    mn.send_msg(MsgReqCmdBatch(cmds, true), conns[proposer]);
+    if (commit_cert) return;
+    std::vector<uint256_t> cmd_hashes;
+    for (const auto &cmd: cmds)
+        cmd_hashes.push_back(cmd->get_hash());
+    MsgReqCmdWatch watch(cmd_hashes);
+    for (uint32_t i = 1; i <= nfaulty; i++)
+        mn.send_msg(watch, conns[(proposer + i) % replicas.size()]);
+}
+
+void ClientWorker::on_arrival(TimerEvent &) {
+    /* issue every request whose arrival time has passed, regardless of the
+     * outstanding ones */
+    double now = get_time();
+    while (next_arrival <= now && max_iter_num)
+    {
+        if (!try_send(false, next_arrival))
+            nthrottled += batch_size;
+        next_arrival += arrival(rng);
+    }
+    if (max_iter_num)
+        ev_arrival.add(std::max(next_arrival - get_time(), 0.0));
+}
+
+void ClientWorker::on_fin(const Finality &fin, bool certified) {
+    E2C_LOG_DEBUG("got %s", std::string(fin).c_str());
     const uint256_t &cmd_hash = fin.cmd_hash;
     auto it = waiting.find(cmd_hash);
-    auto &et = it->second.et;
     if (it == waiting.end()) return;
-    et.stop();
-    if (++it->second.confirmed <= nfaulty) return; // wait for f + 1 ack
-    e2c::logger.info("Acknowledged %s, wall: %.3f, cpu: %.3f",
-                        std::string(fin).c_str(),
-                        et.elapsed_sec, et.cpu_elapsed_sec);
+    /* the replica already waits for the decision (the command was resent),
+     * it replies again once decided */
+    if (fin.decision == 0) return;
+    if (fin.decision == -1)
+    {
+        /* a reply from the replica in charge of the command is final,
+         * otherwise the others may still make up f + 1 acks */
+        size_t slack = leader_only || commit_cert ? 0 : replicas.size() - (nfaulty + 1);
+        if (++it->second.rejected <= slack) return;
+        E2C_LOG_DEBUG("rejected %.10s", get_hex(cmd_hash).c_str());
+        nrejected++;
+        waiting.erase(it);
+        on_reject();
+        return;
+    }
+    if (!certified && ++it->second.confirmed <= nfaulty) return; // wait for f + 1 ack
+    if (backoff > 0 && (backoff /= 2) < min_backoff)
+        backoff = 0;
+    double wall = get_time() - it->second.issued_at;
+    E2C_LOG_DEBUG("Acknowledged %s, wall: %.3f",
+                        std::string(fin).c_str(), wall);
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    elapsed.push_back(std::make_pair(tv, wall));
+    latency.record(wall * 1e6);
+    nacked++;
     waiting.erase(it);
-    while (try_send());
+}
+
+void ClientWorker::on_reject() {
+    double now = get_time();
+    /* the rejections of one batch come together, back off once */
+    if (backoff > 0 && now < resume_at) return;
+    backoff = std::min(std::max(backoff * 2, min_backoff), max_backoff);
+    resume_at = now + backoff;
+    if (worker_rate == 0)
+    {
+        ev_resume.del();
+        ev_resume.add(backoff);
+    }
+}
+
+void ClientWorker::on_timeout(TimerEvent &) {
+    double now = get_time();
+    std::vector<command_t> cmds;
+    for (auto &p: waiting)
+        if (p.second.sent_at + resp_timeout <= now)
+        {
+            cmds.push_back(p.second.cmd);
+            p.second.sent_at = now;
+        }
+    if (!cmds.empty())
+    {
+        /* the replica may have crashed (or the proposer changed unseen),
+         * the next one replies instead (the commands get proposed again if
+         * they were silently committed) */
+        ReplicaID &next = leader_only ? proposer : responder;
+        next = (next + 1) % replicas.size();
+        E2C_LOG_WARN("no reply for %lu commands, resending them to replica %u",
+                    cmds.size(), next);
+        for (size_t i = 0; i < cmds.size(); i += batch_size)
+        {
+            std::vector<command_t> batch(cmds.begin() + i,
+                    cmds.begin() + std::min(i + batch_size, cmds.size()));
+            if (leader_only)
+                send_leader_only(batch);
+            else
+                mn.send_msg(MsgReqCmdBatch(batch), conns[next]);
+        }
+    }
+    ev_timeout.add(resp_timeout);
+}
+
+void ClientWorker::client_resp_cmd_handler(MsgRespCmd &&msg, const Net::conn_t &) {
+    on_fin(msg.fin);
+    if (worker_rate == 0)
+        while (try_send());
+}
+
+void ClientWorker::client_resp_cmd_batch_handler(MsgRespCmdBatch &&msg, const Net::conn_t &) {
+    if (msg.proposer < replicas.size())
+        proposer = msg.proposer;
+    for (const auto &fin: msg.fins)
+        on_fin(fin);
+    if (worker_rate == 0)
+        while (try_send());
+}
+
+bool ClientWorker::verify_cert(const MsgRespCmdCert &msg) const {
+    const auto &cert = msg.cert;
+    if (cert.blk_hash != msg.header.get_hash() ||
+        cert.height != msg.header.get_height() ||
+        !cert.is_valid(nfaulty + 1, replicas.size()))
+        return false;
+    for (const auto &v: cert.votes)
+        if (!v.second->verify(*pubkeys[v.first])) return false;
+    for (const auto &fin: msg.fins)
+        if (fin.decision != 1 || fin.blk_hash != cert.blk_hash ||
+            fin.ncmds != msg.header.get_ncmds() ||
+            !fin.verify_inclusion(msg.header.get_cmd_root()))
+            return false;
+    return true;
+}
+
+void ClientWorker::client_resp_cmd_cert_handler(MsgRespCmdCert &&msg, const Net::conn_t &) {
+    if (!commit_cert) return;
+    try {
+        msg.postponed_parse(*crypto);
+    } catch (std::exception &err) {
+        E2C_LOG_WARN("malformed commit proof: %s", err.what());
+        return;
+    }
+    if (!verify_cert(msg))
+    {
+        E2C_LOG_WARN("invalid commit proof for %s",
+                    get_hex10(msg.header.get_hash()).c_str());
+        return;
+    }
+    if (msg.proposer < replicas.size())
+        proposer = msg.proposer;
+    for (const auto &fin: msg.fins)
+        on_fin(fin, true);
+    if (worker_rate == 0)
+        while (try_send());
+}
+
+void ClientWorker::start() {
+    tcall = new ThreadCall(ec);
+    ev_resume = TimerEvent(ec, [this](TimerEvent &) { while (try_send()); });
+    if (commit_cert || leader_only)
+    {
+        ev_timeout = TimerEvent(ec, salticidae::generic_bind(&ClientWorker::on_timeout, this, _1));
+        ev_timeout.add(resp_timeout);
+    }
+    if (worker_rate > 0)
+    {
+        ev_arrival = TimerEvent(ec, salticidae::generic_bind(&ClientWorker::on_arrival, this, _1));
+        next_arrival = get_time();
+        ev_arrival.add(0);
+    }
+    else
+        while (try_send());
+    handle = std::thread([this]() { ec.dispatch(); });
+}
+
+void ClientWorker::stop() {
+    tcall->async_call([this](ThreadCall::Handle &) { ec.stop(); });
+    handle.join();
 }
 
 std::pair<std::string, std::string> split_ip_port_cport(const std::string &s) {
@@ -105,6 +415,32 @@ std::pair<std::string, std::string> split_ip_port_cport(const std::string &s) {
     return std::make_pair(ret[0], ret[1]);
 }
 
+void print_stats(FILE *f, const std::vector<BoxObj<ClientWorker>> &workers,
+                double rate, double wall) {
+    e2c::LatencyHistogram latency;
+    uint64_t nsent = 0, nacked = 0, nrejected = 0, nthrottled = 0;
+    for (const auto &w: workers)
+    {
+        latency.merge(w->latency);
+        nsent += w->nsent;
+        nacked += w->nacked;
+        nrejected += w->nrejected;
+        nthrottled += w->nthrottled;
+    }
+    fprintf(f, "{\"mode\": \"%s\", \"target_rate\": %.3f, \"nthread\": %zu, "
+                "\"batch\": %zu, \"wall\": %.6f, \"sent\": %lu, \"acked\": %lu, "
+                "\"rejected\": %lu, \"throttled\": %lu, \"throughput\": %.3f, \"latency_us\": {\"min\": %lu, "
+                "\"mean\": %.3f, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, "
+                "\"p999\": %lu, \"max\": %lu}}\n",
+                rate > 0 ? "open" : "closed", rate, workers.size(),
+                batch_size, wall, nsent, nacked, nrejected, nthrottled,
+                wall > 0 ? nacked / wall : 0,
+                latency.min(), latency.mean(),
+                latency.percentile(50), latency.percentile(90),
+                latency.percentile(99), latency.percentile(99.9),
+                latency.max());
+}
+
 int main(int argc, char **argv) {
     Config config("e2c-setup.conf");
 
@@ -113,25 +449,61 @@ int main(int argc, char **argv) {
     auto opt_max_iter_num = Config::OptValInt::create(100);
     auto opt_max_async_num = Config::OptValInt::create(10);
     auto opt_cid = Config::OptValInt::create(-1);
+    auto opt_batch_size = Config::OptValInt::create(1);
+    auto opt_leader_only = Config::OptValFlag::create(false);
+    auto opt_proposer = Config::OptValInt::create(1);
+    auto opt_rate = Config::OptValDouble::create(0);
+    auto opt_nthread = Config::OptValInt::create(1);
+    auto opt_duration = Config::OptValDouble::create(0);
+    auto opt_stats_file = Config::OptValStr::create("");
+    auto opt_commit_cert = Config::OptValFlag::create(false);
+    auto opt_algo = Config::OptValStr::create("secp256k1");
+    auto opt_resp_timeout = Config::OptValDouble::create(5);
 
+    EventContext ec;
     auto shutdown = [&](int) { ec.stop(); };
     salticidae::SigEvent ev_sigint(ec, shutdown);
     salticidae::SigEvent ev_sigterm(ec, shutdown);
     ev_sigint.add(SIGINT);
     ev_sigterm.add(SIGTERM);
 
-    mn.reg_handler(client_resp_cmd_handler);
-    mn.start();
-
     config.add_opt("idx", opt_idx, Config::SET_VAL);
     config.add_opt("cid", opt_cid, Config::SET_VAL);
     config.add_opt("replica", opt_replicas, Config::APPEND);
     config.add_opt("iter", opt_max_iter_num, Config::SET_VAL);
     config.add_opt("max-async", opt_max_async_num, Config::SET_VAL);
+    config.add_opt("batch", opt_batch_size, Config::SET_VAL);
+    config.add_opt("leader-only", opt_leader_only, Config::SWITCH_ON);
+    config.add_opt("proposer", opt_proposer, Config::SET_VAL);
+    config.add_opt("rate", opt_rate, Config::SET_VAL, 'r', "open-loop target rate (commands/s), closed-loop if 0");
+    config.add_opt("nthread", opt_nthread, Config::SET_VAL, 'T', "the number of client threads (each with its own connections)");
+    config.add_opt("duration", opt_duration, Config::SET_VAL, 'd', "stop after the given number of seconds (0 for no limit)");
+    config.add_opt("stats-file", opt_stats_file, Config::SET_VAL, 'o', "write the JSON summary to the file instead of stdout");
+    config.add_opt("commit-cert", opt_commit_cert, Config::SWITCH_ON, 'C', "wait for one reply with a commit certificate instead of f + 1 replies (the replicas need --commit-cert)");
+    config.add_opt("algo", opt_algo, Config::SET_VAL, 'A', "the signature scheme of the replica keys");
+    config.add_opt("resp-timeout", opt_resp_timeout, Config::SET_VAL, 'w', "with --commit-cert or --leader-only, resend the commands to the next replica after waiting this many seconds for a reply");
     config.parse(argc, argv);
     auto idx = opt_idx->get();
-    max_iter_num = opt_max_iter_num->get();
+    auto max_iter_num = opt_max_iter_num->get();
     max_async_num = opt_max_async_num->get();
+    if (opt_batch_size->get() < 1)
+        throw std::invalid_argument("batch size must be >0");
+    batch_size = opt_batch_size->get();
+    leader_only = opt_leader_only->get();
+    if (opt_nthread->get() < 1)
+        throw std::invalid_argument("nthread must be >0");
+    size_t nthread = opt_nthread->get();
+    if (nthread > (1u << worker_bits))
+        throw std::invalid_argument("too many threads");
+    if (opt_rate->get() < 0)
+        throw std::invalid_argument("rate must be >=0");
+    worker_rate = opt_rate->get() / nthread;
+    commit_cert = opt_commit_cert->get();
+    if (opt_resp_timeout->get() <= 0)
+        throw std::invalid_argument("resp timeout must be >0");
+    resp_timeout = opt_resp_timeout->get();
+    if (commit_cert)
+        crypto = e2c::create_crypto_suite(opt_algo->get());
     std::vector<std::string> raw;
     for (const auto &s: opt_replicas->get())
     {
@@ -139,11 +511,18 @@ int main(int argc, char **argv) {
         if (res.size() < 1)
             throw E2CError("format error");
         raw.push_back(res[0]);
+        if (!commit_cert) continue;
+        /* the same entries as for the replicas: addr, pubkey, tls cert */
+        if (res.size() < 2)
+            throw E2CError("the public keys of the replicas are needed");
+        pubkeys.push_back(crypto->parse_pubkey(e2c::from_hex(res[1])));
     }
 
     if (!(0 <= idx && (size_t)idx < raw.size() && raw.size() > 0))
         throw std::invalid_argument("out of range");
-    cid = opt_cid->get() != -1 ? opt_cid->get() : idx;
+    uint32_t cid = opt_cid->get() != -1 ? opt_cid->get() : idx;
+    if (cid >= (1u << (32 - worker_bits)))
+        throw std::invalid_argument("cid out of range");
     for (const auto &p: raw)
     {
         auto _p = split_ip_port_cport(p);
@@ -152,17 +531,46 @@ int main(int argc, char **argv) {
     }
     /* For E2C, in the synchronous world, we have n > 2f */
     nfaulty = (replicas.size() - 1) / 2;
-    e2c::logger.info("nfaulty = %zu", nfaulty);
-    connect_all();
-    while (try_send());
-    ec.dispatch();
+    if (!(0 <= opt_proposer->get() && (size_t)opt_proposer->get() < replicas.size()))
+        throw std::invalid_argument("proposer out of range");
+    E2C_LOG_INFO("nfaulty = %zu", nfaulty);
 
-    for (const auto &e: elapsed)
+    std::vector<BoxObj<ClientWorker>> workers;
+    for (size_t i = 0; i < nthread; i++)
     {
-        char fmt[64];
-        struct tm *tmp = localtime(&e.first.tv_sec);
-        strftime(fmt, sizeof fmt, "%Y-%m-%d %H:%M:%S.%%06u [hotstuff info] %%.6f\n", tmp);
-        fprintf(stderr, fmt, e.first.tv_usec, e.second);
+        /* split the iterations, -1 (unbounded) stays as is */
+        int n = nthread;
+        int iter = max_iter_num < 0 ? max_iter_num :
+                    max_iter_num / n + ((int)i < max_iter_num % n);
+        /* distinct cids keep the commands of the workers distinct, also
+         * from the ones of the other clients whatever their nthread */
+        workers.push_back(new ClientWorker((cid << worker_bits) | i, iter, opt_proposer->get()));
     }
+
+    TimerEvent ev_duration(ec, [&](TimerEvent &) { ec.stop(); });
+    if (opt_duration->get() > 0)
+        ev_duration.add(opt_duration->get());
+    salticidae::ElapsedTime wall;
+    wall.start();
+    for (auto &w: workers) w->start();
+    ec.dispatch();
+    for (auto &w: workers) w->stop();
+    wall.stop();
+
+    for (const auto &w: workers)
+        for (const auto &e: w->elapsed)
+        {
+            char fmt[64];
+            struct tm *tmp = localtime(&e.first.tv_sec);
+            strftime(fmt, sizeof fmt, "%Y-%m-%d %H:%M:%S.%%06u [hotstuff info] %%.6f\n", tmp);
+            fprintf(stderr, fmt, e.first.tv_usec, e.second);
+        }
+
+    auto &stats_file = opt_stats_file->get();
+    FILE *f = stats_file.empty() ? stdout : fopen(stats_file.c_str(), "w");
+    if (f == nullptr)
+        throw E2CError("cannot open %s", stats_file.c_str());
+    print_stats(f, workers, opt_rate->get(), wall.elapsed_sec);
+    if (f != stdout) fclose(f);
     return 0;
 }
@@ -0,0 +1,93 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Render a binary log written by e2c::BinLog as text. */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libe2c/binlog.h"
+
+using e2c::BinLogRecord;
+
+int main(int argc, char **argv) {
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <binary log>\n", argv[0]);
+        return 1;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if (f == nullptr)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    char magic[8];
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, "E2CBLOG1", 8))
+    {
+        fprintf(stderr, "%s: not an e2c binary log\n", argv[1]);
+        return 1;
+    }
+    /* the formats may be written after the records using them */
+    std::unordered_map<uint32_t, std::string> formats;
+    std::vector<BinLogRecord> records;
+    int tag;
+    while ((tag = fgetc(f)) != EOF)
+    {
+        if (tag == 'F')
+        {
+            uint32_t id;
+            uint16_t len;
+            if (fread(&id, sizeof(id), 1, f) != 1 ||
+                fread(&len, sizeof(len), 1, f) != 1) break;
+            std::string fmt(len, '\0');
+            if (fread(&fmt[0], 1, len, f) != len) break;
+            formats[id] = std::move(fmt);
+        }
+        else if (tag == 'R')
+        {
+            BinLogRecord rec;
+            if (fread(&rec, BinLogRecord::size, 1, f) != 1) break;
+            records.push_back(rec);
+        }
+        else
+        {
+            fprintf(stderr, "corrupted entry at offset %ld\n", ftell(f) - 1);
+            break;
+        }
+    }
+    fclose(f);
+    /* records of different threads are drained in batches, merge them */
+    std::stable_sort(records.begin(), records.end(),
+        [](const BinLogRecord &a, const BinLogRecord &b) { return a.ts < b.ts; });
+    for (const auto &rec: records)
+    {
+        time_t sec = rec.ts / 1000000000;
+        struct tm tm;
+        char tbuf[32];
+        localtime_r(&sec, &tm);
+        strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &tm);
+        auto it = formats.find(rec.fmt_id);
+        printf("%s.%06lu [%u] E2C: %s\n", tbuf,
+                (unsigned long)(rec.ts % 1000000000 / 1000), rec.tid,
+                it == formats.end() ? "<unknown format>" :
+                    rec.render(it->second).c_str());
+    }
+    return 0;
+}
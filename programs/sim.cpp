@@ -0,0 +1,135 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <cstdio>
+
+#include "salticidae/util.h"
+
+#include "libe2c/util.h"
+#include "libe2c/sim.h"
+
+using salticidae::Config;
+using salticidae::ElapsedTime;
+
+using e2c::E2CError;
+using e2c::SimConfig;
+using e2c::Simulation;
+using e2c::LatencyHistogram;
+
+int main(int argc, char **argv) {
+    Config config("e2c-sim.conf");
+
+    auto opt_nreplicas = Config::OptValInt::create(4);
+    auto opt_nblocks = Config::OptValInt::create(100);
+    auto opt_blk_size = Config::OptValInt::create(100);
+    auto opt_delta = Config::OptValDouble::create(0.05);
+    auto opt_interval = Config::OptValDouble::create(0.01);
+    auto opt_proposer = Config::OptValInt::create(1);
+    auto opt_delay = Config::OptValDouble::create(0.01);
+    auto opt_jitter = Config::OptValDouble::create(0);
+    auto opt_loss = Config::OptValDouble::create(0);
+    auto opt_seed = Config::OptValInt::create(0);
+    auto opt_crash_at = Config::OptValDouble::create(-1);
+    auto opt_stats_file = Config::OptValStr::create("");
+    auto opt_help = Config::OptValFlag::create(false);
+
+    config.add_opt("nreplicas", opt_nreplicas, Config::SET_VAL, 'n', "the number of replicas");
+    config.add_opt("nblocks", opt_nblocks, Config::SET_VAL, 'k', "the number of blocks worth of commands submitted");
+    config.add_opt("block-size", opt_blk_size, Config::SET_VAL, 'b', "the number of commands per block");
+    config.add_opt("delta", opt_delta, Config::SET_VAL, 't', "the synchrony bound (in virtual seconds)");
+    config.add_opt("interval", opt_interval, Config::SET_VAL, 'I', "the time between two submissions of a block worth of commands");
+    config.add_opt("proposer", opt_proposer, Config::SET_VAL, 'l', "the leader of the first view");
+    config.add_opt("delay", opt_delay, Config::SET_VAL, 'D', "the one-way network delay");
+    config.add_opt("jitter", opt_jitter, Config::SET_VAL, 'J', "the maximum extra (uniform) network delay");
+    config.add_opt("loss", opt_loss, Config::SET_VAL, 'L', "the probability of losing a proposal message");
+    config.add_opt("seed", opt_seed, Config::SET_VAL, 's', "the seed of the simulated network");
+    config.add_opt("crash-at", opt_crash_at, Config::SET_VAL, 'C', "crash the first leader at the given virtual time (never if negative)");
+    config.add_opt("stats-file", opt_stats_file, Config::SET_VAL, 'o', "write the JSON summary to the file instead of stdout");
+    config.add_opt("help", opt_help, Config::SWITCH_ON, 'h', "show this help info");
+    config.parse(argc, argv);
+    if (opt_help->get())
+    {
+        config.print_help();
+        exit(0);
+    }
+
+    SimConfig sconf;
+    if (opt_nreplicas->get() < 1 || opt_nblocks->get() < 1 || opt_blk_size->get() < 1)
+        throw E2CError("invalid simulation size");
+    sconf.nreplicas = opt_nreplicas->get();
+    sconf.nblocks = opt_nblocks->get();
+    sconf.blk_size = opt_blk_size->get();
+    sconf.delta = opt_delta->get();
+    sconf.interval = opt_interval->get();
+    if (!(0 <= opt_proposer->get() && (size_t)opt_proposer->get() < sconf.nreplicas))
+        throw E2CError("proposer out of range");
+    sconf.proposer = opt_proposer->get();
+    sconf.crash_at = opt_crash_at->get();
+    /* the remaining replicas must be able to gather the blames */
+    if (sconf.crash_at >= 0 && sconf.nreplicas < 3)
+        throw E2CError("crashing the leader needs at least 3 replicas");
+    sconf.netconfig.delay = opt_delay->get();
+    sconf.netconfig.jitter = opt_jitter->get();
+    sconf.netconfig.loss = opt_loss->get();
+    sconf.netconfig.seed = opt_seed->get();
+
+    Simulation sim(sconf);
+    ElapsedTime wall;
+    wall.start();
+    double vtime = sim.run();
+    wall.stop();
+
+    LatencyHistogram latency;
+    uint64_t ncommitted = 0, ndecided = 0;
+    uint32_t view = 0;
+    for (size_t i = 0; i < sconf.nreplicas; i++)
+    {
+        auto &r = sim.get_replica(i);
+        latency.merge(r.commit_latency);
+        ncommitted += r.ncommitted;
+        ndecided += r.ndecided;
+        view = std::max(view, r.get_view());
+    }
+    auto &net = sim.get_net();
+    auto &stats_file = opt_stats_file->get();
+    FILE *f = stats_file.empty() ? stdout : fopen(stats_file.c_str(), "w");
+    if (f == nullptr)
+        throw E2CError("cannot open %s", stats_file.c_str());
+    fprintf(f, "{\"nreplicas\": %zu, \"nblocks\": %zu, \"blk_size\": %zu, "
+                "\"delta\": %.6f, \"delay\": %.6f, \"jitter\": %.6f, \"loss\": %.6f, "
+                "\"virtual_time\": %.6f, \"wall\": %.6f, \"events\": %zu, "
+                "\"msgs\": %lu, \"bytes\": %lu, \"dropped\": %lu, "
+                "\"committed_blocks\": %lu, \"decided_cmds\": %lu, "
+                "\"throughput\": %.3f, \"sim_throughput\": %.3f, "
+                "\"commit_latency_us\": {\"min\": %lu, \"mean\": %.3f, \"p50\": %lu, "
+                "\"p99\": %lu, \"p999\": %lu, \"max\": %lu}, "
+                "\"crash_at\": %.6f, \"failover\": %.6f, \"view\": %u}\n",
+                sconf.nreplicas, sconf.nblocks, sconf.blk_size,
+                sconf.delta, sconf.netconfig.delay, sconf.netconfig.jitter,
+                sconf.netconfig.loss,
+                vtime, wall.elapsed_sec, sim.get_clock().get_nevents(),
+                net.nmsgs, net.nbytes, net.ndropped,
+                ncommitted, ndecided,
+                /* commands committed per virtual second by one replica */
+                vtime > 0 ? ndecided / (double)sconf.nreplicas / vtime : 0,
+                /* commands committed by all replicas per wall-clock second */
+                wall.elapsed_sec > 0 ? ndecided / wall.elapsed_sec : 0,
+                latency.min(), latency.mean(), latency.percentile(50),
+                latency.percentile(99), latency.percentile(99.9), latency.max(),
+                sconf.crash_at, sim.failover, view);
+    if (f != stdout) fclose(f);
+    return 0;
+}
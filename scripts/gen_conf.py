@@ -17,6 +17,7 @@ if __name__ == "__main__":
     parser.add_argument('--nodes', type=str, default='nodes.txt')
     parser.add_argument('--block-size', type=int, default=1)
     parser.add_argument('--pace-maker', type=str, default='dummy')
+    parser.add_argument('--algo', type=str, default='secp256k1')
     args = parser.parse_args()
 
 
@@ -36,7 +37,7 @@ if __name__ == "__main__":
     replicas = ["{}:{};{}".format(ip, base_pport + i, base_cport + i)
                 for ip in ips
                 for i in range(iter)]
-    p = subprocess.Popen([keygen_bin, '--num', str(len(replicas))],
+    p = subprocess.Popen([keygen_bin, '--num', str(len(replicas)), '--algo', args.algo],
                         stdout=subprocess.PIPE, stderr=open(os.devnull, 'w'))
     keys = [[t[4:] for t in l.decode('ascii').split()] for l in p.stdout]
     tls_p = subprocess.Popen([tls_keygen_bin, '--num', str(len(replicas))],
@@ -46,6 +47,7 @@ if __name__ == "__main__":
         main_conf.write("block-size = {}\n".format(args.block_size))
     if not (args.pace_maker is None):
         main_conf.write("pace-maker = {}\n".format(args.pace_maker))
+    main_conf.write("algo = {}\n".format(args.algo))
     for r in zip(replicas, keys, tls_keys, itertools.count(0)):
         main_conf.write("replica = {}, {}, {}\n".format(r[0], r[1][0], r[2][2]))
         r_conf_name = "{}-sec{}.conf".format(prefix, r[3])
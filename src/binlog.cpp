@@ -0,0 +1,197 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libe2c/binlog.h"
+
+namespace e2c {
+
+BinLog binlog;
+
+static const char binlog_magic[] = "E2CBLOG1";
+/* how long the writer sleeps when all rings are empty */
+static const auto binlog_idle = std::chrono::milliseconds(1);
+
+std::string BinLogRecord::render(const std::string &fmt) const {
+    std::string out;
+    size_t off = 0;
+    char buf[512];
+    for (size_t i = 0; i < fmt.size(); i++)
+    {
+        if (fmt[i] != '%') { out += fmt[i]; continue; }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%') { out += '%'; i++; continue; }
+        /* flags, width and precision are kept, length modifiers dropped */
+        std::string spec = "%";
+        size_t j = i + 1;
+        while (j < fmt.size() && strchr("-+ #0123456789.*", fmt[j])) spec += fmt[j++];
+        while (j < fmt.size() && strchr("hlLqjzt", fmt[j])) j++;
+        if (j == fmt.size()) break;
+        char conv = fmt[j];
+        i = j;
+        if (conv == 's')
+        {
+            if (off >= nbytes) { out += "<?>"; continue; }
+            size_t len = payload[off++];
+            std::string s((const char *)payload + off, std::min<size_t>(len, nbytes - off));
+            off += len;
+            snprintf(buf, sizeof(buf), (spec + "s").c_str(), s.c_str());
+            out += buf;
+            continue;
+        }
+        if (off + 8 > nbytes) { out += "<?>"; continue; }
+        uint64_t v;
+        memmove(&v, payload + off, 8);
+        off += 8;
+        if (strchr("fFeEgGaA", conv))
+        {
+            double d;
+            memmove(&d, &v, 8);
+            snprintf(buf, sizeof(buf), (spec + conv).c_str(), d);
+        }
+        else if (conv == 'd' || conv == 'i')
+            snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), (long long)v);
+        else if (conv == 'c')
+            snprintf(buf, sizeof(buf), (spec + conv).c_str(), (int)v);
+        else if (conv == 'p')
+            snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)v);
+        else
+            snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), (unsigned long long)v);
+        out += buf;
+    }
+    return out;
+}
+
+struct BinLog::ThreadRings {
+    /* one per BinLog instance the thread has written to, shared with it so
+     * that neither side outlives the ring */
+    std::vector<std::pair<uint64_t, std::shared_ptr<Ring>>> rings;
+
+    ~ThreadRings() {
+        for (auto &r: rings)
+            r.second->released.store(true, std::memory_order_release);
+    }
+};
+
+uint64_t BinLog::next_serial() {
+    static std::atomic<uint64_t> nserials(0);
+    return nserials.fetch_add(1, std::memory_order_relaxed);
+}
+
+BinLog::Ring *BinLog::get_ring() {
+    thread_local ThreadRings held;
+    for (auto &r: held.rings)
+        if (r.first == serial) return r.second.get();
+    std::shared_ptr<Ring> ring;
+    {
+        std::lock_guard<std::mutex> _(lock);
+        if (!free_rings.empty())
+        {
+            ring = std::move(free_rings.back());
+            free_rings.pop_back();
+            ring->released.store(false, std::memory_order_relaxed);
+        }
+        else
+        {
+            ring = std::make_shared<Ring>();
+            ring->tid = rings.size();
+        }
+        rings.push_back(ring);
+    }
+    held.rings.emplace_back(serial, ring);
+    return ring.get();
+}
+
+uint32_t BinLog::register_format(const char *fmt) {
+    std::lock_guard<std::mutex> _(lock);
+    for (size_t i = 0; i < formats.size(); i++)
+        if (formats[i] == fmt) return i;
+    formats.push_back(fmt);
+    return formats.size() - 1;
+}
+
+bool BinLog::open(const std::string &path) {
+    if (is_open()) return false;
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    fwrite(binlog_magic, 1, sizeof(binlog_magic) - 1, file);
+    nformats_written = 0;
+    running = true;
+    writer = std::thread([this]() { writer_loop(); });
+    opened.store(true, std::memory_order_release);
+    return true;
+}
+
+void BinLog::close() {
+    if (!is_open()) return;
+    opened.store(false, std::memory_order_relaxed);
+    running = false;
+    writer.join();
+    flush();
+    fclose(file);
+    file = nullptr;
+}
+
+size_t BinLog::flush() {
+    std::vector<std::shared_ptr<Ring>> _rings;
+    {
+        std::lock_guard<std::mutex> _(lock);
+        for (; nformats_written < formats.size(); nformats_written++)
+        {
+            const auto &fmt = formats[nformats_written];
+            uint32_t id = nformats_written;
+            uint16_t len = std::min<size_t>(fmt.size(), UINT16_MAX);
+            fputc('F', file);
+            fwrite(&id, sizeof(id), 1, file);
+            fwrite(&len, sizeof(len), 1, file);
+            fwrite(fmt.data(), 1, len, file);
+        }
+        _rings = rings;
+    }
+    size_t cnt = 0;
+    std::vector<std::shared_ptr<Ring>> drained;
+    for (auto &r: _rings)
+    {
+        /* read before head, so that no record can follow the release */
+        bool released = r->released.load(std::memory_order_acquire);
+        uint64_t t = r->tail.load(std::memory_order_relaxed);
+        uint64_t h = r->head.load(std::memory_order_acquire);
+        for (; t < h; t++, cnt++)
+        {
+            fputc('R', file);
+            fwrite(&r->records[t % ring_capacity], BinLogRecord::size, 1, file);
+        }
+        r->tail.store(t, std::memory_order_release);
+        if (released) drained.push_back(r);
+    }
+    if (!drained.empty())
+    {
+        std::lock_guard<std::mutex> _(lock);
+        for (auto &r: drained)
+        {
+            rings.erase(std::find(rings.begin(), rings.end(), r));
+            free_rings.push_back(std::move(r));
+        }
+    }
+    return cnt;
+}
+
+void BinLog::writer_loop() {
+    while (running)
+        if (!flush())
+        {
+            fflush(file);
+            std::this_thread::sleep_for(binlog_idle);
+        }
+}
+
+}
@@ -17,6 +17,10 @@
 namespace e2c {
 
 const opcode_t MsgReqCmd::opcode;
+const opcode_t MsgReqCmdBatch::opcode;
+const opcode_t MsgReqCmdWatch::opcode;
 const opcode_t MsgRespCmd::opcode;
+const opcode_t MsgRespCmdBatch::opcode;
+const opcode_t MsgRespCmdCert::opcode;
 
 }
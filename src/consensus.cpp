@@ -12,11 +12,13 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <stack>
 
 #include "libe2c/util.h"
 #include "libe2c/consensus.h"
+#include "libe2c/trace.h"
 
 namespace e2c {
 
@@ -28,6 +30,13 @@ E2CCore::E2CCore(ReplicaID id, privkey_bt &&priv_key):
         b_comm(b0),
         priv_key(std::move(priv_key)),
         tails{b0},
+        view(0),
+        view_changing(false),
+        blame_qc(nullptr),
+        blamed(nullptr),
+        synced(true),
+        view_start(0),
+        checked_view(0),
         id(id),
         storage(new EntityStorage()) {
     b0->proposer = 1;
@@ -41,6 +50,8 @@ E2CCore::E2CCore(ReplicaID id, privkey_bt &&priv_key):
     storage->add_blk(b0);
 }
 
+E2CCore::~E2CCore() {}
+
 std::vector<block_t> E2CCore::get_parents() {
     // Fetch parents for a new block
     // b_mark is the highest known block
@@ -84,48 +95,129 @@ bool E2CCore::on_deliver_blk(const block_t &blk) {
     return true;
 }
 
+static block_t get_ancestor(block_t blk, uint32_t ht) {
+    while (blk->get_height() > ht)
+        blk = blk->get_parents()[0];
+    return blk;
+}
+
+bool E2CCore::conflicts_committed(const block_t &blk) const {
+    if (blk->height >= b_comm->height)
+        return get_ancestor(blk, b_comm->height)->get_hash() != b_comm->get_hash();
+    return get_ancestor(b_comm, blk->height)->get_hash() != blk->get_hash();
+}
+
+void E2CCore::adopt_chain(const block_t &blk) {
+    std::lock_guard<std::mutex> _(ht_blk_lock);
+    for (auto it = ht_blk_map.begin(); it != ht_blk_map.end();)
+        if (it->first > blk->height) it = ht_blk_map.erase(it);
+        else it++;
+    for (auto b = blk; b->decision != 1; b = b->parents[0])
+    {
+        auto &mblk = ht_blk_map[b->height];
+        if (mblk && mblk->get_hash() == b->get_hash()) break;
+        mblk = b;
+    }
+    b_mark = blk;
+}
+
+bool E2CCore::check_status_proof(const block_t &nblk) {
+    for (auto b = nblk; b->proposer == nblk->proposer && b->decision != 1;
+            b = b->parents[0])
+    {
+        if (b->get_hash() == proven_blk) return true;
+        if (b->extra.empty()) continue;
+        StatusCert cert(this);
+        try {
+            DataStream s(bytearray_t(b->extra));
+            s >> cert;
+        } catch (std::exception &) {
+            continue;
+        }
+        if (cert.view != view ||
+            !cert.is_valid(config.nmajority, config.nreplicas)) continue;
+        /* on the main thread, but only once per view change */
+        for (const auto &st: cert.statuses)
+            if (!st.cert->verify(config.get_pubkey(st.rid))) return false;
+        /* every correct replica has the committed blocks on the chain of its
+         * status, the highest one among n - f extends them all */
+        auto parent = b->parents[0];
+        if (parent->get_hash() != cert.get_highest().blk_hash ||
+            conflicts_committed(parent)) return false;
+        proven_blk = b->get_hash();
+        return true;
+    }
+    return false;
+}
+
 void E2CCore::update(const block_t &nblk) {
     /* Received a new block: nblk
      * We first check if we have already received the parent
      * Then we add it to the commit_queue if it is not already present */
     bool status ;
     uint32_t ht = nblk->get_height();
-    logger.info("Processing block at height: %u", ht);
-    logger.info("Processing block as per map: %u", ht_blk_map.count(ht));
-    if ( (status = (ht_blk_map.count(ht) == 1)) && ht_blk_map[ht]->get_hash() != nblk->get_hash()) {
-        logger.warning("The leader has equivocated." );
-        logger.warning("First Block");
-        logger.warning("[%s]", std::string(*ht_blk_map[ht]).c_str());
-        logger.warning("Parents:");
-        for(auto &phash: ht_blk_map[ht]->parent_hashes) {
-            logger.warning("%s", get_hex10(phash).c_str());
-        }
-        logger.warning("Commands");
-        for(auto &phash: ht_blk_map[ht]->cmds) {
-            logger.warning("%s", get_hex10(phash).c_str());
-        }
-        logger.warning("Extra");
-        for(auto e: ht_blk_map[ht]->extra) {
-            logger.warning("%u", e);
+    E2C_LOG_PROTO("Processing block at height: %u", ht);
+    /* the block conflicts with the one at its height, or with its parent's
+     * height when it is the first one above */
+    block_t oblk = nullptr;
+    if ( (status = (ht_blk_map.count(ht) == 1)) ) {
+        if (ht_blk_map[ht]->get_hash() != nblk->get_hash())
+            oblk = ht_blk_map[ht];
+    } else {
+        auto it = ht_blk_map.find(ht - 1);
+        if (it != ht_blk_map.end() &&
+            it->second->get_hash() != nblk->parents[0]->get_hash())
+            oblk = it->second;
+    }
+    if ( oblk ) {
+        if (oblk->proposer != nblk->proposer) {
+            /* A leader of a later view replaces the blocks left uncommitted
+             * by the earlier ones, only along the chain proven by its
+             * statuses. Any other conflict is from a faulty leader. */
+            std::lock_guard<std::mutex> _(commit_lock);
+            if (oblk->decision == 1 || !check_status_proof(nblk))
+            {
+                E2C_LOG_WARN("Dropped block %s conflicting with %s at height %u",
+                            get_hex10(nblk->get_hash()).c_str(),
+                            get_hex10(oblk->get_hash()).c_str(), oblk->height);
+                return;
+            }
+            E2C_LOG_INFO("Block at height %u superseded by %s", oblk->height,
+                        get_hex10(nblk->get_hash()).c_str());
+            adopt_chain(nblk);
+            do_set_commit_timer(nblk, 2*this->get_delta());
+            return;
         }
-        logger.warning("Second Block");
-        logger.warning("[%s]", std::string(*nblk).c_str());
-        logger.warning("Parents:");
-        for(auto &phash: nblk->parent_hashes) {
-            logger.warning("%s", get_hex10(phash).c_str());
+        /* the same leader on another parent, not provable at one height */
+        if (oblk->height != ht)
+        {
+            E2C_LOG_WARN("Dropped block %s not extending %s",
+                        get_hex10(nblk->get_hash()).c_str(),
+                        get_hex10(oblk->get_hash()).c_str());
+            return;
         }
-        logger.warning("Commands");
-        for(auto &phash: nblk->cmds) {
-            logger.warning("%s", get_hex10(phash).c_str());
+        E2C_LOG_WARN("The leader has equivocated at height %u: %s and %s", ht,
+                    get_hex10(ht_blk_map[ht]->get_hash()).c_str(),
+                    get_hex10(nblk->get_hash()).c_str());
+#ifdef E2C_DEBUG
+        for (const auto &blk: {ht_blk_map[ht], nblk})
+        {
+            E2C_LOG_DEBUG("[%s]", std::string(*blk).c_str());
+            for (auto &phash: blk->parent_hashes)
+                E2C_LOG_DEBUG("parent %s", get_hex10(phash).c_str());
+            for (auto &cmd: blk->cmds)
+                E2C_LOG_DEBUG("cmd %s", get_hex10(cmd).c_str());
+            E2C_LOG_DEBUG("extra %s", get_hex(blk->extra).c_str());
+            E2C_LOG_DEBUG("recomputed hash %s",
+                        get_hex10(blk->header_hash()).c_str());
         }
-        logger.warning("Extra");
-        for(auto e: nblk->extra) {
-            logger.warning("%u", e);
+#endif
+        if (!view_changing)
+        {
+            EquivBlame eb(view, oblk, nblk, this);
+            do_broadcast_equiv_blame(eb);
+            quit_view();
         }
-        uint256_t hash = salticidae::get_hash(*ht_blk_map[ht]);
-        logger.warning("recomputed hash of old block: %s", get_hex10(hash).c_str());
-        hash = salticidae::get_hash(*nblk);
-        logger.warning("recomputed hash of new block: %s", get_hex10(hash).c_str());
         return;
     }
     if ( status ) {
@@ -136,23 +228,38 @@ void E2CCore::update(const block_t &nblk) {
     if ( b_mark->get_height() < ht ) {
         b_mark = nblk ;
     }
-    ht_blk_map [ht] = nblk;
-    logger.info("Creating commit timer for block at height [%u] for time %.3f" , ht , get_delta());
-    nblk->commit_timer = TimerEvent(nblk->commit_ec, [this,ht](TimerEvent &){
-            commit_timer_cb(ht);
+    {
+        std::lock_guard<std::mutex> _(ht_blk_lock);
+        ht_blk_map[ht] = nblk;
+    }
+    E2C_LOG_PROTO("Creating commit timer for block at height [%u] for time %.3f" , ht , get_delta());
+    do_set_commit_timer(nblk, 2*this->get_delta());
+}
+
+void E2CCore::do_set_commit_timer(const block_t &blk, double timeout) {
+    uint32_t ht = blk->get_height();
+    blk->commit_timer = TimerEvent(blk->commit_ec, [this, ht, v = get_view()](TimerEvent &){
+            commit_timer_cb(ht, v);
         });
-    nblk->commit_timer.add(2*this->get_delta());
+    blk->commit_timer.add(timeout);
     // Start timer thread for this block
     // TODO Hopefully this will not overflow
-    nblk->commit_thread = std::thread([nblk,this]() { nblk->commit_ec.dispatch(); });
+    blk->commit_thread = std::thread([blk]() { blk->commit_ec.dispatch(); });
 }
 
 block_t E2CCore::on_propose(const std::vector<uint256_t> &cmds,
                             const std::vector<block_t> &parents,
                             bytearray_t &&extra) {
-    logger.info("Calling propose from Node %u" , get_id());
+    E2C_LOG_PROTO("Calling propose from Node %u" , get_id());
+    auto start = Tracer::now();
     if (parents.empty())
         throw std::runtime_error("empty parents");
+    /* the first block of the view proves the chain it extends */
+    if (!status_proof.empty() && extra.empty())
+    {
+        extra = std::move(status_proof);
+        status_proof.clear();
+    }
     for (const auto &_: parents) tails.erase(_);
     /* create the new block */
     block_t bnew = storage->add_blk(
@@ -160,34 +267,37 @@ block_t E2CCore::on_propose(const std::vector<uint256_t> &cmds,
             std::move(extra),
                   parents[0]->height + 1, get_id())
     );
-    const uint256_t bnew_hash = salticidae::get_hash(*bnew);
-    // logger.info("Computed Hash: %s, Block hash: %s",
-    //             get_hex10(bnew_hash).c_str(), get_hex10(bnew->hash).c_str());
-    bnew->hash = bnew_hash;
+    const uint256_t &bnew_hash = bnew->get_hash();
     bnew->signature = std::move(create_part_cert(*priv_key, bnew_hash));
     on_deliver_blk(bnew);
     update(bnew);
     Proposal prop(bnew, this);
-    logger.info("Node %u proposing block %s", get_id(), std::string(*bnew).c_str());
+    E2C_LOG_PROTO("Node %u proposing block %016lx at height %u with %lu commands",
+                get_id(), trace_id(bnew_hash), bnew->height, bnew->cmds.size());
     /* broadcast to other replicas */
-    logger.info("Broadcasting proposal %s",std::string(prop).c_str());
     do_broadcast_proposal(prop);
+    tracer.span("propose", trace_id(bnew_hash), start, bnew->height);
     /* self-vote */
     on_propose_(prop);
     return bnew;
 }
 
 void E2CCore::on_receive_proposal(const Proposal &prop) {
-    logger.info("Received a proposal from %u", prop.blk->get_proposer());
+    E2C_LOG_PROTO("Received a proposal from %u", prop.blk->get_proposer());
     block_t bnew = prop.blk;
     sanity_check_delivered(bnew);
+    /* The view has been quit, hold the proposals of the next leader until
+     * entering its view */
+    if (view_changing)
+    {
+        early_proposals.push_back(prop);
+        return;
+    }
     /* Forward proposal only if receiving for the first time */
     if ( ht_blk_map.count(bnew->get_height()) == 1 &&
          ht_blk_map[bnew->get_height()]->get_hash() == bnew->get_hash() ) {
-        logger.info("Already handled this proposal. Discarding");
-        logger.info("Existing block at height %u:", bnew->get_height());
-        logger.info("Old Block: %s", std::string(*ht_blk_map[bnew->get_height()]).c_str());
-        logger.info("Incoming Block: %s", std::string(*bnew).c_str());
+        E2C_LOG_DEBUG("Already handled proposal %s. Discarding",
+                    std::string(*bnew).c_str());
         return;
     }
     update(bnew);
@@ -197,35 +307,222 @@ void E2CCore::on_receive_proposal(const Proposal &prop) {
     on_receive_proposal_(prop);
 }
 
+void E2CCore::on_blame_timeout() {
+    if (view_changing) return;
+    /* the replicas enter a view up to \delta apart, the ones still in the
+     * previous view may have dropped the blame */
+    if (blamed)
+    {
+        do_broadcast_blame(*blamed);
+        return;
+    }
+    uint32_t v = view;
+    E2C_LOG_INFO("Blaming the leader of view %u", v);
+    blamed = new Blame(v, id, create_part_cert(*priv_key, Blame::blame_hash(v)), this);
+    do_broadcast_blame(*blamed);
+    on_receive_blame(*blamed);
+}
+
+void E2CCore::on_receive_blame(const Blame &bl) {
+    /* held until entering the next view, once per blamer */
+    if (bl.view == view + 1)
+    {
+        for (const auto &b: early_blames)
+            if (b.blamer == bl.blamer) return;
+        early_blames.push_back(bl);
+        return;
+    }
+    if (bl.view != view || view_changing) return;
+    if (!blamers.insert(bl.blamer).second) return;
+    E2C_LOG_PROTO("Received a blame of view %u from %u", bl.view, bl.blamer);
+    if (!blame_qc)
+        blame_qc = create_quorum_cert(Blame::blame_hash(bl.view));
+    blame_qc->add_part(bl.blamer, *bl.cert);
+    /* n - f blames: at least one from an honest replica, while the honest
+     * replicas alone can always gather them */
+    if (blamers.size() < config.nmajority) return;
+    blame_qc->compute();
+    QuitView qv(bl.view, std::move(blame_qc), this);
+    blame_qc = nullptr;
+    do_broadcast_quit_view(qv);
+    quit_view();
+}
+
+void E2CCore::on_receive_equiv_blame(const EquivBlame &eb) {
+    if (eb.view < view || (eb.view == view && view_changing)) return;
+    if (!eb.is_valid()) return;
+    E2C_LOG_WARN("Received %s", std::string(eb).c_str());
+    view = eb.view;
+    /* forward the proof so that all replicas quit within \delta */
+    do_broadcast_equiv_blame(eb);
+    quit_view();
+}
+
+void E2CCore::on_receive_quit_view(const QuitView &qv) {
+    if (qv.view < view || (qv.view == view && view_changing)) return;
+    if (qv.qc->get_obj_hash() != Blame::blame_hash(qv.view)) return;
+    E2C_LOG_PROTO("Received a quit view of view %u", qv.view);
+    view = qv.view;
+    /* forward the certificate so that all replicas quit within \delta */
+    do_broadcast_quit_view(qv);
+    quit_view();
+}
+
+bool E2CCore::check_stalled(double now, double since) {
+    /* the clock restarts in each view */
+    if (checked_view != view)
+    {
+        checked_view = view;
+        view_start = now;
+    }
+    if (view_changing) return false;
+    return now - std::max(since, view_start) > 4 * delta;
+}
+
+std::unordered_set<uint256_t> E2CCore::get_uncommitted_cmds() {
+    std::unordered_set<uint256_t> cmds;
+    std::lock_guard<std::mutex> _(commit_lock);
+    for (auto b = b_mark; b->decision != 1; b = b->parents[0])
+        cmds.insert(b->cmds.begin(), b->cmds.end());
+    return cmds;
+}
+
+void E2CCore::on_receive_status(const Status &st) {
+    /* held until entering the next view, once per replica */
+    if (st.view == view + 1)
+    {
+        for (const auto &s: early_statuses)
+            if (s.rid == st.rid) return;
+        early_statuses.push_back(st);
+        return;
+    }
+    if (st.view != view || view_changing || synced) return;
+    for (const auto &s: statuses)
+        if (s.rid == st.rid) return;
+    block_t blk = storage->find_blk(st.blk_hash);
+    if (blk == nullptr || !blk->delivered || blk->height != st.height) return;
+    {
+        /* only a faulty replica has a block off the committed chain */
+        std::lock_guard<std::mutex> _(commit_lock);
+        if (conflicts_committed(blk))
+        {
+            E2C_LOG_WARN("Ignored %s off the committed chain",
+                        std::string(st).c_str());
+            return;
+        }
+    }
+    E2C_LOG_PROTO("Received %s", std::string(st).c_str());
+    statuses.push_back(st);
+    if (statuses.size() < config.nmajority) return;
+    StatusCert cert(view, std::move(statuses), this);
+    statuses.clear();
+    block_t hblk = storage->find_blk(cert.get_highest().blk_hash);
+    {
+        std::lock_guard<std::mutex> _(commit_lock);
+        adopt_chain(hblk);
+    }
+    DataStream s;
+    s << cert;
+    status_proof = bytearray_t(std::move(s));
+    synced = true;
+    E2C_LOG_INFO("Leading view %u from block %s at height %u", view.load(),
+                get_hex10(hblk->get_hash()).c_str(), hblk->height);
+    do_view_synced(view);
+}
+
+void E2CCore::quit_view() {
+    /* the pending commit timers of this view will not fire the commits, the
+     * blocks are committed later as the ancestors of the next view's blocks */
+    view_changing = true;
+    uint32_t v = view;
+    E2C_LOG_INFO("Quit view %u", v);
+    on_quit_view_();
+    /* wait for the blocks committed by any honest replica to reach all */
+    do_set_view_timer(v, 2*this->get_delta());
+}
+
+void E2CCore::view_timer_cb(uint32_t v) {
+    if (v != view || !view_changing) return;
+    blamers.clear();
+    blame_qc = nullptr;
+    blamed = nullptr;
+    statuses.clear();
+    status_proof.clear();
+    proven_blk = uint256_t();
+    synced = false;
+    view = v + 1;
+    view_changing = false;
+    E2C_LOG_INFO("Enter view %u", v + 1);
+    do_enter_view(v + 1);
+    /* the leader waits for the statuses before proposing */
+    Status st(v + 1, id, b_mark->get_hash(), b_mark->height,
+            create_part_cert(*priv_key,
+                Status::status_hash(v + 1, b_mark->get_hash(), b_mark->height)),
+            this);
+    do_send_status(st);
+    auto sts = std::move(early_statuses);
+    early_statuses.clear();
+    for (const auto &_st: sts)
+        on_receive_status(_st);
+    auto props = std::move(early_proposals);
+    early_proposals.clear();
+    for (const auto &prop: props)
+        on_receive_proposal(prop);
+    auto bls = std::move(early_blames);
+    early_blames.clear();
+    for (const auto &bl: bls)
+        on_receive_blame(bl);
+}
+
 /*** end E2C protocol logic ***/
 void E2CCore::on_init(uint32_t nfaulty) {
     config.nmajority = config.nreplicas - nfaulty;
+    std::lock_guard<std::mutex> _(ht_blk_lock);
     ht_blk_map[0] = b0;
 }
 
 /* 2\delta has passed. It is safe to commit now */
-void E2CCore::commit_timer_cb(uint32_t ht) {
-    uint32_t idx = ht;
-    logger.info("Commit timer for height %u ended", ht);
-    /* Commit this block and all parents */
-    for (uint32_t i = ht ; ; i--) {
-        auto blk = ht_blk_map[idx];
-        logger.info("Committing Block %s", std::string(*blk).c_str());
-        if ( blk->decision == 1 ) {
-            return ;
-        }
+void E2CCore::commit_timer_cb(uint32_t ht, uint32_t v) {
+    E2C_LOG_PROTO("Commit timer for height %u ended", ht);
+    /* on a commit thread, the main one may replace the uncommitted blocks */
+    std::lock_guard<std::mutex> commit(commit_lock);
+    if (v != view || view_changing) return;
+    block_t top;
+    {
+        std::lock_guard<std::mutex> _(ht_blk_lock);
+        auto it = ht_blk_map.find(ht);
+        /* the height was superseded by the chain of a later leader */
+        if (it == ht_blk_map.end()) return;
+        top = it->second;
+    }
+    /* Commit this block and all its undecided ancestors, oldest first */
+    std::vector<block_t> chain;
+    for (auto blk = top; blk->decision != 1; blk = blk->parents[0])
+        chain.push_back(blk);
+    for (auto it = chain.rbegin(); it != chain.rend(); it++) {
+        auto &blk = *it;
+        auto start = Tracer::now();
+        tracer.end("commit_wait", trace_id(blk->get_hash()), blk->height);
+        E2C_LOG_PROTO("Committing block %016lx at height %u",
+                    trace_id(blk->get_hash()), blk->height);
         // Clean up Heap
         // if ( blk->commit_ec != nullptr )
         //     delete blk->commit_ec ;
         // if ( blk->commit_timer != nullptr )
         blk->commit_timer.del() ;
         blk->decision = 1;
-        do_consensus(blk);
-        /* Execute all statements */
+        b_comm = blk;
+        /* Execute all statements, each with the proof of its inclusion */
+        MerkleTree tree(blk->cmds);
         for (size_t i = 0; i < blk->cmds.size(); i++) {
-            do_decide(Finality(id, 1, i, blk->height,
-                               blk->cmds[i], blk->get_hash()));
+            Finality fin(id, 1, i, blk->height,
+                        blk->cmds[i], blk->get_hash());
+            fin.ncmds = blk->ncmds;
+            fin.cmd_path = tree.get_path(i);
+            do_decide(std::move(fin));
         }
+        do_consensus(blk);
+        tracer.span("decide", trace_id(blk->get_hash()), start, blk->cmds.size());
     }
 }
 
@@ -247,6 +544,18 @@ promise_t E2CCore::async_wait_receive_proposal() {
     });
 }
 
+promise_t E2CCore::async_wait_quit_view() {
+    return quit_view_waiting.then([](uint32_t v) {
+        return v;
+    });
+}
+
+void E2CCore::on_quit_view_() {
+    auto t = std::move(quit_view_waiting);
+    quit_view_waiting = promise_t();
+    t.resolve(view.load());
+}
+
 void E2CCore::on_propose_(const Proposal &prop) {
     auto t = std::move(propose_waiting);
     propose_waiting = promise_t();
@@ -264,8 +573,103 @@ E2CCore::operator std::string () const {
     s << "<E2C "
       << "b_mark=" << get_hex10(b_mark->get_hash()) << " "
       << "b_comm=" << get_hex10(b_comm->get_hash()) << " "
+      << "view=" << std::to_string(view.load()) << " "
       << "tails=" << std::to_string(tails.size()) << ">";
     return s;
 }
 
+static uint64_t read_le64(const uint8_t *p, size_t n) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+CompactProposal::CompactProposal(const Proposal &prop):
+        proposer(prop.blk->get_proposer()),
+        height(prop.blk->get_height()),
+        parent_hashes(prop.blk->get_parent_hashes()),
+        extra(prop.blk->get_extra()),
+        cert(prop.blk->get_signature()->clone()),
+        hsc(prop.hsc) {
+    DataStream s;
+    s << prop.blk->get_hash();
+    salt = read_le64(s.data(), 8);
+    auto key = get_key();
+    for (const auto &cmd: prop.blk->get_cmds())
+        short_ids.push_back(short_id(key, cmd));
+}
+
+std::pair<uint64_t, uint64_t> CompactProposal::get_key() const {
+    DataStream s;
+    s << htole((uint32_t)proposer) << htole(height);
+    for (const auto &h: parent_hashes)
+        s << h;
+    s << htole(salt);
+    DataStream k;
+    k << s.get_hash();
+    return std::make_pair(read_le64(k.data(), 8), read_le64(k.data() + 8, 8));
+}
+
+uint64_t CompactProposal::short_id(const std::pair<uint64_t, uint64_t> &key,
+                                    const uint256_t &cmd_hash) {
+    DataStream s;
+    s << cmd_hash;
+    return siphash24(key.first, key.second, s.data(), s.size()) &
+            ((1ULL << (8 * short_id_size)) - 1);
+}
+
+Block CompactProposal::to_block(std::vector<uint256_t> &&cmds) const {
+    Block blk(std::vector<uint256_t>(parent_hashes), std::move(cmds),
+                bytearray_t(extra), height, proposer);
+    blk.set_signature(cert->clone());
+    return blk;
+}
+
+void CompactProposal::serialize(DataStream &s) const {
+    s << htole((uint32_t)proposer) << htole(height)
+      << htole((uint32_t)parent_hashes.size());
+    for (const auto &h: parent_hashes)
+        s << h;
+    s << htole(salt) << htole((uint32_t)short_ids.size());
+    for (auto id: short_ids)
+    {
+        uint8_t buf[short_id_size];
+        for (size_t i = 0; i < short_id_size; i++)
+            buf[i] = id >> (8 * i);
+        s.put_data(buf, buf + short_id_size);
+    }
+    s << htole((uint32_t)extra.size()) << extra << *cert;
+}
+
+void CompactProposal::unserialize(DataStream &s) {
+    assert(hsc != nullptr);
+    uint32_t n;
+    s >> n;
+    proposer = letoh(n);
+    s >> n;
+    height = letoh(n);
+    s >> n;
+    n = letoh(n);
+    parent_hashes.resize(n);
+    for (auto &h: parent_hashes)
+        s >> h;
+    s >> salt >> n;
+    salt = letoh(salt);
+    n = letoh(n);
+    short_ids.resize(n);
+    for (auto &id: short_ids)
+        id = read_le64(s.get_data_inplace(short_id_size), short_id_size);
+    s >> n;
+    n = letoh(n);
+    if (n == 0)
+        extra.clear();
+    else
+    {
+        auto base = s.get_data_inplace(n);
+        extra = bytearray_t(base, base + n);
+    }
+    cert = hsc->parse_part_cert(s);
+}
+
 }
@@ -20,6 +20,15 @@ namespace e2c {
 secp256k1_context_t secp256k1_default_sign_ctx = new Secp256k1Context(true);
 secp256k1_context_t secp256k1_default_verify_ctx = new Secp256k1Context(false);
 
+/** whether a certificate has a signer out of the configuration, checked
+ * before looking up the keys as rids comes from the wire */
+static bool has_unknown_signer(const salticidae::Bits &rids, const ReplicaConfig &config) {
+    for (size_t i = 0; i < rids.size(); i++)
+        if (rids.get(i) && config.find_pubkey(i) == nullptr)
+            return true;
+    return false;
+}
+
 QuorumCertSecp256k1::QuorumCertSecp256k1(
         const ReplicaConfig &config, const uint256_t &obj_hash):
             QuorumCert(), obj_hash(obj_hash), rids(config.nreplicas) {
@@ -27,7 +36,7 @@ QuorumCertSecp256k1::QuorumCertSecp256k1(
 }
 
 bool QuorumCertSecp256k1::verify(const ReplicaConfig &config) {
-    if (sigs.size() < config.nmajority) return false;
+    if (sigs.size() < config.nmajority || has_unknown_signer(rids, config)) return false;
     for (size_t i = 0; i < rids.size(); i++)
         if (rids.get(i))
         {
@@ -43,8 +52,10 @@ bool QuorumCertSecp256k1::verify(const ReplicaConfig &config) {
 }
 
 promise_t QuorumCertSecp256k1::verify(const ReplicaConfig &config, VeriPool &vpool) {
-    if (sigs.size() < config.nmajority)
+    if (sigs.size() < config.nmajority || has_unknown_signer(rids, config))
         return promise_t([](promise_t &pm) { pm.resolve(false); });
+    /* converted once for all the tasks */
+    const bytearray_t msg = obj_hash;
     std::vector<promise_t> vpm;
     for (size_t i = 0; i < rids.size(); i++)
         if (rids.get(i))
@@ -52,9 +63,8 @@ promise_t QuorumCertSecp256k1::verify(const ReplicaConfig &config, VeriPool &vpo
             // TODO Logging
             //             HOTSTUFF_LOG_DEBUG("checking cert(%d), obj_hash=%s",
             //                     i, get_hex10(obj_hash).c_str());
-            vpm.push_back(vpool.verify(new Secp256k1VeriTask(obj_hash,
-                            static_cast<const PubKeySecp256k1 &>(config.get_pubkey(i)),
-                            sigs[i])));
+            vpm.push_back(vpool.verify(
+                new Secp256k1ReplicaVeriTask(config, i, &msg[0], sigs[i])));
         }
     return promise::all(vpm).then([](const promise::values_t &values) {
         for (const auto &v: values)
@@ -63,4 +73,112 @@ promise_t QuorumCertSecp256k1::verify(const ReplicaConfig &config, VeriPool &vpo
     });
 }
 
+bool Secp256k1ReplicaVeriTask::verify() {
+    /* runs on a VeriPool worker, where nothing may throw */
+    auto pub_key = config.find_pubkey(rid);
+    return pub_key != nullptr &&
+        SigSecp256k1::verify_raw(sig, msg,
+            static_cast<const PubKeySecp256k1 &>(*pub_key));
+}
+
+void PubKeyEd25519::load() {
+    auto pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, data, nbytes);
+    if (pkey == nullptr)
+        throw std::invalid_argument("ill-formed public key");
+    key = new EVPKey(pkey);
+}
+
+PubKeyEd25519::PubKeyEd25519(const PrivKeyEd25519 &priv_key): PubKey() {
+    size_t len = nbytes;
+    if (!EVP_PKEY_get_raw_public_key(priv_key.key->get(), data, &len) ||
+        len != nbytes)
+        throw std::runtime_error("cannot derive the public key");
+    load();
+}
+
+void PrivKeyEd25519::load() {
+    auto pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, data, nbytes);
+    if (pkey == nullptr)
+        throw std::invalid_argument("ill-formed private key");
+    key = new EVPKey(pkey);
+}
+
+void SigEd25519::sign(const bytearray_t &msg, const PrivKeyEd25519 &priv_key) {
+    check_msg_length(msg);
+    size_t len = nbytes;
+    auto ctx = EVP_MD_CTX_new();
+    /* Ed25519 is a one-shot scheme, so there is no message digest */
+    bool ok = ctx &&
+        EVP_DigestSignInit(ctx, nullptr, nullptr, nullptr, priv_key.key->get()) == 1 &&
+        EVP_DigestSign(ctx, data, &len, &msg[0], msg.size()) == 1 &&
+        len == nbytes;
+    EVP_MD_CTX_free(ctx);
+    if (!ok) throw std::runtime_error("failed to create signature");
+}
+
+bool SigEd25519::verify(const bytearray_t &msg, const PubKeyEd25519 &pub_key,
+                        EVP_MD_CTX *ctx) const {
+    check_msg_length(msg);
+    EVP_MD_CTX_reset(ctx);
+    return EVP_DigestVerifyInit(ctx, nullptr, nullptr, nullptr, pub_key.key->get()) == 1 &&
+        EVP_DigestVerify(ctx, data, nbytes, &msg[0], msg.size()) == 1;
+}
+
+bool SigEd25519::verify(const bytearray_t &msg, const PubKeyEd25519 &pub_key) const {
+    auto ctx = EVP_MD_CTX_new();
+    if (ctx == nullptr) return false;
+    bool ok = verify(msg, pub_key, ctx);
+    EVP_MD_CTX_free(ctx);
+    return ok;
+}
+
+QuorumCertEd25519::QuorumCertEd25519(
+        const ReplicaConfig &config, const uint256_t &obj_hash):
+            QuorumCert(), obj_hash(obj_hash), rids(config.nreplicas) {
+    rids.clear();
+}
+
+bool QuorumCertEd25519::verify(const ReplicaConfig &config) {
+    if (sigs.size() < config.nmajority || has_unknown_signer(rids, config)) return false;
+    /* OpenSSL has no batch equation for Ed25519, the signatures are checked
+     * one by one with a shared digest context */
+    auto ctx = EVP_MD_CTX_new();
+    if (ctx == nullptr) return false;
+    const bytearray_t msg = obj_hash;
+    bool ok = true;
+    for (size_t i = 0; ok && i < rids.size(); i++)
+        if (rids.get(i))
+            ok = sigs[i].verify(msg,
+                    static_cast<const PubKeyEd25519 &>(config.get_pubkey(i)), ctx);
+    EVP_MD_CTX_free(ctx);
+    return ok;
+}
+
+promise_t QuorumCertEd25519::verify(const ReplicaConfig &config, VeriPool &vpool) {
+    if (sigs.size() < config.nmajority || has_unknown_signer(rids, config))
+        return promise_t([](promise_t &pm) { pm.resolve(false); });
+    /* one task per signature, spread over the pool workers */
+    std::vector<promise_t> vpm;
+    for (size_t i = 0; i < rids.size(); i++)
+        if (rids.get(i))
+            vpm.push_back(vpool.verify(new Ed25519VeriTask(obj_hash,
+                    static_cast<const PubKeyEd25519 &>(config.get_pubkey(i)),
+                    sigs[i])));
+    return promise::all(vpm).then([](const promise::values_t &values) {
+        for (const auto &v: values)
+            if (!promise::any_cast<bool>(v)) return false;
+        return true;
+    });
+}
+
+crypto_suite_bt create_crypto_suite(const std::string &algo) {
+    if (algo == "secp256k1")
+        return new CryptoSuiteImpl<PrivKeySecp256k1, PubKeySecp256k1,
+                                PartCertSecp256k1, QuorumCertSecp256k1>();
+    if (algo == "ed25519")
+        return new CryptoSuiteImpl<PrivKeyEd25519, PubKeyEd25519,
+                                PartCertEd25519, QuorumCertEd25519>();
+    throw std::invalid_argument("unknown signature scheme " + algo);
+}
+
 }
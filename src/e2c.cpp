@@ -12,6 +12,9 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <random>
+
 #include "libe2c/e2c.h"
 #include "libe2c/client.h"
 #include "libe2c/liveness.h"
@@ -20,13 +23,85 @@ using salticidae::static_pointer_cast;
 
 namespace e2c {
 
+/** the number of heights around commit_height for which the proposal
+ * digests, compact rebuilds, commit votes and seen blocks are kept */
+static const uint32_t prop_seen_window = 64;
+/** the command submissions handled in one event loop turn, before yielding
+ * to the messages of the replicas */
+static const size_t cmd_burst = 64;
+/** the seconds of catch-up budget that can be saved up */
+static const double catchup_burst = 0.1;
+/** the block requests of one replica queued for catch-up, the further ones
+ * are dropped (the replica sends them again on its fetch timeout) */
+static const size_t catchup_peer_limit = 16;
+/** the number of heights a stored batch is kept for below commit_height,
+ * if it is never certified or committed */
+static const uint32_t batch_expiry = 256;
+
+static uint64_t us_since(const std::chrono::steady_clock::time_point &start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
 const opcode_t MsgPropose::opcode;
 MsgPropose::MsgPropose(const Proposal &proposal) {
     serialized << proposal;
 }
 void MsgPropose::postponed_parse(E2CCore *hsc) {
     proposal.hsc = hsc;
+    const uint8_t *base = serialized.data();
+    size_t len = serialized.size();
     serialized >> proposal;
+    proposal.raw = new RawBytes(std::move(serialized), base, len);
+}
+
+const opcode_t MsgProposeCompact::opcode;
+MsgProposeCompact::MsgProposeCompact(const Proposal &proposal) {
+    if (proposal.raw && proposal.compact)
+        serialized.put_data(proposal.raw->begin(), proposal.raw->end());
+    else
+        serialized << CompactProposal(proposal);
+}
+void MsgProposeCompact::postponed_parse(E2CCore *hsc) {
+    cp.hsc = hsc;
+    serialized >> cp;
+}
+
+const opcode_t MsgReqCompactCmds::opcode;
+MsgReqCompactCmds::MsgReqCompactCmds(uint32_t height, const uint256_t &digest,
+                                    const std::vector<uint32_t> &idx) {
+    serialized << htole(height) << digest << htole((uint32_t)idx.size());
+    for (auto i: idx)
+        serialized << htole(i);
+}
+
+MsgReqCompactCmds::MsgReqCompactCmds(DataStream &&s) {
+    uint32_t size;
+    s >> height >> digest >> size;
+    height = letoh(height);
+    size = letoh(size);
+    idx.resize(size);
+    for (auto &i: idx)
+    {
+        s >> i;
+        i = letoh(i);
+    }
+}
+
+const opcode_t MsgRespCompactCmds::opcode;
+MsgRespCompactCmds::MsgRespCompactCmds(const uint256_t &digest,
+                                        const std::vector<uint256_t> &cmds) {
+    serialized << digest << htole((uint32_t)cmds.size());
+    for (const auto &h: cmds)
+        serialized << h;
+}
+
+MsgRespCompactCmds::MsgRespCompactCmds(DataStream &&s) {
+    uint32_t size;
+    s >> digest >> size;
+    size = letoh(size);
+    cmds.resize(size);
+    for (auto &h: cmds) s >> h;
 }
 
 // const opcode_t MsgVote::opcode;
@@ -61,22 +136,178 @@ void MsgRespBlock::postponed_parse(E2CCore *hsc) {
     uint32_t size;
     serialized >> size;
     size = letoh(size);
-    blks.resize(size);
-    for (auto &blk: blks)
+    std::vector<Block> _blks(size);
+    Block::unserialize_batch(serialized, _blks);
+    for (auto &_blk: _blks)
+        blks.push_back(hsc->storage->add_blk(std::move(_blk), hsc->get_config()));
+}
+
+const opcode_t MsgEquivBlame::opcode;
+MsgEquivBlame::MsgEquivBlame(const EquivBlame &bl) { serialized << bl; }
+void MsgEquivBlame::postponed_parse(E2CCore *hsc) {
+    bl.hsc = hsc;
+    serialized >> bl;
+}
+
+const opcode_t MsgBlame::opcode;
+MsgBlame::MsgBlame(const Blame &bl) { serialized << bl; }
+void MsgBlame::postponed_parse(E2CCore *hsc) {
+    bl.hsc = hsc;
+    serialized >> bl;
+}
+
+const opcode_t MsgQuitView::opcode;
+MsgQuitView::MsgQuitView(const QuitView &qv) { serialized << qv; }
+void MsgQuitView::postponed_parse(E2CCore *hsc) {
+    qv.hsc = hsc;
+    serialized >> qv;
+}
+
+const opcode_t MsgFwdCmd::opcode;
+MsgFwdCmd::MsgFwdCmd(const std::vector<uint256_t> &cmd_hashes) {
+    serialized << htole((uint32_t)cmd_hashes.size());
+    for (const auto &h: cmd_hashes)
+        serialized << h;
+}
+
+MsgFwdCmd::MsgFwdCmd(DataStream &&s) {
+    uint32_t size;
+    s >> size;
+    size = letoh(size);
+    cmd_hashes.resize(size);
+    for (auto &h: cmd_hashes) s >> h;
+}
+
+const opcode_t MsgFwdReject::opcode;
+MsgFwdReject::MsgFwdReject(const std::vector<uint256_t> &cmd_hashes) {
+    serialized << htole((uint32_t)cmd_hashes.size());
+    for (const auto &h: cmd_hashes)
+        serialized << h;
+}
+
+MsgFwdReject::MsgFwdReject(DataStream &&s) {
+    uint32_t size;
+    s >> size;
+    size = letoh(size);
+    cmd_hashes.resize(size);
+    for (auto &h: cmd_hashes) s >> h;
+}
+
+const opcode_t MsgBatch::opcode;
+MsgBatch::MsgBatch(const CmdBatch &batch) { serialized << batch; }
+MsgBatch::MsgBatch(DataStream &&s) { s >> batch; }
+
+const opcode_t MsgBatchAck::opcode;
+MsgBatchAck::MsgBatchAck(const BatchAck &ack) { serialized << ack; }
+void MsgBatchAck::postponed_parse(E2CCore *hsc) {
+    ack.hsc = hsc;
+    serialized >> ack;
+}
+
+const opcode_t MsgAvailCert::opcode;
+MsgAvailCert::MsgAvailCert(const AvailCert &ac) { serialized << ac; }
+void MsgAvailCert::postponed_parse(E2CCore *hsc) {
+    ac.hsc = hsc;
+    serialized >> ac;
+}
+
+const opcode_t MsgCommitVote::opcode;
+MsgCommitVote::MsgCommitVote(const CommitVote &vote) { serialized << vote; }
+void MsgCommitVote::postponed_parse(E2CCore *hsc) {
+    vote.hsc = hsc;
+    serialized >> vote;
+}
+
+const opcode_t MsgStatus::opcode;
+MsgStatus::MsgStatus(const Status &st) { serialized << st; }
+void MsgStatus::postponed_parse(E2CCore *hsc) {
+    st.hsc = hsc;
+    serialized >> st;
+}
+
+const opcode_t MsgReqBatch::opcode;
+MsgReqBatch::MsgReqBatch(const std::vector<uint256_t> &batch_hashes) {
+    serialized << htole((uint32_t)batch_hashes.size());
+    for (const auto &h: batch_hashes)
+        serialized << h;
+}
+
+MsgReqBatch::MsgReqBatch(DataStream &&s) {
+    uint32_t size;
+    s >> size;
+    size = letoh(size);
+    batch_hashes.resize(size);
+    for (auto &h: batch_hashes) s >> h;
+}
+
+const opcode_t MsgRespBatch::opcode;
+MsgRespBatch::MsgRespBatch(const std::vector<command_t> &batches) {
+    serialized << htole((uint32_t)batches.size());
+    for (const auto &b: batches) serialized << *b;
+}
+
+MsgRespBatch::MsgRespBatch(DataStream &&s) {
+    uint32_t size;
+    s >> size;
+    size = letoh(size);
+    batches.resize(size);
+    for (auto &b: batches) s >> b;
+}
+
+void E2CBase::exec_command(uint256_t cmd_hash, commit_cb_t callback) {
+    exec_command(std::vector<uint256_t>{cmd_hash}, std::move(callback));
+}
+
+size_t E2CBase::get_cmd_pending() const {
+    return std::max<int64_t>(stats.cmds_queued.get() +
+                            stats.cmds_buffered.get() +
+                            stats.cmds_waiting.get(), 0);
+}
+
+bool E2CBase::admit_cmds(size_t n) {
+    if (!cmd_high_watermark) return true;
+    size_t pending = get_cmd_pending();
+    if (cmd_overloaded.load(std::memory_order_relaxed))
+    {
+        if (pending > cmd_low_watermark)
+        {
+            stats.cmds_rejected.add(n);
+            return false;
+        }
+        cmd_overloaded.store(false, std::memory_order_relaxed);
+        E2C_LOG_INFO("%lu commands pending, accepting again", pending);
+    }
+    if (pending + n > cmd_high_watermark)
     {
-        Block _blk;
-        _blk.unserialize(serialized, hsc);
-        blk = hsc->storage->add_blk(std::move(_blk), hsc->get_config());
+        if (!cmd_overloaded.exchange(true, std::memory_order_relaxed))
+            E2C_LOG_WARN("%lu commands pending, rejecting", pending);
+        stats.cmds_rejected.add(n);
+        return false;
     }
+    return true;
 }
 
-void E2CBase::exec_command(uint256_t cmd_hash, commit_cb_t callback) {
-    cmd_pending.enqueue(std::make_pair(cmd_hash, callback));
+void E2CBase::exec_command(std::vector<uint256_t> &&cmd_hashes,
+                            commit_cb_t callback, bool forward) {
+    if (tracer.is_enabled())
+        for (const auto &cmd_hash: cmd_hashes)
+            tracer.instant("submit", trace_id(cmd_hash), cmd_hashes.size());
+    stats.cmds_queued.add(cmd_hashes.size());
+    cmd_pending.enqueue(CmdSubmission{std::move(cmd_hashes), std::move(callback), forward});
+}
+
+void E2CBase::on_fetch_cmd(const command_t &cmd) {
+    const uint256_t &cmd_hash = cmd->get_hash();
+    auto it = cmd_fetch_waiting.find(cmd_hash);
+    if (it != cmd_fetch_waiting.end())
+    {
+        it->second.resolve(cmd);
+        cmd_fetch_waiting.erase(it);
+    }
 }
 
 void E2CBase::on_fetch_blk(const block_t &blk) {
-    part_fetched++;
-    fetched++;
+    stats.fetched.add();
     const uint256_t &blk_hash = blk->get_hash();
     auto it = blk_fetch_waiting.find(blk_hash);
     if (it != blk_fetch_waiting.end())
@@ -94,9 +325,8 @@ bool E2CBase::on_deliver_blk(const block_t &blk) {
         assert(storage->is_blk_delivered(p));
     if ((valid = E2CCore::on_deliver_blk(blk)))
     {
-        part_parent_size += blk->get_parent_hashes().size();
-        part_delivered++;
-        delivered++;
+        stats.parent_size.add(blk->get_parent_hashes().size());
+        stats.delivered.add();
     }
 
     bool res = true;
@@ -106,11 +336,9 @@ bool E2CBase::on_deliver_blk(const block_t &blk) {
         auto &pm = it->second;
         if (valid)
         {
+            tracer.end("deliver", trace_id(blk_hash), blk->get_height());
             pm.elapsed.stop(false);
-            auto sec = pm.elapsed.elapsed_sec;
-            part_delivery_time += sec;
-            part_delivery_time_min = std::min(part_delivery_time_min, sec);
-            part_delivery_time_max = std::max(part_delivery_time_max, sec);
+            stats.delivery_time.observe(pm.elapsed.elapsed_sec * 1e6);
 
             pm.resolve(blk);
         }
@@ -124,6 +352,26 @@ bool E2CBase::on_deliver_blk(const block_t &blk) {
     return res;
 }
 
+promise_t E2CBase::async_fetch_cmd(const uint256_t &cmd_hash,
+                                        const PeerId *replica,
+                                        bool fetch_now) {
+    if (storage->is_cmd_fetched(cmd_hash))
+        return promise_t([this, &cmd_hash](promise_t pm){
+            pm.resolve(storage->find_cmd(cmd_hash));
+        });
+    auto it = cmd_fetch_waiting.find(cmd_hash);
+    if (it == cmd_fetch_waiting.end())
+    {
+        it = cmd_fetch_waiting.insert(
+            std::make_pair(
+                cmd_hash,
+                CmdFetchContext(cmd_hash, this))).first;
+    }
+    if (replica != nullptr)
+        it->second.add_replica(*replica, fetch_now);
+    return static_cast<promise_t &>(it->second);
+}
+
 promise_t E2CBase::async_fetch_blk(const uint256_t &blk_hash,
                                         const PeerId *replica,
                                         bool fetch_now) {
@@ -154,18 +402,33 @@ promise_t E2CBase::async_deliver_blk(const uint256_t &blk_hash,
     if (it != blk_delivery_waiting.end())
         return static_cast<promise_t &>(it->second);
     BlockDeliveryContext pm{[](promise_t){}};
+    tracer.begin("deliver", trace_id(blk_hash));
     it = blk_delivery_waiting.insert(std::make_pair(blk_hash, pm)).first;
     /* otherwise the on_deliver_batch will resolve */
     async_fetch_blk(blk_hash, &replica).then([this, replica](block_t blk) {
         /* qc_ref should be fetched */
         std::vector<promise_t> pms;
-        if (blk == get_genesis())
+        if (blk == get_genesis() || blk->is_verified())
             pms.push_back(promise_t([](promise_t &pm){ pm.resolve(true); }));
         else
-            pms.push_back(blk->verify(this, vpool));
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto tid = trace_id(blk->get_hash());
+            tracer.begin("verify", tid);
+            pms.push_back(blk->verify(this, vpool).then([this, start, tid](bool valid) {
+                tracer.end("verify", tid, valid);
+                stats.verify_time.observe(us_since(start));
+                return valid;
+            }));
+        }
         /* the parents should be delivered */
         for (const auto &phash: blk->get_parent_hashes())
             pms.push_back(async_deliver_blk(phash, replica));
+        /* with the mempool on, the commands of a block are batches that have
+         * to be stored before the block is committed */
+        if (mempool_batch)
+            for (const auto &cmd_hash: blk->get_cmds())
+                pms.push_back(async_fetch_cmd(cmd_hash, &replica));
         promise::all(pms).then([this, blk](const promise::values_t values) {
             auto ret = promise::any_cast<bool>(values[0]) && this->on_deliver_blk(blk);
             if (!ret) {}
@@ -174,56 +437,742 @@ promise_t E2CBase::async_deliver_blk(const uint256_t &blk_hash,
     return static_cast<promise_t &>(pm);
 }
 
+ProposalFilter::ProposalFilter() {
+    std::random_device rd;
+    key.first = (uint64_t(rd()) << 32) | rd();
+    key.second = (uint64_t(rd()) << 32) | rd();
+}
+
+bool ProposalFilter::admit(uint64_t digest, uint32_t commit_height) {
+    std::lock_guard<std::mutex> _(lock);
+    if (seen.count(digest)) return false;
+    return verifying.insert(std::make_pair(digest, commit_height)).second;
+}
+
+void ProposalFilter::checked(uint64_t digest, bool valid, uint32_t height) {
+    std::lock_guard<std::mutex> _(lock);
+    verifying.erase(digest);
+    /* an invalid copy is not recorded, in case a valid one follows */
+    if (valid && seen.insert(digest).second)
+        seen_heights[height].push_back(digest);
+}
+
+void ProposalFilter::prune(uint32_t height) {
+    std::lock_guard<std::mutex> _(lock);
+    auto end = seen_heights.lower_bound(height);
+    for (auto it = seen_heights.begin(); it != end; it++)
+        for (auto d: it->second) seen.erase(d);
+    seen_heights.erase(seen_heights.begin(), end);
+    for (auto it = verifying.begin(); it != verifying.end();)
+        if (it->second < height)
+            it = verifying.erase(it);
+        else
+            it++;
+}
+
+bool IngestTask::verify() {
+    auto start = Tracer::now();
+    try {
+        if (filter)
+        {
+            const uint8_t *base = s.data();
+            size_t len = s.size();
+            /* drop the copies of a proposal before parsing */
+            res->digest = filter->digest(base, len);
+            if (!filter->admit(res->digest, commit_height))
+            {
+                res->dup = true;
+                return false;
+            }
+            Block blk;
+            blk.unserialize(s, hsc);
+            blk.set_signature(hsc->parse_part_cert(s));
+            auto &sig = blk.get_signature();
+            if (sig->get_obj_hash() != blk.get_hash() ||
+                !sig->verify(hsc->get_config().get_pubkey(blk.get_proposer())))
+                return false;
+            blk.set_verified();
+            tracer.span("parse_propose", trace_id(blk.get_hash()), start, len);
+            res->blks.push_back(std::move(blk));
+            res->raw = new RawBytes(std::move(s), base, len);
+        }
+        else
+        {
+            uint32_t size;
+            s >> size;
+            size = letoh(size);
+            res->blks.resize(size);
+            Block::unserialize_batch(s, res->blks);
+        }
+    } catch (std::exception &) {
+        return false;
+    }
+    return true;
+}
+
+void E2CBase::ingest(DataStream &&s, const PeerId &peer, bool is_proposal) {
+    IngestTask::result_t res = new IngestTask::Result();
+    uint64_t seq = ingest_base + ingest_queue.size();
+    ingest_queue.push_back(Ingest{res, peer, is_proposal, false, false});
+    auto start = std::chrono::steady_clock::now();
+    vpool.verify(new IngestTask(this, std::move(s),
+                                is_proposal ? &prop_filter : nullptr,
+                                commit_height.load(std::memory_order_relaxed), res)).then(
+            [this, seq, start, is_proposal](bool valid) {
+        if (is_proposal) stats.verify_time.observe(us_since(start));
+        auto &in = ingest_queue[seq - ingest_base];
+        in.done = true;
+        in.valid = valid;
+        /* workers finish out of order, keep the order of arrival */
+        while (!ingest_queue.empty() && ingest_queue.front().done)
+        {
+            Ingest _in = std::move(ingest_queue.front());
+            ingest_queue.pop_front();
+            ingest_base++;
+            on_ingested(std::move(_in));
+        }
+    });
+}
+
+void E2CBase::on_ingested(Ingest &&in) {
+    auto &blks = in.res->blks;
+    if (in.res->dup)
+    {
+        stats.dup_proposals.add();
+        return;
+    }
+    if (in.is_proposal)
+        on_proposal_checked(in.res->digest, in.valid,
+                            in.valid ? blks[0].get_height() : 0);
+    if (!in.valid)
+    {
+        E2C_LOG_WARN("dropped an invalid %s",
+                    in.is_proposal ? "proposal" : "block response");
+        return;
+    }
+    if (!in.is_proposal)
+    {
+        for (auto &_blk: blks)
+            on_fetch_blk(storage->add_blk(std::move(_blk), get_config()));
+        return;
+    }
+    on_proposal_verified(storage->add_blk(std::move(blks[0]), get_config()),
+                        std::move(in.res->raw), false, in.peer);
+}
+
+void E2CBase::on_proposal_verified(block_t blk, raw_bytes_t &&raw, bool compact,
+                                    const PeerId &peer) {
+    /* the block may have been fetched before, unsigned */
+    blk->set_verified();
+    Proposal prop(blk, this);
+    prop.raw = std::move(raw);
+    prop.compact = compact;
+    async_deliver_blk(blk->get_hash(), peer).then([this, prop = std::move(prop)]() {
+        on_receive_proposal(prop);
+    });
+}
+
+bool E2CBase::check_proposer(DataStream &s) {
+    /* the rest is parsed and verified later */
+    if (s.size() < 8) return false;
+    uint32_t proposer;
+    memmove(&proposer, s.data(), sizeof(proposer));
+    proposer = letoh(proposer);
+    // Ensure the correct proposer is proposing
+    if (proposer != get_pace_maker()->get_proposer()) {
+        E2C_LOG_WARN("Received a block from rid: %u, expected from rid: %u" ,
+                       proposer, get_pace_maker()->get_proposer());
+        return false;
+    }
+    return true;
+}
+
+void E2CBase::on_proposal_checked(uint64_t digest, bool valid, uint32_t height) {
+    /* forget the proposals well below the committed blocks, and the ones
+     * stuck in verification since */
+    uint32_t ht = commit_height.load(std::memory_order_relaxed);
+    if (ht > prop_seen_window)
+        prop_filter.prune(ht - prop_seen_window);
+    prop_filter.checked(digest, valid && near_commit_height(height), height);
+}
+
 void E2CBase::propose_handler(MsgPropose &&msg, const Net::conn_t &conn) {
     const PeerId &peer = conn->get_peer_id();
     if (peer.is_null()) return;
-    msg.postponed_parse(this);
-    auto &prop = msg.proposal;
-    block_t blk = prop.blk;
-    if(blk->get_height() == 0) {
+    stats.propose_size.observe(msg.serialized.size());
+    /* filtered, parsed and verified by the vpool workers */
+    if (check_proposer(msg.serialized))
+        ingest(std::move(msg.serialized), peer, true);
+}
+
+void E2CBase::propose_compact_handler(MsgProposeCompact &&msg, const Net::conn_t &conn) {
+    const PeerId &peer = conn->get_peer_id();
+    if (peer.is_null()) return;
+    stats.propose_size.observe(msg.serialized.size());
+    if (!check_proposer(msg.serialized)) return;
+    /* a compact proposal is small, filter its copies here */
+    uint64_t seen_digest = prop_filter.digest(msg.serialized.data(), msg.serialized.size());
+    if (!prop_filter.admit(seen_digest, commit_height.load(std::memory_order_relaxed)))
+    {
+        stats.dup_proposals.add();
         return;
     }
-    // Ensure the correct proposer is proposing
-    if(blk->get_proposer() != get_pace_maker()->get_proposer()) {
-        logger.warning("Received a block from rid: %u, expected from rid: %u" ,
-                       blk->get_proposer(), get_pace_maker()->get_proposer());
-        logger.warning("Incoming Block: %s", std::string(*blk).c_str());
-        return ;
+    /* the commands are requested by the digest of the message */
+    const uint256_t digest = msg.serialized.get_hash();
+    const uint8_t *base = msg.serialized.data();
+    size_t len = msg.serialized.size();
+    try {
+        msg.postponed_parse(this);
+    } catch (std::exception &) {
+        on_proposal_checked(seen_digest, false);
+        return;
     }
-    if (!blk) return;
-    promise::all(std::vector<promise_t>{
-        async_deliver_blk(blk->get_hash(), peer)
-    }).then([this, prop = std::move(prop)]() {
-        on_receive_proposal(prop);
+    CompactRebuild rb{std::move(msg.cp), {}, {},
+                    new RawBytes(std::move(msg.serialized), base, len), peer, false,
+                    seen_digest};
+    /* look the short ids up among the batches not committed yet */
+    auto key = rb.cp.get_key();
+    std::unordered_map<uint64_t, uint256_t> ids;
+    std::unordered_set<uint64_t> collided;
+    {
+        std::lock_guard<std::mutex> _(batch_lock);
+        for (const auto &b: batch_cmds)
+        {
+            uint64_t id = CompactProposal::short_id(key, b.first);
+            if (!ids.insert(std::make_pair(id, b.first)).second)
+                collided.insert(id);
+        }
+    }
+    const auto &short_ids = rb.cp.short_ids;
+    rb.cmds.resize(short_ids.size());
+    for (uint32_t i = 0; i < short_ids.size(); i++)
+    {
+        auto it = ids.find(short_ids[i]);
+        if (it == ids.end() || collided.count(short_ids[i]))
+            rb.missing.push_back(i);
+        else
+            rb.cmds[i] = it->second;
+    }
+    if (rb.missing.empty())
+    {
+        on_compact_rebuilt(digest, std::move(rb));
+        return;
+    }
+    /* the height is not verified yet, keep the rebuilds near the committed
+     * blocks only and forget the stuck ones */
+    if (!near_commit_height(rb.cp.height))
+    {
+        on_proposal_checked(seen_digest, false);
+        return;
+    }
+    for (auto it = compact_waiting.begin(); it != compact_waiting.end();)
+        if (!near_commit_height(it->second.cp.height))
+        {
+            on_proposal_checked(it->second.seen_digest, false);
+            it = compact_waiting.erase(it);
+        }
+        else
+            it++;
+    stats.compact_missed.add(rb.missing.size());
+    pn.send_msg(MsgReqCompactCmds(rb.cp.height, digest, rb.missing), peer);
+    compact_waiting.insert(std::make_pair(digest, std::move(rb)));
+}
+
+void E2CBase::on_compact_rebuilt(const uint256_t &digest, CompactRebuild &&rb) {
+    block_t blk = new Block(rb.cp.to_block(std::move(rb.cmds)));
+    auto &sig = blk->get_signature();
+    if (sig->get_obj_hash() != blk->get_hash())
+    {
+        /* a short id matched another batch, fall back to all the commands */
+        if (rb.full)
+        {
+            on_proposal_checked(rb.seen_digest, false);
+            return;
+        }
+        rb.full = true;
+        rb.missing.clear();
+        for (uint32_t i = 0; i < rb.cp.short_ids.size(); i++)
+            rb.missing.push_back(i);
+        rb.cmds.clear();
+        rb.cmds.resize(rb.missing.size());
+        pn.send_msg(MsgReqCompactCmds(rb.cp.height, digest, rb.missing), rb.peer);
+        compact_waiting.insert(std::make_pair(digest, std::move(rb)));
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    sig->verify(get_config().get_pubkey(blk->get_proposer()), vpool).then(
+            [this, blk, raw = std::move(rb.raw), peer = rb.peer, start,
+            seen_digest = rb.seen_digest](bool valid) mutable {
+        stats.verify_time.observe(us_since(start));
+        on_proposal_checked(seen_digest, valid, blk->get_height());
+        if (!valid)
+        {
+            E2C_LOG_WARN("dropped an invalid compact proposal");
+            return;
+        }
+        on_proposal_verified(storage->add_blk(blk), std::move(raw), true, peer);
     });
 }
 
-    void E2CBase::do_consensus(const block_t &blk) {
-        pmaker->on_consensus(blk);
+void E2CBase::req_compact_handler(MsgReqCompactCmds &&msg, const Net::conn_t &conn) {
+    const PeerId replica = conn->get_peer_id();
+    if (replica.is_null()) return;
+    auto it = compact_sent.find(msg.height);
+    if (it == compact_sent.end()) return;
+    for (const auto &p: it->second)
+    {
+        if (p.first != msg.digest) continue;
+        const auto &cmds = p.second->get_cmds();
+        std::vector<uint256_t> resp;
+        for (auto i: msg.idx)
+        {
+            if (i >= cmds.size()) return;
+            resp.push_back(cmds[i]);
+        }
+        pn.send_msg(MsgRespCompactCmds(msg.digest, resp), replica);
+        return;
+    }
+}
+
+void E2CBase::resp_compact_handler(MsgRespCompactCmds &&msg, const Net::conn_t &conn) {
+    auto it = compact_waiting.find(msg.digest);
+    if (it == compact_waiting.end() || it->second.peer != conn->get_peer_id()) return;
+    auto &rb = it->second;
+    if (msg.cmds.size() != rb.missing.size()) return;
+    for (size_t i = 0; i < msg.cmds.size(); i++)
+        rb.cmds[rb.missing[i]] = msg.cmds[i];
+    CompactRebuild _rb = std::move(rb);
+    compact_waiting.erase(it);
+    on_compact_rebuilt(msg.digest, std::move(_rb));
+}
+
+void E2CBase::do_set_commit_timer(const block_t &blk, double timeout) {
+    {
+        std::lock_guard<std::mutex> _(blk_seen_lock);
+        if (blk_seen.insert(std::make_pair(blk->get_hash(),
+                                        std::chrono::steady_clock::now())).second)
+            blk_seen_heights[blk->get_height()].push_back(blk->get_hash());
+    }
+    tracer.begin("commit_wait", trace_id(blk->get_hash()), blk->get_height());
+    E2CCore::do_set_commit_timer(blk, timeout);
+}
+
+void E2CBase::do_consensus(const block_t &blk) {
+    uint32_t ht = blk->get_height();
+    uint32_t cur = commit_height.load(std::memory_order_relaxed);
+    while (ht > cur && !commit_height.compare_exchange_weak(cur, ht))
+        ;
+    {
+        std::lock_guard<std::mutex> _(blk_seen_lock);
+        auto it = blk_seen.find(blk->get_hash());
+        if (it != blk_seen.end())
+        {
+            stats.commit_latency.observe(us_since(it->second));
+            blk_seen.erase(it);
+        }
+        /* the blocks well below the committed ones are abandoned */
+        uint32_t committed = std::max(ht, cur);
+        if (committed > prop_seen_window)
+        {
+            auto end = blk_seen_heights.lower_bound(committed - prop_seen_window);
+            for (auto h = blk_seen_heights.begin(); h != end; h++)
+                for (const auto &blk_hash: h->second)
+                    blk_seen.erase(blk_hash);
+            blk_seen_heights.erase(blk_seen_heights.begin(), end);
+        }
     }
+    pmaker->on_consensus(blk);
+    state_machine_commit(blk);
+    if (commit_cert)
+        tcall.async_call([this, blk](ThreadCall::Handle &) { on_local_commit(blk); });
+}
 
 void E2CBase::req_blk_handler(MsgReqBlock &&msg, const Net::conn_t &conn) {
     const PeerId replica = conn->get_peer_id();
     if (replica.is_null()) return;
-    auto &blk_hashes = msg.blk_hashes;
+    /* a replica cannot grow the queue without bound */
+    size_t &pending = catchup_pending[replica];
+    if (pending >= catchup_peer_limit)
+    {
+        stats.catchup_dropped.add();
+        return;
+    }
+    pending++;
+    /* serving the blocks must not hold up the proposals */
+    catchup_queue.push_back(BlockRequest{replica, std::move(msg.blk_hashes),
+                                        std::chrono::steady_clock::now()});
+    if (!catchup_scheduled) schedule_catchup(0);
+}
+
+void E2CBase::set_catchup_rate(double rate) {
+    catchup_rate = rate;
+    catchup_tokens = rate * catchup_burst;
+    catchup_refill = std::chrono::steady_clock::now();
+}
+
+void E2CBase::schedule_catchup(double delay) {
+    catchup_scheduled = true;
+    catchup_timer.del();
+    catchup_timer.add(delay);
+}
+
+void E2CBase::serve_catchup() {
+    catchup_scheduled = false;
+    if (catchup_queue.empty()) return;
+    if (catchup_rate > 0)
+    {
+        auto now = std::chrono::steady_clock::now();
+        catchup_tokens = std::min(catchup_tokens + catchup_rate *
+                std::chrono::duration<double>(now - catchup_refill).count(),
+                catchup_rate * catchup_burst);
+        catchup_refill = now;
+        /* the last response overdrew the budget */
+        if (catchup_tokens < 0)
+        {
+            schedule_catchup(-catchup_tokens / catchup_rate);
+            return;
+        }
+    }
+    BlockRequest req = std::move(catchup_queue.front());
+    catchup_queue.pop_front();
+    auto it = catchup_pending.find(req.replica);
+    if (--it->second == 0) catchup_pending.erase(it);
+    stats.catchup_wait.observe(us_since(req.arrival));
     std::vector<promise_t> pms;
-    for (const auto &h: blk_hashes)
+    for (const auto &h: req.blk_hashes)
         pms.push_back(async_fetch_blk(h, nullptr));
-    promise::all(pms).then([replica, this](const promise::values_t values) {
+    promise::all(pms).then([replica = req.replica, this](const promise::values_t values) {
         std::vector<block_t> blks;
         for (auto &v: values)
         {
             auto blk = promise::any_cast<block_t>(v);
             blks.push_back(blk);
         }
-        pn.send_msg(MsgRespBlock(blks), replica);
+        MsgRespBlock resp(blks);
+        catchup_tokens -= resp.serialized.size();
+        stats.catchup_sent.add(resp.serialized.size());
+        pn.send_msg(resp, replica);
     });
+    /* the next one after the messages received meanwhile */
+    if (!catchup_queue.empty()) schedule_catchup(0);
 }
 
 void E2CBase::resp_blk_handler(MsgRespBlock &&msg, const Net::conn_t &) {
+    stats.resp_blk_size.observe(msg.serialized.size());
+    ingest(std::move(msg.serialized), PeerId(), false);
+}
+
+void E2CBase::fwd_cmd_handler(MsgFwdCmd &&msg, const Net::conn_t &conn) {
+    const PeerId peer = conn->get_peer_id();
+    if (peer.is_null()) return;
+    /* the proposer is overloaded: hand the commands back, the forwarding
+     * replica tells its clients to back off */
+    if (!admit_cmds(msg.cmd_hashes.size()))
+    {
+        pn.send_msg(MsgFwdReject(msg.cmd_hashes), peer);
+        return;
+    }
+    /* the forwarding replica replies to the client, never forward again */
+    exec_command(std::move(msg.cmd_hashes), nullptr);
+}
+
+void E2CBase::fwd_reject_handler(MsgFwdReject &&msg, const Net::conn_t &conn) {
+    /* only the proposer the commands were forwarded to may reject them */
+    if (conn->get_peer_id().is_null() ||
+        conn->get_peer_id() != get_config().get_peer_id(pmaker->get_proposer()))
+        return;
+    for (const auto &cmd_hash: msg.cmd_hashes)
+    {
+        commit_cb_t callback;
+        {
+            std::lock_guard<std::mutex> _(decision_lock);
+            auto it = decision_waiting.find(cmd_hash);
+            if (it == decision_waiting.end() || !it->second.forward) continue;
+            callback = std::move(it->second.callback);
+            decision_waiting.erase(it);
+        }
+        stats.cmds_waiting.add(-1);
+        callback(Finality(id, -1, 0, 0, cmd_hash, uint256_t()));
+    }
+}
+
+void E2CBase::disseminate_batch() {
+    mempool_timer.del();
+    auto batch = new CmdBatch(get_id(), batch_seq++, std::move(mempool_buffer));
+    command_t cmd = batch;
+    mempool_buffer.clear();
+    const uint256_t batch_hash = batch->get_hash();
+    batch_acks.insert(std::make_pair(batch_hash, AvailCert(batch_hash, this)));
+    pn.multicast_msg(MsgBatch(*batch), peers);
+    stats.mempool_batches.add();
+    on_store_batch(cmd);
+    on_batch_ack(BatchAck(get_id(), batch_hash,
+                        sign(AvailCert::ack_hash(batch_hash)), this));
+}
+
+void E2CBase::on_store_batch(const command_t &cmd) {
+    if (storage->is_cmd_fetched(cmd->get_hash())) return;
+    {
+        uint32_t ht = commit_height.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> _(batch_lock);
+        /* expire the batches never committed, the committed ones are
+         * erased already; a batch proposed later is fetched again */
+        while (!batch_order.empty() &&
+                batch_order.front().second + batch_expiry < ht)
+        {
+            const auto &batch_hash = batch_order.front().first;
+            if (batch_cmds.erase(batch_hash))
+                storage->try_release_cmd(storage->find_cmd(batch_hash));
+            batch_certs.erase(batch_hash);
+            batch_order.pop();
+        }
+        if (batch_cmds.insert(std::make_pair(cmd->get_hash(),
+                    static_cast<const CmdBatch &>(*cmd).get_cmds())).second)
+            batch_order.push(std::make_pair(cmd->get_hash(), ht));
+    }
+    on_fetch_cmd(storage->add_cmd(cmd));
+}
+
+void E2CBase::on_batch_ack(const BatchAck &ack) {
+    auto it = batch_acks.find(ack.batch_hash);
+    if (it == batch_acks.end() || it->second.has_ack(ack.rid)) return;
+    auto &ac = it->second;
+    ac.acks.push_back(std::make_pair(ack.rid, part_cert_bt(ack.cert->clone())));
+    /* f + 1 acks: at least one correct replica stores the batch */
+    const auto &config = get_config();
+    if (ac.acks.size() < config.nreplicas - config.nmajority + 1) return;
+    AvailCert cert = std::move(ac);
+    batch_acks.erase(it);
+    batch_certs.insert(std::make_pair(cert.batch_hash, cert));
+    stats.mempool_certs.add();
+    E2C_LOG_DEBUG("certified %s", std::string(cert).c_str());
+    ReplicaID proposer = pmaker->get_proposer();
+    if (proposer == get_id())
+        on_avail_cert(cert);
+    else
+        pn.send_msg(MsgAvailCert(cert), config.get_peer_id(proposer));
+}
+
+void E2CBase::on_avail_cert(const AvailCert &ac) {
+    if (pmaker->get_proposer() != get_id() ||
+        adopted_cmds.count(ac.batch_hash)) return;
+    /* the proposer may not be among the acks, fetch the batch from them
+     * for the commit */
+    for (const auto &a: ac.acks)
+        if (a.first != get_id())
+        {
+            const PeerId &peer = get_config().get_peer_id(a.first);
+            async_fetch_cmd(ac.batch_hash, &peer);
+        }
+    if (cmd_pending_buffer.empty())
+        batch_start = Tracer::now();
+    cmd_pending_buffer.push(ac.batch_hash);
+    stats.cmds_buffered.set(cmd_pending_buffer.size());
+    if (cmd_pending_buffer.size() >= blk_size)
+        propose_pending();
+}
+
+void E2CBase::batch_handler(MsgBatch &&msg, const Net::conn_t &conn) {
+    const PeerId peer = conn->get_peer_id();
+    if (peer.is_null()) return;
+    ReplicaID origin = msg.batch.get_origin();
+    if (origin >= get_config().nreplicas ||
+        get_config().get_peer_id(origin) != peer) return;
+    command_t cmd = new CmdBatch(std::move(msg.batch));
+    const uint256_t batch_hash = cmd->get_hash();
+    on_store_batch(cmd);
+    pn.send_msg(MsgBatchAck(BatchAck(get_id(), batch_hash,
+                        sign(AvailCert::ack_hash(batch_hash)), this)), peer);
+}
+
+void E2CBase::batch_ack_handler(MsgBatchAck &&msg, const Net::conn_t &conn) {
+    const PeerId peer = conn->get_peer_id();
+    if (peer.is_null()) return;
     msg.postponed_parse(this);
-    for (const auto &blk: msg.blks)
-        if (blk) on_fetch_blk(blk);
+    auto &ack = msg.ack;
+    auto it = batch_acks.find(ack.batch_hash);
+    if (it == batch_acks.end() || ack.rid >= get_config().nreplicas ||
+        get_config().get_peer_id(ack.rid) != peer ||
+        it->second.has_ack(ack.rid) ||
+        ack.cert->get_obj_hash() != AvailCert::ack_hash(ack.batch_hash)) return;
+    ack.cert->verify(get_config().get_pubkey(ack.rid), vpool).then(
+        [this, ack](bool valid) {
+            if (valid) on_batch_ack(ack);
+        });
+}
+
+void E2CBase::avail_cert_handler(MsgAvailCert &&msg, const Net::conn_t &conn) {
+    if (conn->get_peer_id().is_null()) return;
+    if (pmaker->get_proposer() != get_id()) return;
+    msg.postponed_parse(this);
+    auto &ac = msg.ac;
+    const auto &config = get_config();
+    if (!ac.is_valid(config.nreplicas - config.nmajority + 1, config.nreplicas))
+        return;
+    std::vector<promise_t> pms;
+    for (const auto &a: ac.acks)
+        pms.push_back(a.second->verify(config.get_pubkey(a.first), vpool));
+    promise::all(pms).then([this, ac](const promise::values_t values) {
+        for (const auto &v: values)
+            if (!promise::any_cast<bool>(v)) return;
+        on_avail_cert(ac);
+    });
+}
+
+void E2CBase::req_batch_handler(MsgReqBatch &&msg, const Net::conn_t &conn) {
+    const PeerId replica = conn->get_peer_id();
+    if (replica.is_null()) return;
+    std::vector<promise_t> pms;
+    for (const auto &h: msg.batch_hashes)
+        pms.push_back(async_fetch_cmd(h, nullptr));
+    promise::all(pms).then([replica, this](const promise::values_t values) {
+        std::vector<command_t> batches;
+        for (auto &v: values)
+            batches.push_back(promise::any_cast<command_t>(v));
+        pn.send_msg(MsgRespBatch(batches), replica);
+    });
+}
+
+void E2CBase::resp_batch_handler(MsgRespBatch &&msg, const Net::conn_t &conn) {
+    if (conn->get_peer_id().is_null()) return;
+    /* the requested hash is the one of the content, no need to trust the
+     * sender */
+    for (auto &b: msg.batches)
+        on_store_batch(new CmdBatch(std::move(b)));
+}
+
+bool E2CBase::near_commit_height(uint32_t height) const {
+    uint32_t ht = commit_height.load(std::memory_order_relaxed);
+    return (uint64_t)height + prop_seen_window >= ht &&
+            height <= (uint64_t)ht + prop_seen_window;
+}
+
+E2CBase::CommitTally *E2CBase::get_commit_tally(uint32_t height, const uint256_t &blk_hash) {
+    /* the heights come from signed votes, but a faulty replica may sign any */
+    if (!near_commit_height(height)) return nullptr;
+    return &commit_votes[height].insert(std::make_pair(blk_hash,
+                CommitTally{CommitCert(blk_hash, height), nullptr, false})).first->second;
+}
+
+void E2CBase::on_local_commit(const block_t &blk) {
+    const uint256_t &blk_hash = blk->get_hash();
+    const uint32_t height = blk->get_height();
+    /* forget the votes well below the committed blocks */
+    uint32_t ht = commit_height.load(std::memory_order_relaxed);
+    if (ht > prop_seen_window)
+        commit_votes.erase(commit_votes.begin(),
+                            commit_votes.lower_bound(ht - prop_seen_window));
+    auto tally = get_commit_tally(height, blk_hash);
+    if (tally == nullptr || tally->blk) return;
+    tally->blk = blk;
+    CommitVote vote(get_id(), height, blk_hash,
+                    sign(CommitCert::vote_hash(blk_hash, height)), this);
+    pn.multicast_msg(MsgCommitVote(vote), peers);
+    on_commit_vote(vote);
+}
+
+void E2CBase::on_commit_vote(const CommitVote &vote) {
+    auto tally = get_commit_tally(vote.height, vote.blk_hash);
+    if (tally == nullptr || tally->done) return;
+    auto &cert = tally->cert;
+    if (!cert.has_vote(vote.rid))
+        cert.votes.push_back(std::make_pair(vote.rid, part_cert_bt(vote.cert->clone())));
+    /* f + 1 votes: at least one correct replica has committed the block,
+     * wait for this replica to commit it too */
+    const auto &config = get_config();
+    if (!tally->blk || cert.votes.size() < config.nreplicas - config.nmajority + 1)
+        return;
+    tally->done = true;
+    stats.commit_certs.add();
+    E2C_LOG_DEBUG("certified %s", std::string(cert).c_str());
+    state_machine_certify(tally->blk, cert);
+}
+
+void E2CBase::commit_vote_handler(MsgCommitVote &&msg, const Net::conn_t &conn) {
+    const PeerId peer = conn->get_peer_id();
+    if (peer.is_null() || !commit_cert) return;
+    msg.postponed_parse(this);
+    auto &vote = msg.vote;
+    if (vote.rid >= get_config().nreplicas ||
+        get_config().get_peer_id(vote.rid) != peer ||
+        vote.cert->get_obj_hash() != CommitCert::vote_hash(vote.blk_hash, vote.height)) return;
+    /* no need to check the votes on a certified block */
+    auto it = commit_votes.find(vote.height);
+    if (it != commit_votes.end())
+    {
+        auto t = it->second.find(vote.blk_hash);
+        if (t != it->second.end() &&
+            (t->second.done || t->second.cert.has_vote(vote.rid))) return;
+    }
+    vote.cert->verify(get_config().get_pubkey(vote.rid), vpool).then(
+        [this, vote](bool valid) {
+            if (valid) on_commit_vote(vote);
+        });
+}
+
+void E2CBase::blame_handler(MsgBlame &&msg, const Net::conn_t &conn) {
+    if (conn->get_peer_id().is_null()) return;
+    msg.postponed_parse(this);
+    auto &bl = msg.bl;
+    /* the blames of the next view are held until entering it */
+    if ((bl.view != get_view() && bl.view != get_view() + 1) ||
+        bl.blamer >= get_config().nreplicas ||
+        bl.cert->get_obj_hash() != Blame::blame_hash(bl.view)) return;
+    stats.blames.add();
+    bl.cert->verify(get_config().get_pubkey(bl.blamer), vpool).then(
+        [this, bl](bool valid) {
+            if (valid) on_receive_blame(bl);
+        });
+}
+
+void E2CBase::equiv_blame_handler(MsgEquivBlame &&msg, const Net::conn_t &conn) {
+    if (conn->get_peer_id().is_null()) return;
+    msg.postponed_parse(this);
+    auto &eb = msg.bl;
+    /* only the leader of the current view can be proven faulty */
+    if (eb.view != get_view() || is_view_changing() || !eb.is_valid() ||
+        eb.blk1->get_proposer() != pmaker->get_proposer()) return;
+    promise::all(std::vector<promise_t>{
+        eb.blk1->verify(this, vpool),
+        eb.blk2->verify(this, vpool)
+    }).then([this, eb](const promise::values_t values) {
+        for (const auto &v: values)
+            if (!promise::any_cast<bool>(v)) return;
+        on_receive_equiv_blame(eb);
+    });
+}
+
+void E2CBase::quit_view_handler(MsgQuitView &&msg, const Net::conn_t &conn) {
+    if (conn->get_peer_id().is_null()) return;
+    msg.postponed_parse(this);
+    auto &qv = msg.qv;
+    if (qv.view < get_view() || (qv.view == get_view() && is_view_changing()) ||
+        qv.qc->get_obj_hash() != Blame::blame_hash(qv.view)) return;
+    /* the signatures of all blames are checked in parallel by the pool */
+    qv.qc->verify(get_config(), vpool).then([this, qv](bool valid) {
+        if (valid) on_receive_quit_view(qv);
+    });
+}
+
+void E2CBase::status_handler(MsgStatus &&msg, const Net::conn_t &conn) {
+    const PeerId peer = conn->get_peer_id();
+    if (peer.is_null()) return;
+    msg.postponed_parse(this);
+    auto &st = msg.st;
+    /* the statuses of the next view are held until entering it */
+    if ((st.view != get_view() && st.view != get_view() + 1) ||
+        st.rid >= get_config().nreplicas ||
+        get_config().get_peer_id(st.rid) != peer ||
+        st.cert->get_obj_hash() != Status::status_hash(st.view, st.blk_hash, st.height))
+        return;
+    st.cert->verify(get_config().get_pubkey(st.rid), vpool).then(
+        [this, st, peer](bool valid) {
+            if (!valid) return;
+            /* the leader may extend the block, it has to be delivered */
+            async_deliver_blk(st.blk_hash, peer).then([this, st]() {
+                on_receive_status(st);
+            });
+        });
 }
 
 bool E2CBase::conn_handler(const salticidae::ConnPool::conn_t &conn, bool connected) {
@@ -236,37 +1185,49 @@ bool E2CBase::conn_handler(const salticidae::ConnPool::conn_t &conn, bool connec
 }
 
 void E2CBase::print_stat() const {
-    logger.info("===== begin stats =====");
-    logger.info("-------- queues -------");
-    logger.info("blk_fetch_waiting: %lu", blk_fetch_waiting.size());
-    logger.info("blk_delivery_waiting: %lu", blk_delivery_waiting.size());
-    logger.info("decision_waiting: %lu", decision_waiting.size());
-    logger.info("-------- misc ---------");
-    logger.info("fetched: %lu", fetched);
-    logger.info("delivered: %lu", delivered);
-    logger.info("cmd_cache: %lu", storage->get_cmd_cache_size());
-    logger.info("blk_cache: %lu", storage->get_blk_cache_size());
-    logger.info("------ misc (10s) -----");
-    logger.info("fetched: %lu", part_fetched);
-    logger.info("delivered: %lu", part_delivered);
-    logger.info("decided: %lu", part_decided);
-    logger.info("gened: %lu", part_gened);
-    logger.info("avg. parent_size: %.3f",
-            part_delivered ? part_parent_size / double(part_delivered) : 0);
-    logger.info("delivery time: %.3f avg, %.3f min, %.3f max",
-            part_delivered ? part_delivery_time / double(part_delivered) : 0,
-            part_delivery_time_min == double_inf ? 0 : part_delivery_time_min,
-            part_delivery_time_max);
-
-    part_parent_size = 0;
-    part_fetched = 0;
-    part_delivered = 0;
-    part_decided = 0;
-    part_gened = 0;
-    part_delivery_time = 0;
-    part_delivery_time_min = double_inf;
-    part_delivery_time_max = 0;
-    logger.info("--- replica msg. (10s) ---");
+    auto snap = metrics.snapshot();
+    auto part = snap.delta(last_stat);
+    auto print_time = [](const char *name, const MetricSample *s) {
+        if (s == nullptr) return;
+        E2C_LOG_INFO("%s: %.3f avg, %.3f p50, %.3f p99", name,
+                    s->mean() / 1e6, s->percentile(50) / 1e6, s->percentile(99) / 1e6);
+    };
+    E2C_LOG_INFO("===== begin stats =====");
+    E2C_LOG_INFO("-------- queues -------");
+    E2C_LOG_INFO("blk_fetch_waiting: %lu", blk_fetch_waiting.size());
+    E2C_LOG_INFO("blk_delivery_waiting: %lu", blk_delivery_waiting.size());
+    {
+        std::lock_guard<std::mutex> _(decision_lock);
+        E2C_LOG_INFO("decision_waiting: %lu", decision_waiting.size());
+    }
+    E2C_LOG_INFO("catchup requests: %lu", catchup_queue.size());
+    E2C_LOG_INFO("cmds submitted: %.0f, to propose: %.0f, rejected (10s): %.0f",
+                snap.get("e2c_cmd_queue_depth", "queue=\"submitted\""),
+                snap.get("e2c_cmd_queue_depth", "queue=\"proposal\""),
+                part.get("e2c_cmd_rejected_total"));
+    E2C_LOG_INFO("-------- misc ---------");
+    E2C_LOG_INFO("fetched: %.0f", snap.get("e2c_blk_fetched_total"));
+    E2C_LOG_INFO("delivered: %.0f", snap.get("e2c_blk_delivered_total"));
+    E2C_LOG_INFO("cmd_cache: %lu", storage->get_cmd_cache_size());
+    E2C_LOG_INFO("blk_cache: %lu", storage->get_blk_cache_size());
+    E2C_LOG_INFO("------ misc (10s) -----");
+    double part_delivered = part.get("e2c_blk_delivered_total");
+    E2C_LOG_INFO("fetched: %.0f", part.get("e2c_blk_fetched_total"));
+    E2C_LOG_INFO("delivered: %.0f", part_delivered);
+    E2C_LOG_INFO("decided: %.0f", part.get("e2c_cmd_decided_total"));
+    E2C_LOG_INFO("gened: %.0f", part.get("e2c_blk_proposed_total"));
+    E2C_LOG_INFO("dup. proposals: %.0f", part.get("e2c_proposals_dup_total"));
+    if (mempool_batch)
+        E2C_LOG_INFO("mempool batches: %.0f, certified: %.0f, compact misses: %.0f",
+                part.get("e2c_mempool_batches_total"),
+                part.get("e2c_mempool_certs_total"),
+                part.get("e2c_compact_cmds_missed_total"));
+    E2C_LOG_INFO("avg. parent_size: %.3f",
+            part_delivered ? part.get("e2c_blk_parents_total") / part_delivered : 0);
+    print_time("delivery time", part.find("e2c_blk_delivery_time_us"));
+    print_time("commit latency", part.find("e2c_blk_commit_latency_us"));
+    print_time("verify time", part.find("e2c_blk_verify_time_us"));
+    E2C_LOG_INFO("--- replica msg. (10s) ---");
     size_t _nsent = 0;
     size_t _nrecv = 0;
     for (const auto &replica: peers)
@@ -278,22 +1239,62 @@ void E2CBase::print_stat() const {
         size_t nsb = conn->get_nsentb();
         size_t nrb = conn->get_nrecvb();
         conn->clear_msgstat();
-        logger.info("%s: %u(%u), %u(%u), %u",
-            get_hex10(replica).c_str(), ns, nsb, nr, nrb, part_fetched_replica[replica]);
+        E2C_LOG_INFO("%s: %u(%u), %u(%u), %.0f",
+            get_hex10(replica).c_str(), ns, nsb, nr, nrb,
+            part.get("e2c_blk_fetch_requests_total",
+                    "peer=\"" + get_hex10(replica) + "\""));
         _nsent += ns;
         _nrecv += nr;
-        part_fetched_replica[replica] = 0;
     }
-    nsent += _nsent;
-    nrecv += _nrecv;
-    logger.info("sent: %lu", _nsent);
-    logger.info("recv: %lu", _nrecv);
-    logger.info("--- replica msg. total ---");
-    logger.info("sent: %lu", nsent);
-    logger.info("recv: %lu", nrecv);
-    logger.info("====== end stats ======");
+    stats.nsent.add(_nsent);
+    stats.nrecv.add(_nrecv);
+    E2C_LOG_INFO("sent: %lu", _nsent);
+    E2C_LOG_INFO("recv: %lu", _nrecv);
+    E2C_LOG_INFO("--- replica msg. total ---");
+    E2C_LOG_INFO("sent: %.0f", snap.get("e2c_peer_msgs_sent_total") + _nsent);
+    E2C_LOG_INFO("recv: %.0f", snap.get("e2c_peer_msgs_recv_total") + _nrecv);
+    E2C_LOG_INFO("====== end stats ======");
+    last_stat = std::move(snap);
 }
 
+E2CBase::Stats::Stats(MetricsRegistry &m):
+    fetched(m.counter("e2c_blk_fetched_total", "blocks fetched")),
+    delivered(m.counter("e2c_blk_delivered_total", "blocks delivered")),
+    decided(m.counter("e2c_cmd_decided_total", "commands decided")),
+    proposed(m.counter("e2c_blk_proposed_total", "blocks proposed by this replica")),
+    parent_size(m.counter("e2c_blk_parents_total", "parent references of the delivered blocks")),
+    nsent(m.counter("e2c_peer_msgs_sent_total", "messages sent to the replicas")),
+    nrecv(m.counter("e2c_peer_msgs_recv_total", "messages received from the replicas")),
+    delivery_time(m.histogram("e2c_blk_delivery_time_us",
+            "time from requesting a block to its delivery",
+            exponential_buckets(100, 2, 20))),
+    commit_latency(m.histogram("e2c_blk_commit_latency_us",
+            "time from a block being proposed or first seen to its commit",
+            exponential_buckets(1000, 1.5, 30))),
+    verify_time(m.histogram("e2c_blk_verify_time_us",
+            "time to verify a block (parsing and hashing included for proposals)",
+            exponential_buckets(10, 2, 16))),
+    propose_size(m.histogram("e2c_msg_bytes", "size of a received message",
+            exponential_buckets(256, 2, 20), "type=\"propose\"")),
+    resp_blk_size(m.histogram("e2c_msg_bytes", "size of a received message",
+            exponential_buckets(256, 2, 20), "type=\"resp_blk\"")),
+    blames(m.counter("e2c_blames_recv_total", "blames received from the replicas")),
+    view_changes(m.counter("e2c_view_changes_total", "views entered after the first one")),
+    dup_proposals(m.counter("e2c_proposals_dup_total", "proposal copies dropped before parsing")),
+    mempool_batches(m.counter("e2c_mempool_batches_total", "mempool batches disseminated by this replica")),
+    mempool_certs(m.counter("e2c_mempool_certs_total", "availability certificates formed by this replica")),
+    compact_missed(m.counter("e2c_compact_cmds_missed_total", "commands of compact proposals requested from the sender")),
+    commit_certs(m.counter("e2c_commit_certs_total", "commit certificates gathered by this replica")),
+    cmds_rejected(m.counter("e2c_cmd_rejected_total", "client commands rejected by the admission control")),
+    cmds_queued(m.gauge("e2c_cmd_queue_depth", "commands in a queue of the replica", "queue=\"submitted\"")),
+    cmds_buffered(m.gauge("e2c_cmd_queue_depth", "commands in a queue of the replica", "queue=\"proposal\"")),
+    cmds_waiting(m.gauge("e2c_cmd_queue_depth", "commands in a queue of the replica", "queue=\"decision\"")),
+    catchup_sent(m.counter("e2c_catchup_sent_bytes_total", "bytes of blocks served to the replicas catching up")),
+    catchup_dropped(m.counter("e2c_catchup_dropped_total", "block requests dropped over the limit of a replica")),
+    catchup_wait(m.histogram("e2c_catchup_wait_us",
+            "time from receiving a block request to serving it",
+            exponential_buckets(10, 2, 20))) {}
+
 E2CBase::E2CBase(uint32_t blk_size,
                     ReplicaID rid,
                     privkey_bt &&priv_key,
@@ -310,40 +1311,273 @@ E2CBase::E2CBase(uint32_t blk_size,
         vpool(ec, nworker),
         pn(ec, netconfig),
         pmaker(std::move(pmaker)),
+        cmd_high_watermark(0),
+        cmd_low_watermark(0),
+        cmd_overloaded(false),
+        catchup_scheduled(false),
+        catchup_rate(0),
+        catchup_tokens(0),
+        mempool_batch(0),
+        batch_seq(0),
+        mempool_flush(0),
+        commit_cert(false),
+        commit_height(0),
 
-        fetched(0), delivered(0),
-        nsent(0), nrecv(0),
-        part_parent_size(0),
-        part_fetched(0),
-        part_delivered(0),
-        part_decided(0),
-        part_gened(0),
-        part_delivery_time(0),
-        part_delivery_time_min(double_inf),
-        part_delivery_time_max(0)
+        stats(metrics),
+        ingest_base(0)
 {
     /* register the handlers for msg from replicas */
     pn.reg_handler(salticidae::generic_bind(&E2CBase::propose_handler, this, _1, _2));
     pn.reg_handler(salticidae::generic_bind(&E2CBase::req_blk_handler, this, _1, _2));
     pn.reg_handler(salticidae::generic_bind(&E2CBase::resp_blk_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::fwd_cmd_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::fwd_reject_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::blame_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::equiv_blame_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::quit_view_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::batch_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::batch_ack_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::avail_cert_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::req_batch_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::resp_batch_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::propose_compact_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::req_compact_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::resp_compact_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::commit_vote_handler, this, _1, _2));
+    pn.reg_handler(salticidae::generic_bind(&E2CBase::status_handler, this, _1, _2));
     pn.reg_conn_handler(salticidae::generic_bind(&E2CBase::conn_handler, this, _1, _2));
+    catchup_timer = TimerEvent(ec, [this](TimerEvent &) { serve_catchup(); });
+    mempool_timer = TimerEvent(ec, [this](TimerEvent &) {
+        if (!mempool_buffer.empty()) disseminate_batch();
+    });
     pn.start();
     pn.listen(listen_addr);
 }
 
 void E2CBase::do_broadcast_proposal(const Proposal &prop) {
-    pn.multicast_msg(MsgPropose(prop), peers);
+    auto start = Tracer::now();
+    /* the blocks of the mempool refer to batches the replicas store */
+    if (mempool_batch && (!prop.raw || prop.compact))
+    {
+        MsgProposeCompact msg(prop);
+        const uint256_t digest = msg.serialized.get_hash();
+        uint32_t ht = prop.blk->get_height();
+        compact_sent[ht].push_back(std::make_pair(digest, prop.blk));
+        if (ht > prop_seen_window)
+            compact_sent.erase(compact_sent.begin(),
+                                compact_sent.lower_bound(ht - prop_seen_window));
+        /* drop the copies forwarded back to the proposer */
+        on_proposal_checked(prop_filter.digest(msg.serialized.data(),
+                                                msg.serialized.size()), true, ht);
+        pn.multicast_msg(std::move(msg), peers);
+    }
+    else
+    {
+        MsgPropose msg(prop);
+        on_proposal_checked(prop_filter.digest(msg.serialized.data(),
+                                                msg.serialized.size()),
+                            true, prop.blk->get_height());
+        pn.multicast_msg(std::move(msg), peers);
+    }
+    tracer.span("broadcast", trace_id(prop.blk->get_hash()), start, peers.size());
+}
+
+void E2CBase::do_broadcast_blame(const Blame &bl) {
+    pn.multicast_msg(MsgBlame(bl), peers);
+}
+
+void E2CBase::do_broadcast_equiv_blame(const EquivBlame &eb) {
+    pn.multicast_msg(MsgEquivBlame(eb), peers);
+}
+
+void E2CBase::do_broadcast_quit_view(const QuitView &qv) {
+    pn.multicast_msg(MsgQuitView(qv), peers);
+}
+
+void E2CBase::do_set_view_timer(uint32_t view, double timeout) {
+    view_timer = TimerEvent(ec, [this, view](TimerEvent &) {
+        view_timer_cb(view);
+        stats.view_changes.add();
+    });
+    view_timer.add(timeout);
+}
+
+void E2CBase::do_enter_view(uint32_t) {
+    adopted_cmds.clear();
+    ReplicaID proposer = pmaker->get_proposer();
+    /* the buffer of a former leader is not proposed anymore, the replicas
+     * hand their undecided commands to the new one instead */
+    if (proposer != get_id())
+    {
+        cmd_pending_buffer = std::queue<uint256_t>();
+        stats.cmds_buffered.set(0);
+    }
+    if (mempool_batch)
+    {
+        for (auto it = batch_certs.begin(); it != batch_certs.end();)
+        {
+            bool stored;
+            {
+                std::lock_guard<std::mutex> _(batch_lock);
+                stored = batch_cmds.count(it->first);
+            }
+            /* committed or expired */
+            if (!stored)
+            {
+                it = batch_certs.erase(it);
+                continue;
+            }
+            if (proposer == get_id())
+                on_avail_cert(it->second);
+            else
+                pn.send_msg(MsgAvailCert(it->second), get_config().get_peer_id(proposer));
+            it++;
+        }
+        return;
+    }
+    /* the leader buffers its own commands once synced */
+    if (proposer == get_id()) return;
+    std::vector<uint256_t> fwd;
+    {
+        std::lock_guard<std::mutex> _(decision_lock);
+        for (const auto &e: decision_order)
+        {
+            auto it = decision_waiting.find(e.first);
+            if (it != decision_waiting.end() && it->second.forward &&
+                it->second.since == e.second)
+                fwd.push_back(e.first);
+        }
+    }
+    if (!fwd.empty())
+        pn.send_msg(MsgFwdCmd(fwd), get_config().get_peer_id(proposer));
+}
+
+void E2CBase::do_send_status(const Status &st) {
+    ReplicaID proposer = pmaker->get_proposer();
+    if (proposer == get_id())
+        on_receive_status(st);
+    else
+        pn.send_msg(MsgStatus(st), get_config().get_peer_id(proposer));
+}
+
+void E2CBase::do_view_synced(uint32_t) {
+    adopted_cmds = get_uncommitted_cmds();
+    /* the commands submitted to this replica first, the earlier leaders may
+     * have left them undecided, then the ones buffered while the statuses
+     * were collected */
+    std::queue<uint256_t> buffer;
+    std::unordered_set<uint256_t> buffered;
+    if (!mempool_batch)
+    {
+        std::lock_guard<std::mutex> _(decision_lock);
+        for (const auto &e: decision_order)
+        {
+            auto it = decision_waiting.find(e.first);
+            if (it != decision_waiting.end() && it->second.since == e.second &&
+                !adopted_cmds.count(e.first) && buffered.insert(e.first).second)
+                buffer.push(e.first);
+        }
+    }
+    for (; !cmd_pending_buffer.empty(); cmd_pending_buffer.pop())
+    {
+        const auto &cmd_hash = cmd_pending_buffer.front();
+        if (!adopted_cmds.count(cmd_hash) && buffered.insert(cmd_hash).second)
+            buffer.push(cmd_hash);
+    }
+    cmd_pending_buffer = std::move(buffer);
+    stats.cmds_buffered.set(cmd_pending_buffer.size());
+    batch_start = Tracer::now();
+    while (blk_size > 0 && cmd_pending_buffer.size() >= blk_size)
+        propose_pending();
 }
 
 void E2CBase::do_decide(Finality &&fin) {
-    part_decided++;
+    if (!mempool_batch)
+    {
+        decide_cmd(std::move(fin));
+        return;
+    }
+    /* the block refers to a batch, decide on its commands (the Merkle path
+     * proves the batch, not them) */
+    fin.ncmds = 0;
+    fin.cmd_path.clear();
+    std::vector<uint256_t> cmds;
+    bool stored = false;
+    {
+        std::lock_guard<std::mutex> _(batch_lock);
+        auto it = batch_cmds.find(fin.cmd_hash);
+        if (it != batch_cmds.end())
+        {
+            cmds = std::move(it->second);
+            batch_cmds.erase(it);
+            stored = true;
+        }
+    }
+    if (!stored)
+    {
+        E2C_LOG_WARN("committed batch %s is missing, fetching it",
+                    get_hex10(fin.cmd_hash).c_str());
+        /* runs on a commit thread, the fetch belongs to the event loop; the
+         * batch is decided when it arrives (after the following blocks) */
+        tcall.async_call([this, fin](ThreadCall::Handle &) {
+            for (const auto &peer: peers)
+                async_fetch_cmd(fin.cmd_hash, &peer);
+            async_fetch_cmd(fin.cmd_hash, nullptr).then([this, fin](command_t cmd) {
+                {
+                    std::lock_guard<std::mutex> _(batch_lock);
+                    batch_cmds.erase(fin.cmd_hash);
+                }
+                decide_batch(fin, static_cast<const CmdBatch &>(*cmd).get_cmds());
+            });
+        });
+        return;
+    }
+    decide_batch(fin, cmds);
+}
+
+void E2CBase::decide_batch(const Finality &fin, const std::vector<uint256_t> &cmds) {
+    for (const auto &cmd_hash: cmds)
+    {
+        Finality _fin = fin;
+        _fin.cmd_hash = cmd_hash;
+        decide_cmd(std::move(_fin));
+    }
+}
+
+void E2CBase::decide_cmd(Finality &&fin) {
+    stats.decided.add();
     state_machine_execute(fin);
-    auto it = decision_waiting.find(fin.cmd_hash);
-    if (it != decision_waiting.end())
+    commit_cb_t callback;
     {
-        it->second(std::move(fin));
+        std::lock_guard<std::mutex> _(decision_lock);
+        auto it = decision_waiting.find(fin.cmd_hash);
+        if (it == decision_waiting.end()) return;
+        callback = std::move(it->second.callback);
         decision_waiting.erase(it);
     }
+    stats.cmds_waiting.add(-1);
+    callback(std::move(fin));
+}
+
+double E2CBase::get_decision_wait() {
+    std::lock_guard<std::mutex> _(decision_lock);
+    while (!decision_order.empty())
+    {
+        const auto &e = decision_order.front();
+        auto it = decision_waiting.find(e.first);
+        if (it != decision_waiting.end() && it->second.since == e.second)
+            return std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - e.second).count();
+        decision_order.pop_front();
+    }
+    return 0;
+}
+
+void E2CBase::check_progress() {
+    double now = std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (check_stalled(now, now - get_decision_wait()))
+        pmaker->impeach();
 }
 
 E2CBase::~E2CBase() {}
@@ -364,6 +1598,10 @@ void E2CBase::start(
             pn.add_peer(peer);
             pn.set_peer_addr(peer, addr);
             pn.conn_peer(peer);
+            stats.fetch_req[peer] = &metrics.counter(
+                "e2c_blk_fetch_requests_total",
+                "block fetch requests sent to a replica",
+                "peer=\"" + get_hex10(peer) + "\"");
         }
     }
 
@@ -376,39 +1614,85 @@ void E2CBase::start(
         ec.dispatch();
 
     cmd_pending.reg_handler(ec, [this](cmd_queue_t &q) {
-        std::pair<uint256_t, commit_cb_t> e;
+        CmdSubmission e;
+        size_t nsubmissions = 0;
         while (q.try_dequeue(e))
         {
+            stats.cmds_queued.add(-(int64_t)e.cmd_hashes.size());
             ReplicaID proposer = pmaker->get_proposer();
-            const auto &cmd_hash = e.first;
-            auto it = decision_waiting.find(cmd_hash);
-            if (it == decision_waiting.end())
-                it = decision_waiting.insert(std::make_pair(cmd_hash, e.second)).first;
-            else
-                e.second(Finality(id, 0, 0, 0, cmd_hash, uint256_t()));
-            if (proposer != get_id()) continue;
-            cmd_pending_buffer.push(cmd_hash);
-            if (cmd_pending_buffer.size() >= blk_size)
+            bool proposed = false;
+            /* the mempool streams the commands to every replica instead */
+            if (e.forward && !mempool_batch && proposer != get_id())
+                pn.send_msg(MsgFwdCmd(e.cmd_hashes),
+                            get_config().get_peer_id(proposer));
+            for (const auto &cmd_hash: e.cmd_hashes)
             {
-                std::vector<uint256_t> cmds;
-                for (uint32_t i = 0; i < blk_size; i++)
+                if (e.callback)
                 {
-                    cmds.push_back(cmd_pending_buffer.front());
-                    cmd_pending_buffer.pop();
-                }
-                logger.info("Leader is trying to propose here.");
-                pmaker->beat().then([this, cmds = std::move(cmds)](ReplicaID proposer) {
-                    if (proposer == get_id()) {
-                        logger.info("Calling propose");
-                        on_propose(cmds, get_parents());
-                        logger.info("Finished proposing");
+                    auto now = std::chrono::steady_clock::now();
+                    std::unique_lock<std::mutex> lock(decision_lock);
+                    if (decision_waiting.insert(std::make_pair(cmd_hash,
+                            DecisionWaiting{e.callback, now, e.forward})).second)
+                    {
+                        decision_order.push_back(std::make_pair(cmd_hash, now));
+                        lock.unlock();
+                        stats.cmds_waiting.add(1);
                     }
-                });
-                return true;
+                    else
+                    {
+                        lock.unlock();
+                        e.callback(Finality(id, 0, 0, 0, cmd_hash, uint256_t()));
+                    }
+                }
+                if (mempool_batch)
+                {
+                    mempool_buffer.push_back(cmd_hash);
+                    if (mempool_buffer.size() >= mempool_batch)
+                        disseminate_batch();
+                    else if (mempool_buffer.size() == 1)
+                        mempool_timer.add(mempool_flush);
+                    continue;
+                }
+                if (proposer != get_id() || adopted_cmds.count(cmd_hash)) continue;
+                if (cmd_pending_buffer.empty())
+                    batch_start = Tracer::now();
+                cmd_pending_buffer.push(cmd_hash);
+                stats.cmds_buffered.set(cmd_pending_buffer.size());
+                if (cmd_pending_buffer.size() >= blk_size)
+                {
+                    propose_pending();
+                    proposed = true;
+                }
             }
+            /* yield to the messages of the replicas */
+            if (proposed || ++nsubmissions == cmd_burst) return true;
         }
         return false;
     });
 }
 
+void E2CBase::propose_pending() {
+    /* keep the commands buffered until the view is entered and, for its
+     * leader, the highest block of the replicas is adopted */
+    if (is_view_changing() || !is_view_synced()) return;
+    std::vector<uint256_t> cmds;
+    for (uint32_t i = 0; i < blk_size; i++)
+    {
+        cmds.push_back(cmd_pending_buffer.front());
+        cmd_pending_buffer.pop();
+    }
+    stats.cmds_buffered.set(cmd_pending_buffer.size());
+    auto start = batch_start;
+    batch_start = Tracer::now();
+    E2C_LOG_DEBUG("Leader is trying to propose here.");
+    pmaker->beat().then([this, cmds = std::move(cmds), start](ReplicaID proposer) {
+        if (proposer == get_id()) {
+            block_t blk = on_propose(cmds, get_parents());
+            /* the commands buffered until their block is proposed */
+            tracer.span("batch", trace_id(blk->get_hash()), start, cmds.size());
+            stats.proposed.add();
+        }
+    });
+}
+
 }
@@ -14,22 +14,27 @@
 
 #include "libe2c/entity.h"
 #include "libe2c/e2c.h"
+#include "libe2c/sha256.h"
 
 namespace e2c {
 
-void Block::serialize(DataStream &s) const {
+void Block::serialize_header(DataStream &s) const {
     s << htole((uint32_t)proposer) ;
     s << htole((uint32_t)height) ;
     s << htole((uint32_t)parent_hashes.size());
     for (const auto &hash: parent_hashes)
         s << hash;
-    s << htole((uint32_t)cmds.size());
+    s << htole(ncmds) << cmd_root;
+    s << htole((uint32_t)extra.size()) << extra;
+}
+
+void Block::serialize(DataStream &s) const {
+    serialize_header(s);
     for (auto cmd: cmds)
         s << cmd;
-    s << htole((uint32_t)extra.size()) << extra;
 }
 
-void Block::unserialize(DataStream &s, E2CCore *hsc) {
+void Block::parse_header(DataStream &s) {
     uint32_t n;
     s >> n;
     n = letoh(n);
@@ -42,11 +47,8 @@ void Block::unserialize(DataStream &s, E2CCore *hsc) {
     parent_hashes.resize(n);
     for (auto &hash: parent_hashes)
         s >> hash;
-    s >> n;
-    n = letoh(n);
-    cmds.resize(n);
-    for (auto &cmd: cmds)
-        s >> cmd;
+    s >> n >> cmd_root;
+    ncmds = letoh(n);
     s >> n;
     n = letoh(n);
     if (n == 0)
@@ -56,18 +58,72 @@ void Block::unserialize(DataStream &s, E2CCore *hsc) {
         auto base = s.get_data_inplace(n);
         extra = bytearray_t(base, base + n);
     }
-    hash = salticidae::get_hash(*this);
+}
+
+void Block::parse_body(DataStream &s) {
+    /* a bogus count fails on the size check before the allocation */
+    if (s.size() < (size_t)ncmds * 32)
+        throw E2CError("truncated block body");
+    cmds.resize(ncmds);
+    for (auto &cmd: cmds)
+        s >> cmd;
+    if (MerkleTree::root(cmds) != cmd_root)
+        throw E2CError("block body does not match its header");
+}
+
+uint256_t Block::header_hash() const {
+    DataStream s;
+    serialize_header(s);
+    return sha256(s.data(), s.size());
+}
+
+/* The encoding of a header is canonical: the hash is the one of the bytes it
+ * was parsed from, no need to serialize it again. */
+
+void Block::unserialize(DataStream &s, E2CCore *) {
+    const uint8_t *base = s.data();
+    parse_header(s);
+    hash = sha256(base, s.data() - base);
+    parse_body(s);
+}
+
+void Block::unserialize_header(DataStream &s) {
+    const uint8_t *base = s.data();
+    parse_header(s);
+    hash = sha256(base, s.data() - base);
+    cmds.clear();
+}
+
+void Block::unserialize_batch(DataStream &s, std::vector<Block> &blks) {
+    Sha256Batch batch;
+    batch.reserve(blks.size());
+    for (auto &blk: blks)
+    {
+        const uint8_t *base = s.data();
+        blk.parse_header(s);
+        batch.add(base, s.data() - base);
+        blk.parse_body(s);
+    }
+    auto hashes = batch.digest();
+    for (size_t i = 0; i < blks.size(); i++)
+        blks[i].hash = hashes[i];
 }
 
 bool Block::verify(const E2CCore *hsc) const {
-    return signature->verify ( hsc->get_config().get_pubkey(proposer) ) ;
+    if (verified) return true;
+    /* a fetched block carries no signature, it is authenticated by the hash
+     * its child refers to it with */
+    if (!signature) return true;
+    return signature->get_obj_hash() == hash &&
+        signature->verify ( hsc->get_config().get_pubkey(proposer) ) ;
 }
 
 promise_t Block::verify(const E2CCore *hsc, VeriPool &vpool) const {
-    bool status = signature->verify ( hsc->get_config().get_pubkey(proposer) ) ;
-    return promise_t([status](promise_t &pm) {
-        pm.resolve(status);
-    });
+    if (verified || !signature)
+        return promise_t([](promise_t &pm) { pm.resolve(true); });
+    if (signature->get_obj_hash() != hash)
+        return promise_t([](promise_t &pm) { pm.resolve(false); });
+    return signature->verify(hsc->get_config().get_pubkey(proposer), vpool);
 }
 
 }
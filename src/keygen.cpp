@@ -26,11 +26,13 @@ int main(int argc, char **argv) {
     auto opt_n = Config::OptValInt::create(1);
     auto opt_algo = Config::OptValStr::create("secp256k1");
     config.add_opt("num", opt_n, Config::SET_VAL);
-    config.add_opt("algo", opt_algo, Config::SET_VAL);
+    config.add_opt("algo", opt_algo, Config::SET_VAL, 'A', "the signature scheme (secp256k1, ed25519)");
     config.parse(argc, argv);
     auto &algo = opt_algo->get();
     if (algo == "secp256k1")
         priv_key = new e2c::PrivKeySecp256k1();
+    else if (algo == "ed25519")
+        priv_key = new e2c::PrivKeyEd25519();
     else
         error(1, 0, "algo not supported");
     int n = opt_n->get();
@@ -0,0 +1,83 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libe2c/merkle.h"
+#include "libe2c/sha256.h"
+
+namespace e2c {
+
+/* the nodes of a level are hashed in one batch */
+static std::vector<uint256_t> next_level(const std::vector<uint256_t> &level) {
+    DataStream s;
+    for (const auto &h: level)
+        s << h;
+    size_t npairs = level.size() / 2;
+    Sha256Batch batch;
+    batch.reserve(npairs);
+    for (size_t i = 0; i < npairs; i++)
+        batch.add(s.data() + 64 * i, 64);
+    auto next = batch.digest();
+    if (level.size() & 1)
+        next.push_back(level.back());
+    return next;
+}
+
+static uint256_t hash_pair(const uint256_t &left, const uint256_t &right) {
+    DataStream s;
+    s << left << right;
+    return sha256(s.data(), s.size());
+}
+
+MerkleTree::MerkleTree(const std::vector<uint256_t> &leaves) {
+    levels.push_back(leaves);
+    if (leaves.empty())
+        levels.push_back(std::vector<uint256_t>{uint256_t()});
+    while (levels.back().size() > 1)
+        levels.push_back(next_level(levels.back()));
+}
+
+std::vector<uint256_t> MerkleTree::get_path(size_t idx) const {
+    std::vector<uint256_t> path;
+    for (size_t i = 0; i + 1 < levels.size(); i++, idx >>= 1)
+        if ((idx ^ 1) < levels[i].size())
+            path.push_back(levels[i][idx ^ 1]);
+    return path;
+}
+
+uint256_t MerkleTree::root(const std::vector<uint256_t> &leaves) {
+    if (leaves.empty()) return uint256_t();
+    if (leaves.size() == 1) return leaves[0];
+    auto level = next_level(leaves);
+    while (level.size() > 1)
+        level = next_level(level);
+    return level[0];
+}
+
+bool MerkleTree::verify(const uint256_t &root, const uint256_t &leaf,
+                        size_t idx, size_t n,
+                        const std::vector<uint256_t> &path) {
+    if (idx >= n) return false;
+    uint256_t h = leaf;
+    size_t k = 0;
+    for (; n > 1; idx >>= 1, n = (n + 1) / 2)
+    {
+        if ((idx ^ 1) >= n) continue; /* moved up unchanged */
+        if (k == path.size()) return false;
+        const auto &sib = path[k++];
+        h = idx & 1 ? hash_pair(sib, h) : hash_pair(h, sib);
+    }
+    return k == path.size() && h == root;
+}
+
+}
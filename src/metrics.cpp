@@ -0,0 +1,246 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+#include "libe2c/metrics.h"
+
+namespace e2c {
+
+size_t metrics_shard() {
+    static std::atomic<size_t> nthreads{0};
+    thread_local size_t shard = nthreads.fetch_add(1) % metrics_nshards;
+    return shard;
+}
+
+Histogram::Histogram(std::vector<uint64_t> &&_bounds): bounds(std::move(_bounds)) {
+    for (size_t i = 1; i < bounds.size(); i++)
+        if (bounds[i] <= bounds[i - 1])
+            throw std::invalid_argument("histogram bounds must be increasing");
+    for (auto &s: shards)
+    {
+        s.counts.reset(new std::atomic<uint64_t>[bounds.size() + 1]);
+        for (size_t i = 0; i <= bounds.size(); i++)
+            s.counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::vector<uint64_t> Histogram::get_counts() const {
+    std::vector<uint64_t> res(bounds.size() + 1, 0);
+    for (const auto &s: shards)
+        for (size_t i = 0; i < res.size(); i++)
+            res[i] += s.counts[i].load(std::memory_order_relaxed);
+    return res;
+}
+
+uint64_t Histogram::get_sum() const {
+    uint64_t sum = 0;
+    for (const auto &s: shards)
+        sum += s.sum.load(std::memory_order_relaxed);
+    return sum;
+}
+
+uint64_t Histogram::get_count() const {
+    uint64_t count = 0;
+    for (const auto &s: shards)
+        count += s.count.load(std::memory_order_relaxed);
+    return count;
+}
+
+std::vector<uint64_t> exponential_buckets(uint64_t start, double factor, size_t count) {
+    std::vector<uint64_t> res;
+    double b = start;
+    for (size_t i = 0; i < count; i++, b *= factor)
+    {
+        uint64_t v = (uint64_t)std::llround(b);
+        if (res.empty() || v > res.back()) res.push_back(v);
+    }
+    return res;
+}
+
+uint64_t MetricSample::percentile(double q) const {
+    uint64_t total = 0;
+    for (auto c: counts) total += c;
+    if (!total) return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(q / 100 * total));
+    uint64_t acc = 0;
+    for (size_t i = 0; i < bounds.size(); i++)
+        if ((acc += counts[i]) >= rank) return bounds[i];
+    /* falls into the overflow bucket */
+    return bounds.empty() ? 0 : bounds.back();
+}
+
+const MetricSample *MetricsSnapshot::find(const std::string &name,
+                                        const std::string &labels) const {
+    for (const auto &s: samples)
+        if (s.name == name && s.labels == labels) return &s;
+    return nullptr;
+}
+
+double MetricsSnapshot::get(const std::string &name, const std::string &labels) const {
+    auto s = find(name, labels);
+    return s ? s->value : 0;
+}
+
+MetricsSnapshot MetricsSnapshot::delta(const MetricsSnapshot &prev) const {
+    MetricsSnapshot res = *this;
+    for (auto &s: res.samples)
+    {
+        auto p = prev.find(s.name, s.labels);
+        if (p == nullptr || s.type == METRIC_GAUGE) continue;
+        s.value -= p->value;
+        if (s.type == METRIC_HISTOGRAM && p->counts.size() == s.counts.size())
+        {
+            for (size_t i = 0; i < s.counts.size(); i++)
+                s.counts[i] -= p->counts[i];
+            s.sum -= p->sum;
+            s.count -= p->count;
+        }
+    }
+    return res;
+}
+
+static std::string with_labels(const std::string &name,
+                                const std::string &labels,
+                                const std::string &extra = "") {
+    std::string l = labels;
+    if (!extra.empty())
+        l = l.empty() ? extra : l + "," + extra;
+    return l.empty() ? name : name + "{" + l + "}";
+}
+
+std::string MetricsSnapshot::to_prometheus() const {
+    static const char *type_names[] = {"counter", "gauge", "histogram"};
+    std::ostringstream os;
+    const std::string *family = nullptr;
+    for (const auto &s: samples)
+    {
+        if (!family || *family != s.name)
+        {
+            family = &s.name;
+            os << "# HELP " << s.name << " " << s.help << "\n"
+               << "# TYPE " << s.name << " " << type_names[s.type] << "\n";
+        }
+        if (s.type != METRIC_HISTOGRAM)
+        {
+            os << with_labels(s.name, s.labels) << " " << s.value << "\n";
+            continue;
+        }
+        uint64_t acc = 0;
+        for (size_t i = 0; i < s.bounds.size(); i++)
+        {
+            acc += s.counts[i];
+            os << with_labels(s.name + "_bucket", s.labels,
+                            "le=\"" + std::to_string(s.bounds[i]) + "\"")
+               << " " << acc << "\n";
+        }
+        os << with_labels(s.name + "_bucket", s.labels, "le=\"+Inf\"")
+           << " " << s.count << "\n"
+           << with_labels(s.name + "_sum", s.labels) << " " << s.sum << "\n"
+           << with_labels(s.name + "_count", s.labels) << " " << s.count << "\n";
+    }
+    return os.str();
+}
+
+MetricsRegistry::Entry &MetricsRegistry::get_entry(const std::string &name,
+                                                const std::string &labels,
+                                                const std::string &help,
+                                                MetricType type) {
+    auto it = entries.find(std::make_pair(name, labels));
+    if (it != entries.end())
+    {
+        if (it->second.type != type)
+            throw std::invalid_argument("metric " + name + " registered with another type");
+        return it->second;
+    }
+    Entry e;
+    e.name = name;
+    e.labels = labels;
+    e.help = help;
+    e.type = type;
+    return entries.insert(std::make_pair(std::make_pair(name, labels),
+                                        std::move(e))).first->second;
+}
+
+Counter &MetricsRegistry::counter(const std::string &name, const std::string &help,
+                                const std::string &labels) {
+    std::lock_guard<std::mutex> _(lock);
+    auto &e = get_entry(name, labels, help, METRIC_COUNTER);
+    if (!e.counter) e.counter = new Counter();
+    return *e.counter;
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name, const std::string &help,
+                            const std::string &labels) {
+    std::lock_guard<std::mutex> _(lock);
+    auto &e = get_entry(name, labels, help, METRIC_GAUGE);
+    if (!e.gauge) e.gauge = new Gauge();
+    return *e.gauge;
+}
+
+Histogram &MetricsRegistry::histogram(const std::string &name, const std::string &help,
+                                    std::vector<uint64_t> &&bounds,
+                                    const std::string &labels) {
+    std::lock_guard<std::mutex> _(lock);
+    auto &e = get_entry(name, labels, help, METRIC_HISTOGRAM);
+    if (!e.histogram) e.histogram = new Histogram(std::move(bounds));
+    return *e.histogram;
+}
+
+MetricsSnapshot MetricsRegistry::snapshot() const {
+    MetricsSnapshot snap;
+    std::lock_guard<std::mutex> _(lock);
+    snap.samples.reserve(entries.size());
+    for (const auto &p: entries)
+    {
+        const auto &e = p.second;
+        MetricSample s;
+        s.name = e.name;
+        s.labels = e.labels;
+        s.help = e.help;
+        s.type = e.type;
+        s.value = 0;
+        s.sum = s.count = 0;
+        switch (e.type)
+        {
+            case METRIC_COUNTER: s.value = e.counter->get(); break;
+            case METRIC_GAUGE: s.value = e.gauge->get(); break;
+            case METRIC_HISTOGRAM:
+                s.bounds = e.histogram->get_bounds();
+                s.counts = e.histogram->get_counts();
+                s.sum = e.histogram->get_sum();
+                /* derive the count from the buckets so that they agree */
+                for (auto c: s.counts) s.count += c;
+                s.value = s.count;
+                break;
+        }
+        snap.samples.push_back(std::move(s));
+    }
+    return snap;
+}
+
+bool MetricsRegistry::dump_prometheus(const std::string &path) const {
+    std::string text = snapshot().to_prometheus();
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (f == nullptr) return false;
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok = (fclose(f) == 0) && ok;
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+}
@@ -0,0 +1,357 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define E2C_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "libe2c/sha256.h"
+
+namespace e2c {
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha256_init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static inline uint32_t load_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+            ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/** The padded last block(s) of a message, the full blocks before them are
+ * read in place. */
+struct Sha256Tail {
+    uint8_t buf[128];
+    size_t nfull;   /**< full blocks of the message */
+    size_t nblocks; /**< all blocks, the padded ones included */
+
+    void init(const uint8_t *msg, size_t len) {
+        nfull = len / 64;
+        size_t rem = len % 64;
+        size_t ntail = rem + 9 > 64 ? 2 : 1;
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, msg + nfull * 64, rem);
+        buf[rem] = 0x80;
+        uint64_t nbits = (uint64_t)len * 8;
+        for (int i = 0; i < 8; i++)
+            buf[ntail * 64 - 1 - i] = nbits >> (8 * i);
+        nblocks = nfull + ntail;
+    }
+
+    const uint8_t *block(const uint8_t *msg, size_t i) const {
+        return i < nfull ? msg + i * 64 : buf + (i - nfull) * 64;
+    }
+};
+
+static inline uint32_t ror32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void compress_scalar(uint32_t st[8], const uint8_t *blk) {
+    uint32_t w[64];
+    for (int t = 0; t < 16; t++)
+        w[t] = load_be32(blk + 4 * t);
+    for (int t = 16; t < 64; t++)
+    {
+        uint32_t s0 = ror32(w[t - 15], 7) ^ ror32(w[t - 15], 18) ^ (w[t - 15] >> 3);
+        uint32_t s1 = ror32(w[t - 2], 17) ^ ror32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+        w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+    uint32_t a = st[0], b = st[1], c = st[2], d = st[3];
+    uint32_t e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int t = 0; t < 64; t++)
+    {
+        uint32_t t1 = h + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) +
+                    ((e & f) ^ (~e & g)) + sha256_k[t] + w[t];
+        uint32_t t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) +
+                    ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+    st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+static void hash_scalar(const uint8_t *msg, size_t len, uint8_t *digest) {
+    uint32_t st[8];
+    memcpy(st, sha256_init, sizeof(st));
+    Sha256Tail tail;
+    tail.init(msg, len);
+    for (size_t i = 0; i < tail.nblocks; i++)
+        compress_scalar(st, tail.block(msg, i));
+    for (int i = 0; i < 8; i++)
+        store_be32(digest + 4 * i, st[i]);
+}
+
+#ifdef E2C_SHA256_X86
+
+/* SHA-NI: four rounds per pair of sha256rnds2, the state kept as ABEF/CDGH */
+__attribute__((target("sha,sse4.1")))
+static void compress_shani(uint32_t st[8], const uint8_t *data, size_t nblocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128((const __m128i *)&st[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i *)&st[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);          /* CDAB */
+    state1 = _mm_shuffle_epi32(state1, 0x1b);    /* EFGH */
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);        /* CDGH */
+    for (; nblocks; nblocks--, data += 64)
+    {
+        __m128i abef = state0, cdgh = state1;
+        __m128i w[4];
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; g++)
+        {
+            __m128i &x = w[g & 3];
+            if (g < 4)
+                x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * g)), bswap);
+            else
+                x = _mm_sha256msg2_epu32(
+                        _mm_add_epi32(_mm_sha256msg1_epu32(x, w[(g + 1) & 3]),
+                                    _mm_alignr_epi8(w[(g + 3) & 3], w[(g + 2) & 3], 4)),
+                        w[(g + 3) & 3]);
+            __m128i msg = _mm_add_epi32(x, _mm_loadu_si128((const __m128i *)&sha256_k[4 * g]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+    tmp = _mm_shuffle_epi32(state0, 0x1b);       /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xb1);    /* DCHG */
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0); /* DCBA */
+    state1 = _mm_alignr_epi8(state1, tmp, 8);    /* HGFE */
+    _mm_storeu_si128((__m128i *)&st[0], state0);
+    _mm_storeu_si128((__m128i *)&st[4], state1);
+}
+
+static void hash_shani(const uint8_t *msg, size_t len, uint8_t *digest) {
+    uint32_t st[8];
+    memcpy(st, sha256_init, sizeof(st));
+    Sha256Tail tail;
+    tail.init(msg, len);
+    compress_shani(st, msg, tail.nfull);
+    compress_shani(st, tail.buf, tail.nblocks - tail.nfull);
+    for (int i = 0; i < 8; i++)
+        store_be32(digest + 4 * i, st[i]);
+}
+
+/* AVX2: lane i of each register holds the word of message i */
+#define AVX2_ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+__attribute__((target("avx2")))
+static void compress_avx2_x8(__m256i st[8], const uint8_t *const blks[8], __m256i active) {
+    __m256i w[16];
+    for (int t = 0; t < 16; t++)
+        w[t] = _mm256_setr_epi32(
+            load_be32(blks[0] + 4 * t), load_be32(blks[1] + 4 * t),
+            load_be32(blks[2] + 4 * t), load_be32(blks[3] + 4 * t),
+            load_be32(blks[4] + 4 * t), load_be32(blks[5] + 4 * t),
+            load_be32(blks[6] + 4 * t), load_be32(blks[7] + 4 * t));
+    __m256i a = st[0], b = st[1], c = st[2], d = st[3];
+    __m256i e = st[4], f = st[5], g = st[6], h = st[7];
+#pragma GCC unroll 64
+    for (int t = 0; t < 64; t++)
+    {
+        __m256i wt;
+        if (t < 16)
+            wt = w[t];
+        else
+        {
+            __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(w15, 7), AVX2_ROR(w15, 18)),
+                                        _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(w2, 17), AVX2_ROR(w2, 19)),
+                                        _mm256_srli_epi32(w2, 10));
+            wt = w[t & 15] = _mm256_add_epi32(
+                _mm256_add_epi32(w[t & 15], s0),
+                _mm256_add_epi32(w[(t - 7) & 15], s1));
+        }
+        __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(e, 6), AVX2_ROR(e, 11)),
+                                    AVX2_ROR(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, wt)),
+            _mm256_set1_epi32(sha256_k[t]));
+        __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(a, 2), AVX2_ROR(a, 13)),
+                                    AVX2_ROR(a, 22));
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b),
+                                    _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        __m256i t2 = _mm256_add_epi32(s0, maj);
+        h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+        d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+    }
+    __m256i v[8] = {a, b, c, d, e, f, g, h};
+    /* the lanes done with their message keep their state */
+    for (int i = 0; i < 8; i++)
+        st[i] = _mm256_blendv_epi8(st[i], _mm256_add_epi32(st[i], v[i]), active);
+}
+
+#undef AVX2_ROR
+
+__attribute__((target("avx2")))
+static void hash_avx2_x8(const uint8_t *const *msgs, const size_t *lens, size_t n,
+                        uint8_t (*digests)[32]) {
+    static const uint8_t zero_blk[64] = {};
+    Sha256Tail tails[8];
+    size_t maxblocks = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        tails[i].init(msgs[i], lens[i]);
+        maxblocks = std::max(maxblocks, tails[i].nblocks);
+    }
+    __m256i st[8];
+    for (int i = 0; i < 8; i++)
+        st[i] = _mm256_set1_epi32(sha256_init[i]);
+    for (size_t j = 0; j < maxblocks; j++)
+    {
+        const uint8_t *blks[8];
+        int32_t mask[8];
+        for (size_t i = 0; i < 8; i++)
+        {
+            bool on = i < n && j < tails[i].nblocks;
+            blks[i] = on ? tails[i].block(msgs[i], j) : zero_blk;
+            mask[i] = on ? -1 : 0;
+        }
+        compress_avx2_x8(st, blks, _mm256_loadu_si256((const __m256i *)mask));
+    }
+    for (int k = 0; k < 8; k++)
+    {
+        uint32_t words[8];
+        _mm256_storeu_si256((__m256i *)words, st[k]);
+        for (size_t i = 0; i < n; i++)
+            store_be32(digests[i] + 4 * k, words[i]);
+    }
+}
+
+static bool cpu_has(unsigned leaf, unsigned reg, unsigned bit) {
+    unsigned r[4];
+    if (!__get_cpuid_count(leaf, 0, &r[0], &r[1], &r[2], &r[3])) return false;
+    return (r[reg] >> bit) & 1;
+}
+
+#endif
+
+bool sha256_supported(Sha256Kernel kernel) {
+    switch (kernel)
+    {
+        case Sha256Kernel::scalar: return true;
+#ifdef E2C_SHA256_X86
+        /* CPUID.7.0:EBX.SHA[29], SSE4.1 in CPUID.1:ECX[19] */
+        case Sha256Kernel::shani:
+            return cpu_has(7, 1, 29) && cpu_has(1, 2, 19);
+        case Sha256Kernel::avx2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default: return false;
+    }
+}
+
+const char *sha256_kernel_name(Sha256Kernel kernel) {
+    switch (kernel)
+    {
+        case Sha256Kernel::scalar: return "scalar";
+        case Sha256Kernel::shani: return "sha-ni";
+        case Sha256Kernel::avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+Sha256Kernel sha256_kernel() {
+    /* SHA-NI takes a block in less time than AVX2 takes 8 blocks in its
+     * lanes, use the multi-buffer kernel only without it */
+    static const Sha256Kernel kernel =
+        sha256_supported(Sha256Kernel::shani) ? Sha256Kernel::shani :
+        sha256_supported(Sha256Kernel::avx2) ? Sha256Kernel::avx2 :
+        Sha256Kernel::scalar;
+    return kernel;
+}
+
+void sha256_batch(Sha256Kernel kernel,
+                    const uint8_t *const *msgs, const size_t *lens, size_t n,
+                    uint8_t (*digests)[32]) {
+    switch (kernel)
+    {
+#ifdef E2C_SHA256_X86
+        case Sha256Kernel::shani:
+            for (size_t i = 0; i < n; i++)
+                hash_shani(msgs[i], lens[i], digests[i]);
+            return;
+        case Sha256Kernel::avx2:
+            for (size_t i = 0; i < n; i += 8)
+                hash_avx2_x8(msgs + i, lens + i, std::min<size_t>(8, n - i), digests + i);
+            return;
+#endif
+        default:
+            for (size_t i = 0; i < n; i++)
+                hash_scalar(msgs[i], lens[i], digests[i]);
+    }
+}
+
+void sha256_batch(const uint8_t *const *msgs, const size_t *lens, size_t n,
+                    uint8_t (*digests)[32]) {
+    sha256_batch(sha256_kernel(), msgs, lens, n, digests);
+}
+
+static uint256_t to_uint256(const uint8_t *digest) {
+    DataStream s;
+    s.put_data(digest, digest + 32);
+    uint256_t h;
+    s >> h;
+    return h;
+}
+
+uint256_t sha256(const uint8_t *data, size_t len) {
+    uint8_t digest[32];
+    sha256_batch(&data, &len, 1, &digest);
+    return to_uint256(digest);
+}
+
+std::vector<uint256_t> Sha256Batch::digest() const {
+    std::unique_ptr<uint8_t[][32]> digests(new uint8_t[msgs.size()][32]);
+    sha256_batch(msgs.data(), lens.data(), msgs.size(), digests.get());
+    std::vector<uint256_t> hashes;
+    hashes.reserve(msgs.size());
+    for (size_t i = 0; i < msgs.size(); i++)
+        hashes.push_back(to_uint256(digests[i]));
+    return hashes;
+}
+
+}
@@ -0,0 +1,365 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libe2c/sim.h"
+
+namespace e2c {
+
+double SimNetwork::gen_delay() {
+    double delay = config.delay;
+    if (config.jitter > 0)
+        delay += std::uniform_real_distribution<double>(0, config.jitter)(rng);
+    return delay;
+}
+
+void SimNetwork::multicast(ReplicaID from, const bytearray_t &msg,
+                void (SimReplicaBase::*handler)(ReplicaID, bytearray_t &&),
+                bool lossy) {
+    if (replicas[from]->crashed) return;
+    for (auto replica: replicas)
+    {
+        if (replica->get_id() == from) continue;
+        if (lossy && config.loss > 0 && std::bernoulli_distribution(config.loss)(rng))
+        {
+            ndropped++;
+            continue;
+        }
+        nmsgs++;
+        nbytes += msg.size();
+        clock.schedule(gen_delay(), [replica, from, msg, handler]() mutable {
+            if (!replica->crashed)
+                (replica->*handler)(from, std::move(msg));
+        });
+    }
+}
+
+void SimNetwork::send(ReplicaID from, ReplicaID to, const bytearray_t &msg,
+                void (SimReplicaBase::*handler)(ReplicaID, bytearray_t &&)) {
+    if (replicas[from]->crashed) return;
+    auto replica = replicas[to];
+    nmsgs++;
+    nbytes += msg.size();
+    clock.schedule(gen_delay(), [replica, from, msg, handler]() mutable {
+        if (!replica->crashed)
+            (replica->*handler)(from, std::move(msg));
+    });
+}
+
+void SimNetwork::multicast_proposal(ReplicaID from, const bytearray_t &msg) {
+    multicast(from, msg, &SimReplicaBase::on_recv_proposal, true);
+}
+
+void SimReplicaBase::on_recv_proposal(ReplicaID from, bytearray_t &&raw) {
+    MsgPropose msg(DataStream(std::move(raw)));
+    msg.postponed_parse(this);
+    auto &prop = msg.proposal;
+    block_t blk = prop.blk;
+    if (blk->get_height() == 0) return;
+    /* proposals of the next leader are held by E2CCore during a view change */
+    if (blk->get_proposer() != sim.get_leader(get_view() + is_view_changing())) return;
+    async_deliver_blk(blk->get_hash(), from).then([this, prop = std::move(prop)]() {
+        on_receive_proposal(prop);
+    });
+}
+
+void SimReplicaBase::on_recv_blame(ReplicaID, bytearray_t &&raw) {
+    MsgBlame msg(DataStream(std::move(raw)));
+    msg.postponed_parse(this);
+    auto &bl = msg.bl;
+    if ((bl.view != get_view() && bl.view != get_view() + 1) ||
+        bl.blamer >= get_config().nreplicas ||
+        bl.cert->get_obj_hash() != Blame::blame_hash(bl.view) ||
+        !bl.cert->verify(get_config().get_pubkey(bl.blamer))) return;
+    on_receive_blame(bl);
+}
+
+void SimReplicaBase::on_recv_equiv_blame(ReplicaID, bytearray_t &&raw) {
+    MsgEquivBlame msg(DataStream(std::move(raw)));
+    msg.postponed_parse(this);
+    auto &eb = msg.bl;
+    if (eb.view != get_view() || !eb.is_valid() ||
+        eb.blk1->get_proposer() != sim.get_leader(eb.view) ||
+        !eb.blk1->verify(this) || !eb.blk2->verify(this)) return;
+    on_receive_equiv_blame(eb);
+}
+
+void SimReplicaBase::on_recv_quit_view(ReplicaID, bytearray_t &&raw) {
+    MsgQuitView msg(DataStream(std::move(raw)));
+    msg.postponed_parse(this);
+    auto &qv = msg.qv;
+    if (qv.view < get_view() || !qv.qc->verify(get_config())) return;
+    on_receive_quit_view(qv);
+}
+
+void SimReplicaBase::on_recv_status(ReplicaID from, bytearray_t &&raw) {
+    MsgStatus msg(DataStream(std::move(raw)));
+    msg.postponed_parse(this);
+    auto &st = msg.st;
+    if ((st.view != get_view() && st.view != get_view() + 1) ||
+        st.rid != from ||
+        st.cert->get_obj_hash() != Status::status_hash(st.view, st.blk_hash, st.height) ||
+        !st.cert->verify(get_config().get_pubkey(st.rid))) return;
+    async_deliver_blk(st.blk_hash, from).then([this, st]() {
+        on_receive_status(st);
+    });
+}
+
+promise_t SimReplicaBase::async_fetch_blk(const uint256_t &blk_hash,
+                                            ReplicaID replica) {
+    if (storage->is_blk_fetched(blk_hash))
+        return promise_t([this, &blk_hash](promise_t pm){
+            pm.resolve(storage->find_blk(blk_hash));
+        });
+    auto it = blk_fetch_waiting.find(blk_hash);
+    if (it != blk_fetch_waiting.end())
+        return it->second;
+    promise_t pm{[](promise_t){}};
+    blk_fetch_waiting.insert(std::make_pair(blk_hash, pm));
+    /* the request and the response both go through the network, the replica
+     * relaying a proposal always has delivered its ancestors */
+    auto &net = sim.get_net();
+    double rtt = net.gen_delay() + net.gen_delay();
+    net.get_clock().schedule(rtt, [this, blk_hash, replica]() {
+        auto &net = sim.get_net();
+        block_t src = net.get_replica(replica)->storage->find_blk(blk_hash);
+        DataStream s;
+        s << *src << *src->get_signature();
+        net.nmsgs += 2;
+        net.nbytes += sizeof(uint256_t) + s.size();
+        Block _blk;
+        _blk.unserialize(s, this);
+        _blk.set_signature(parse_part_cert(s));
+        block_t blk = storage->add_blk(std::move(_blk), get_config());
+        auto it = blk_fetch_waiting.find(blk_hash);
+        auto pm = it->second;
+        blk_fetch_waiting.erase(it);
+        pm.resolve(blk);
+    });
+    return pm;
+}
+
+promise_t SimReplicaBase::async_deliver_blk(const uint256_t &blk_hash,
+                                            ReplicaID replica) {
+    if (storage->is_blk_delivered(blk_hash))
+        return promise_t([this, &blk_hash](promise_t pm) {
+            pm.resolve(storage->find_blk(blk_hash));
+        });
+    auto it = blk_delivery_waiting.find(blk_hash);
+    if (it != blk_delivery_waiting.end())
+        return it->second;
+    promise_t pm{[](promise_t){}};
+    blk_delivery_waiting.insert(std::make_pair(blk_hash, pm));
+    async_fetch_blk(blk_hash, replica).then([this, replica](block_t blk) {
+        /* the parents should be delivered */
+        std::vector<promise_t> pms;
+        for (const auto &phash: blk->get_parent_hashes())
+            pms.push_back(async_deliver_blk(phash, replica));
+        promise::all(pms).then([this, blk]() {
+            auto it = blk_delivery_waiting.find(blk->get_hash());
+            auto pm = it->second;
+            blk_delivery_waiting.erase(it);
+            if (blk->verify(this) && on_deliver_blk(blk))
+                pm.resolve(blk);
+            else
+                pm.reject(blk);
+        });
+    });
+    return pm;
+}
+
+void SimReplicaBase::do_broadcast_proposal(const Proposal &prop) {
+    MsgPropose msg(prop);
+    sim.get_net().multicast_proposal(get_id(), bytearray_t(std::move(msg.serialized)));
+}
+
+void SimReplicaBase::do_decide(Finality &&fin) {
+    ndecided++;
+    cmd_waiting.erase(fin.cmd_hash);
+}
+
+void SimReplicaBase::do_consensus(const block_t &blk) {
+    double now = sim.get_clock().get_time();
+    ncommitted++;
+    auto it = sim.proposed_at.find(blk->get_hash());
+    if (it != sim.proposed_at.end())
+        commit_latency.record((now - it->second) * 1e6);
+    auto &config = sim.get_config();
+    if (config.crash_at >= 0 && sim.failover < 0 &&
+        blk->get_proposer() != config.proposer)
+        sim.failover = now - config.crash_at;
+}
+
+void SimReplicaBase::do_set_commit_timer(const block_t &blk, double timeout) {
+    sim.get_clock().schedule(timeout, [this, ht = blk->get_height(), v = get_view()]() {
+        if (!crashed) commit_timer_cb(ht, v);
+    });
+}
+
+void SimReplicaBase::do_broadcast_blame(const Blame &bl) {
+    MsgBlame msg(bl);
+    sim.get_net().multicast(get_id(), bytearray_t(std::move(msg.serialized)),
+                            &SimReplicaBase::on_recv_blame);
+}
+
+void SimReplicaBase::do_broadcast_equiv_blame(const EquivBlame &eb) {
+    MsgEquivBlame msg(eb);
+    sim.get_net().multicast(get_id(), bytearray_t(std::move(msg.serialized)),
+                            &SimReplicaBase::on_recv_equiv_blame);
+}
+
+void SimReplicaBase::do_broadcast_quit_view(const QuitView &qv) {
+    MsgQuitView msg(qv);
+    sim.get_net().multicast(get_id(), bytearray_t(std::move(msg.serialized)),
+                            &SimReplicaBase::on_recv_quit_view);
+}
+
+void SimReplicaBase::do_set_view_timer(uint32_t view, double timeout) {
+    sim.get_clock().schedule(timeout, [this, view]() {
+        if (!crashed) view_timer_cb(view);
+    });
+}
+
+void SimReplicaBase::do_enter_view(uint32_t view) {
+    /* the new leader buffers the commands once synced */
+    if (sim.get_leader(view) != get_id()) cmd_buffer.clear();
+}
+
+void SimReplicaBase::do_send_status(const Status &st) {
+    ReplicaID leader = sim.get_leader(st.view);
+    if (leader == get_id())
+    {
+        on_receive_status(st);
+        return;
+    }
+    MsgStatus msg(st);
+    sim.get_net().send(get_id(), leader, bytearray_t(std::move(msg.serialized)),
+                        &SimReplicaBase::on_recv_status);
+}
+
+void SimReplicaBase::do_view_synced(uint32_t) {
+    /* the undecided commands first, the earlier leaders may have left them,
+     * except the ones of the blocks this leader extends */
+    auto adopted = get_uncommitted_cmds();
+    std::unordered_set<uint256_t> buffered;
+    std::deque<uint256_t> buffer;
+    for (const auto &e: cmd_order)
+        if (cmd_waiting.count(e.first) && !adopted.count(e.first) &&
+            buffered.insert(e.first).second)
+            buffer.push_back(e.first);
+    for (const auto &cmd_hash: cmd_buffer)
+        if (cmd_waiting.count(cmd_hash) && !adopted.count(cmd_hash) &&
+            buffered.insert(cmd_hash).second)
+            buffer.push_back(cmd_hash);
+    cmd_buffer = std::move(buffer);
+    propose_pending();
+}
+
+void SimReplicaBase::submit(const std::vector<uint256_t> &cmds) {
+    if (crashed) return;
+    double now = sim.get_clock().get_time();
+    for (const auto &cmd_hash: cmds)
+        if (cmd_waiting.insert(std::make_pair(cmd_hash, now)).second)
+            cmd_order.push_back(std::make_pair(cmd_hash, now));
+    /* while the view is being quit, the leader of the next one */
+    if (sim.get_leader(get_view() + is_view_changing()) != get_id()) return;
+    cmd_buffer.insert(cmd_buffer.end(), cmds.begin(), cmds.end());
+    propose_pending();
+}
+
+void SimReplicaBase::propose_pending() {
+    if (crashed || is_view_changing() || !is_view_synced()) return;
+    size_t blk_size = sim.get_config().blk_size;
+    while (cmd_buffer.size() >= blk_size ||
+            (!cmd_buffer.empty() && sim.all_submitted()))
+    {
+        std::vector<uint256_t> cmds;
+        while (cmds.size() < blk_size && !cmd_buffer.empty())
+        {
+            /* decided meanwhile in a block of an earlier leader */
+            if (cmd_waiting.count(cmd_buffer.front()))
+                cmds.push_back(cmd_buffer.front());
+            cmd_buffer.pop_front();
+        }
+        if (cmds.empty()) break;
+        block_t blk = on_propose(cmds, get_parents());
+        sim.proposed_at[blk->get_hash()] = sim.get_clock().get_time();
+    }
+}
+
+void SimReplicaBase::start() {
+    sim.get_clock().schedule(get_delta(), [this]() { check_progress(); });
+}
+
+void SimReplicaBase::check_progress() {
+    if (crashed) return;
+    while (!cmd_order.empty())
+    {
+        auto it = cmd_waiting.find(cmd_order.front().first);
+        if (it != cmd_waiting.end() && it->second == cmd_order.front().second)
+            break;
+        cmd_order.pop_front();
+    }
+    /* nothing left to wait for */
+    if (cmd_order.empty() && sim.all_submitted()) return;
+    auto &clock = sim.get_clock();
+    double now = clock.get_time();
+    if (check_stalled(now, cmd_order.empty() ? now : cmd_order.front().second))
+        on_blame_timeout();
+    clock.schedule(get_delta(), [this]() { check_progress(); });
+}
+
+Simulation::Simulation(const SimConfig &config):
+        config(config), net(clock, config.netconfig), nsubmitted(0),
+        failover(-1) {
+    for (size_t i = 0; i < config.nreplicas; i++)
+    {
+        auto replica = new SimReplica<>(*this, i, new PrivKeyDummy());
+        replicas.push_back(replica);
+        net.add_replica(replica);
+    }
+    for (auto &r: replicas)
+    {
+        for (size_t i = 0; i < config.nreplicas; i++)
+            r->add_replica(i, PeerId(uint256_t()), new PubKeyDummy());
+        /* n > 2f in the synchronous setting */
+        r->on_init((config.nreplicas - 1) / 2);
+        r->set_delta(config.delta);
+    }
+}
+
+void Simulation::submit() {
+    std::vector<uint256_t> cmds;
+    for (size_t i = 0; i < config.blk_size; i++)
+        cmds.push_back(salticidae::get_hash(nsubmitted * config.blk_size + i));
+    nsubmitted++;
+    for (auto &r: replicas)
+        r->submit(cmds);
+    if (nsubmitted < config.nblocks)
+        clock.schedule(config.interval, [this]() { submit(); });
+}
+
+void Simulation::crash() {
+    replicas[config.proposer]->crashed = true;
+}
+
+double Simulation::run() {
+    clock.schedule(0, [this]() { submit(); });
+    if (config.crash_at >= 0)
+        clock.schedule(config.crash_at, [this]() { crash(); });
+    for (auto &r: replicas) r->start();
+    while (clock.step());
+    return clock.get_time();
+}
+
+}
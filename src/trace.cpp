@@ -0,0 +1,93 @@
+/**
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cinttypes>
+#include <cstdio>
+
+#include "libe2c/trace.h"
+
+namespace e2c {
+
+Tracer tracer;
+
+static uint32_t trace_tid() {
+    static std::atomic<uint32_t> nthreads{0};
+    thread_local uint32_t tid = nthreads.fetch_add(1);
+    return tid;
+}
+
+void Tracer::enable(size_t capacity, uint32_t _pid) {
+    size_t n = 1;
+    while (n < capacity) n <<= 1;
+    slots.reset(new Slot[n]);
+    mask = n - 1;
+    head.store(0, std::memory_order_relaxed);
+    pid = _pid;
+    start = now();
+    enabled.store(true, std::memory_order_release);
+}
+
+void Tracer::record(char phase, const char *name, uint64_t id,
+                    uint64_t ts, uint64_t dur, uint64_t arg) {
+    uint64_t idx = head.fetch_add(1, std::memory_order_relaxed);
+    auto &slot = slots[idx & mask];
+    slot.seq.store(2 * idx + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.phase.store(phase, std::memory_order_relaxed);
+    slot.tid.store(trace_tid(), std::memory_order_relaxed);
+    slot.ts.store(ts, std::memory_order_relaxed);
+    slot.dur.store(dur, std::memory_order_relaxed);
+    slot.id.store(id, std::memory_order_relaxed);
+    slot.arg.store(arg, std::memory_order_relaxed);
+    slot.seq.store(2 * idx + 2, std::memory_order_release);
+}
+
+bool Tracer::dump_chrome(const std::string &path) const {
+    FILE *f = fopen(path.c_str(), "w");
+    if (f == nullptr) return false;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+                "\"args\":{\"name\":\"replica %u\"}}", pid, pid);
+    uint64_t end = slots ? head.load(std::memory_order_acquire) : 0;
+    uint64_t begin = end > mask + 1 ? end - (mask + 1) : 0;
+    for (uint64_t idx = begin; idx < end; idx++)
+    {
+        const auto &slot = slots[idx & mask];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        const char *name = slot.name.load(std::memory_order_relaxed);
+        char phase = slot.phase.load(std::memory_order_relaxed);
+        uint32_t tid = slot.tid.load(std::memory_order_relaxed);
+        uint64_t ts = slot.ts.load(std::memory_order_relaxed);
+        uint64_t dur = slot.dur.load(std::memory_order_relaxed);
+        uint64_t id = slot.id.load(std::memory_order_relaxed);
+        uint64_t arg = slot.arg.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        /* skip the events being written or already overwritten */
+        if (seq != 2 * idx + 2 ||
+            slot.seq.load(std::memory_order_relaxed) != seq) continue;
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"e2c\",\"ph\":\"%c\","
+                    "\"pid\":%u,\"tid\":%u,\"ts\":%.3f",
+                name, phase, pid, tid, ts / 1e3);
+        if (phase == 'X')
+            fprintf(f, ",\"dur\":%.3f", dur / 1e3);
+        else if (phase == 'i')
+            fprintf(f, ",\"s\":\"t\"");
+        fprintf(f, ",\"id\":\"0x%" PRIx64 "\",\"args\":{\"arg\":%" PRIu64 "}}", id, arg);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+}
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "libe2c/binlog.h"
+
+using namespace e2c;
+
+/* Encode the arguments of the protocol logs into records and check that they
+ * render as printf would, then write them through a BinLog and read the file
+ * back. */
+
+template<typename... Args>
+static BinLogRecord encode(const Args &...args) {
+    BinLogRecord rec;
+    rec.nbytes = 0;
+    rec.put_args(args...);
+    return rec;
+}
+
+template<typename... Args>
+static size_t check(const char *fmt, const Args &...args) {
+    char expected[512];
+    snprintf(expected, sizeof(expected), fmt, args...);
+    std::string got = encode(args...).render(fmt);
+    if (got == expected) return 0;
+    printf("\"%s\": got \"%s\", expected \"%s\"\n", fmt, got.c_str(), expected);
+    return 1;
+}
+
+int main() {
+    size_t nerrors = 0;
+    nerrors += check("Node %u proposing block %016lx at height %u with %lu commands",
+                    3u, 0x1234abcdUL, 42u, (size_t)1000);
+    nerrors += check("Committing block %016lx at height %u", ~0UL, 7u);
+    nerrors += check("view %d, delta %.3f, %s%%", -5, 0.125, "ok");
+    nerrors += check("%5s|%-4u|%c", "ab", 9u, 'x');
+    /* a missing argument is marked, not read past the payload */
+    if (encode(1u).render("%u %u") != "1 <?>") nerrors++;
+    /* the strings are truncated to the room left */
+    std::string big(300, 'a');
+    auto rec = encode(big);
+    if (rec.nbytes > BinLogRecord::payload_size ||
+        rec.render("%s") != big.substr(0, BinLogRecord::payload_size - 1)) nerrors++;
+
+    char path[] = "/tmp/test_binlog.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return 1;
+    close(fd);
+    BinLog log;
+    if (!log.open(path)) return 1;
+    const char *fmt = "Committing block %016lx at height %u";
+    uint32_t id = log.register_format(fmt);
+    const size_t nrecords = 100;
+    for (size_t i = 0; i < nrecords; i++)
+        log.write(id, (uint64_t)i * 0x10001, (uint32_t)i);
+    /* short-lived threads, as the commit timers, reuse the rings of the
+     * exited ones; none of their records is lost */
+    const size_t nthreads = 20;
+    uint32_t tid_id = log.register_format("thread %u");
+    for (size_t i = 0; i < nthreads; i++)
+    {
+        std::thread([&log, tid_id, i]() {
+            for (size_t j = 0; j < nrecords; j++)
+                log.write(tid_id, (uint32_t)i);
+        }).join();
+        usleep(10000);
+    }
+    log.close();
+
+    FILE *f = fopen(path, "rb");
+    char magic[8];
+    if (f == nullptr || fread(magic, 1, 8, f) != 8 || memcmp(magic, "E2CBLOG1", 8))
+        return 1;
+    std::string read_fmt;
+    size_t nread = 0, nthread_read = 0;
+    uint16_t max_tid = 0;
+    int tag;
+    while ((tag = fgetc(f)) != EOF)
+    {
+        if (tag == 'F')
+        {
+            uint32_t _id;
+            uint16_t len;
+            if (fread(&_id, sizeof(_id), 1, f) != 1 ||
+                fread(&len, sizeof(len), 1, f) != 1) break;
+            std::string s(len, 0);
+            if (fread(&s[0], 1, len, f) != len) nerrors++;
+            if (_id == id) read_fmt = s;
+            else if (_id != tid_id) nerrors++;
+        }
+        else if (tag == 'R')
+        {
+            BinLogRecord r;
+            if (fread(&r, BinLogRecord::size, 1, f) != 1) break;
+            if (r.fmt_id == tid_id)
+            {
+                max_tid = std::max(max_tid, r.tid);
+                nthread_read++;
+                continue;
+            }
+            char expected[128];
+            snprintf(expected, sizeof(expected), fmt, (uint64_t)nread * 0x10001, (uint32_t)nread);
+            if (r.fmt_id != id || r.render(read_fmt) != expected) nerrors++;
+            nread++;
+        }
+        else
+        {
+            nerrors++;
+            break;
+        }
+    }
+    fclose(f);
+    unlink(path);
+    if (read_fmt != fmt || nread != nrecords) nerrors++;
+    if (nthread_read != nthreads * nrecords || (size_t)max_tid + 1 >= nthreads) nerrors++;
+    printf("binlog records: %lu errors\n", nerrors);
+    return nerrors ? 1 : 0;
+}
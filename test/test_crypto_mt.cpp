@@ -0,0 +1,58 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "libe2c/crypto.h"
+
+using namespace e2c;
+
+/* Serialize distinct keys and signatures from many threads at once and
+ * check every encoding against the one made by a single thread. */
+
+static const size_t nthreads = 8;
+static const size_t nrounds = 20000;
+
+int main() {
+    std::vector<PrivKeySecp256k1> privs(nthreads);
+    std::vector<PubKeySecp256k1> pubs;
+    std::vector<PartCertSecp256k1> certs;
+    std::vector<bytearray_t> expected;
+    for (size_t i = 0; i < nthreads; i++)
+    {
+        privs[i].from_rand();
+        pubs.push_back(PubKeySecp256k1(privs[i]));
+        certs.push_back(PartCertSecp256k1(privs[i], salticidae::get_hash(i)));
+        DataStream s;
+        s << pubs[i] << certs[i];
+        expected.push_back(std::move(s));
+    }
+
+    std::atomic<size_t> nerrors{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nthreads; i++)
+        threads.push_back(std::thread([&, i]() {
+            while (!go.load()) std::this_thread::yield();
+            for (size_t r = 0; r < nrounds; r++)
+            {
+                DataStream s;
+                s << pubs[i] << certs[i];
+                if (bytearray_t(std::move(s)) != expected[i]) nerrors++;
+            }
+        }));
+    go = true;
+    for (auto &t: threads) t.join();
+
+    /* the encodings must also parse back and verify */
+    for (size_t i = 0; i < nthreads; i++)
+    {
+        DataStream s(expected[i]);
+        PubKeySecp256k1 pub;
+        PartCertSecp256k1 cert;
+        s >> pub >> cert;
+        if (!cert.verify(pub)) nerrors++;
+    }
+    printf("%lu threads x %lu rounds: %lu errors\n",
+            nthreads, nrounds, nerrors.load());
+    return nerrors ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+#include <random>
+#include <vector>
+
+#include "libe2c/merkle.h"
+
+using namespace e2c;
+
+/* Build the trees of all widths up to max_leaves and check the path of every
+ * leaf against the root, then check that a wrong leaf, index or path
+ * is rejected. */
+
+static const size_t max_leaves = 70;
+
+static uint256_t rand_hash(std::mt19937 &rng) {
+    DataStream s;
+    for (size_t i = 0; i < 8; i++)
+        s << (uint32_t)rng();
+    uint256_t h;
+    s >> h;
+    return h;
+}
+
+int main() {
+    std::mt19937 rng(0);
+    size_t nerrors = 0;
+    if (MerkleTree::root({}) != uint256_t() ||
+        MerkleTree({}).get_root() != uint256_t())
+        nerrors++;
+    for (size_t n = 1; n <= max_leaves; n++)
+    {
+        std::vector<uint256_t> leaves;
+        for (size_t i = 0; i < n; i++)
+            leaves.push_back(rand_hash(rng));
+        MerkleTree tree(leaves);
+        const auto &root = tree.get_root();
+        if (MerkleTree::root(leaves) != root) nerrors++;
+        for (size_t i = 0; i < n; i++)
+        {
+            auto path = tree.get_path(i);
+            if (!MerkleTree::verify(root, leaves[i], i, n, path)) nerrors++;
+            if (MerkleTree::verify(root, leaves[(i + 1) % n], i, n, path) && n > 1)
+                nerrors++;
+            if (MerkleTree::verify(root, leaves[i], i + n, n, path)) nerrors++;
+            if (!path.empty())
+            {
+                auto bad = path;
+                bad.back() = rand_hash(rng);
+                if (MerkleTree::verify(root, leaves[i], i, n, bad)) nerrors++;
+                bad.pop_back();
+                if (MerkleTree::verify(root, leaves[i], i, n, bad)) nerrors++;
+            }
+        }
+    }
+    printf("trees of 1 to %lu leaves: %lu errors\n", max_leaves, nerrors);
+    return nerrors ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+#include <random>
+#include <vector>
+
+#include "libe2c/sha256.h"
+
+using namespace e2c;
+
+/* Hash batches of random messages, of all lengths around the block and
+ * padding boundaries, with every kernel the CPU runs and check the digests
+ * against salticidae::get_hash. */
+
+static const size_t nrounds = 200;
+static const size_t max_batch = 21;
+
+int main() {
+    std::mt19937 rng(0);
+    size_t nerrors = 0;
+    for (auto kernel: {Sha256Kernel::scalar, Sha256Kernel::shani, Sha256Kernel::avx2})
+    {
+        if (!sha256_supported(kernel))
+        {
+            printf("%s: not supported\n", sha256_kernel_name(kernel));
+            continue;
+        }
+        size_t nbad = 0;
+        for (size_t r = 0; r < nrounds; r++)
+        {
+            size_t n = r % max_batch + 1;
+            std::vector<bytearray_t> msgs(n);
+            std::vector<const uint8_t *> ptrs;
+            std::vector<size_t> lens;
+            for (auto &m: msgs)
+            {
+                /* lengths up to 3 blocks, sometimes a long one */
+                m.resize(rng() % 8 ? rng() % 193 : rng() % 5000);
+                for (auto &c: m) c = rng();
+                ptrs.push_back(m.data());
+                lens.push_back(m.size());
+            }
+            std::vector<uint8_t> digests(32 * n);
+            sha256_batch(kernel, ptrs.data(), lens.data(), n,
+                        (uint8_t (*)[32])digests.data());
+            for (size_t i = 0; i < n; i++)
+            {
+                DataStream s;
+                s << salticidae::get_hash(msgs[i]);
+                if (bytearray_t(digests.begin() + 32 * i, digests.begin() + 32 * (i + 1)) !=
+                    bytearray_t(std::move(s)))
+                    nbad++;
+            }
+        }
+        printf("%s: %lu rounds, %lu errors\n", sha256_kernel_name(kernel), nrounds, nbad);
+        nerrors += nbad;
+    }
+    /* the batch helper with the kernel picked at run time */
+    Sha256Batch batch;
+    std::vector<bytearray_t> msgs;
+    for (size_t i = 0; i < 100; i++)
+        msgs.push_back(bytearray_t(i, (uint8_t)i));
+    for (const auto &m: msgs)
+        batch.add(m.data(), m.size());
+    auto hashes = batch.digest();
+    for (size_t i = 0; i < msgs.size(); i++)
+        if (hashes[i] != salticidae::get_hash(msgs[i])) nerrors++;
+    printf("default kernel %s: %lu errors\n",
+            sha256_kernel_name(sha256_kernel()), nerrors);
+    return nerrors ? 1 : 0;
+}